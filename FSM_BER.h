@@ -0,0 +1,202 @@
+/**********************************************************
+ * Filename:    FSM_BER.h
+ *
+ * Description: Bit-error injection between 25GMII TX and
+ *              25GMII RX. Errors hit the 36 bits of a column
+ *              (32 data and 4 control bits) at a configured
+ *              rate, either independently or in bursts of a
+ *              Gilbert-Elliott channel: a good and a bad state,
+ *              each with its own error rate, and geometric
+ *              sojourn times. With -ber-columns, the rates are
+ *              per column instead of per bit. A column hit by
+ *              any error is received as an errored (E) column.
+ *
+ *              Error positions are drawn by geometric skipping:
+ *              the distance to the next error is drawn directly,
+ *              so the cost is proportional to the number of
+ *              errors and state changes, not to the number of
+ *              bits, and a BER of 1e-12 costs no more than an
+ *              error-free link. Errors use their own random-
+ *              number generator, seeded from SimRand() once, so
+ *              the traffic of a run does not depend on them.
+ *
+ *********************************************************/
+
+#ifndef _FSM_BER_H_INCLUDED_
+#define _FSM_BER_H_INCLUDED_
+
+#include <math.h>
+#include "FSM_base.h"
+
+const int32s COLUMN_BITS     = 36;
+const int64s NO_ERROR_AHEAD  = (int64s)1 << 62;    // distance meaning "never"
+
+/////////////////////////////////////////////////////////////////////
+// Bit-error injection state machine; passes the vectors of a W-column
+// MII unchanged except for the errored columns. It is not timed
+// (DLY_NONE): its delay is counted in 25GMII RX.
+/////////////////////////////////////////////////////////////////////
+template< int16s W = 1 > class fsm_bit_error_t: public fsm_base_t< DLY_NONE, typename mii_units_t< W >::vector_t >
+{
+	public:
+
+		typedef fsm_base_t< DLY_NONE, typename mii_units_t< W >::vector_t > base_t;
+		typedef typename mii_units_t< W >::vector_t vector_t;
+
+	private:
+
+		static const int32s VECTOR_COLUMNS = 2 * W;
+
+		bit_error_params_t params;
+		int32s	unit_bits;			// bits per error unit: 1, or a whole column
+		int64s	vector_units;		// error units per vector
+		int64s	next_error;			// units from the start of the next vector to the next error
+		int64s	sojourn;			// units left in the current channel state, bursty channel only
+		int8u	bad_state;
+		int64u	rng_state;
+
+		int64s	ErrorCount;			// errored units
+		int64s	ColumnCount;		// errored columns
+		int64s	VectorCount;
+
+		/////////////////////////////////////////////////////////////
+		// 64-bit generator (SplitMix64); SimRand() has 15 bits only
+		/////////////////////////////////////////////////////////////
+		inline int64u NextRandom (void)
+		{
+			int64u z = (this->rng_state += 0x9E3779B97F4A7C15ull);
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+			return z ^ (z >> 31);
+		}
+
+		/////////////////////////////////////////////////////////////
+		// Error-free units before the next error at the given rate
+		/////////////////////////////////////////////////////////////
+		int64s Geometric (DOUBLE rate)
+		{
+			if (rate >= 1.0)
+				return 0;
+			if (rate <= 0.0)
+				return NO_ERROR_AHEAD;
+
+			DOUBLE u = ((NextRandom () >> 11) + 1.0) / 9007199254740992.0;		// (0, 1], 53 bits
+			DOUBLE skip = floor (log (u) / log1p (-rate));
+			return skip < (DOUBLE)NO_ERROR_AHEAD ? (int64s)skip : NO_ERROR_AHEAD;
+		}
+
+		/////////////////////////////////////////////////////////////
+		// Error-free units between the current position and the next
+		// error, through as many state changes as it takes
+		/////////////////////////////////////////////////////////////
+		int64s NextError (void)
+		{
+			if (this->params.good_length <= 0)
+				return Geometric (this->params.rate);
+
+			int64s distance = 0;
+			while (distance < NO_ERROR_AHEAD)
+			{
+				int64s skip = Geometric (this->bad_state ? this->params.burst_rate : this->params.rate);
+				if (skip < this->sojourn)
+				{
+					this->sojourn -= skip + 1;
+					return distance + skip;
+				}
+
+				distance += this->sojourn;
+				this->bad_state ^= 1;
+				this->sojourn = 1 + Geometric (1.0 / (this->bad_state ? this->params.bad_length : this->params.good_length));
+			}
+			return NO_ERROR_AHEAD;
+		}
+
+		/////////////////////////////////////////////////////////////
+		// Errors falling into the vector just received
+		/////////////////////////////////////////////////////////////
+		void Inject (vector_t& vctr)
+		{
+			int16s last_column = -1;
+
+			while (this->next_error < this->vector_units)
+			{
+				int16s n = (int16s)(this->next_error * this->unit_bits / COLUMN_BITS);
+				if (n != last_column)
+				{
+					_36b_t& column = ColumnOf (vctr, n);
+					column = _36b_t (column, E_BLOCK, column.GetSeqNumber ());
+					this->ColumnCount++;
+					last_column = n;
+				}
+				this->ErrorCount++;
+
+				int64s skip = NextError ();
+				this->next_error = skip < NO_ERROR_AHEAD ? this->next_error + 1 + skip : NO_ERROR_AHEAD;
+			}
+		}
+
+	public:
+
+		void ReceiveUnit (vector_t vctr)
+		{
+			if (this->next_error < this->vector_units)
+				Inject (vctr);
+			if (this->next_error < NO_ERROR_AHEAD)
+				this->next_error -= this->vector_units;
+
+			this->VectorCount++;
+			this->output_block = vctr;
+			this->output_ready = true;
+		}
+
+		inline bool Enabled (void) const	{ return this->params.rate > 0 || (this->params.good_length > 0 && this->params.burst_rate > 0); }
+		inline int64s GetErrorCount (void) const	{ return this->ErrorCount; }
+		inline int64s GetColumnCount (void) const	{ return this->ColumnCount; }
+		inline int64s GetUnitCount (void) const		{ return this->VectorCount * this->vector_units; }
+		inline bool   PerColumn (void) const		{ return this->params.per_column; }
+
+		fsm_bit_error_t (const bit_error_params_t& prm = SimOptions.bit_errors)
+		{
+			// initialize internal variables
+			this->params      = prm;
+			this->unit_bits   = prm.per_column ? COLUMN_BITS : 1;
+			this->vector_units = VECTOR_COLUMNS * COLUMN_BITS / this->unit_bits;
+			this->bad_state   = 0;
+			this->sojourn     = NO_ERROR_AHEAD;
+			this->rng_state   = 0;
+			this->next_error  = NO_ERROR_AHEAD;
+			this->ErrorCount  = 0;
+			this->ColumnCount = 0;
+			this->VectorCount = 0;
+
+			// SimRand() is drawn only on a link with errors
+			if (Enabled ())
+			{
+				for (int16s n = 0; n < 4; n++)
+					this->rng_state = (this->rng_state << 15) | (int64u)SimRand ();
+				if (prm.good_length > 0)
+					this->sojourn = 1 + Geometric (1.0 / prm.good_length);
+				this->next_error = NextError ();
+			}
+		}
+
+		/////////////////////////////////////////////////////////////
+		// Save/restore state (see sim_checkpoint.h)
+		/////////////////////////////////////////////////////////////
+		template< class archive_t > void Serialize (archive_t& ar)
+		{
+			base_t::Serialize (ar);
+			ar.Raw (this->params);
+			ar.Raw (this->unit_bits);
+			ar.Raw (this->vector_units);
+			ar.Raw (this->next_error);
+			ar.Raw (this->sojourn);
+			ar.Raw (this->bad_state);
+			ar.Raw (this->rng_state);
+			ar.Raw (this->ErrorCount);
+			ar.Raw (this->ColumnCount);
+			ar.Raw (this->VectorCount);
+		}
+};
+
+#endif // _FSM_BER_H_INCLUDED_
@@ -108,6 +108,8 @@ public:
         parity_block_count      = 0;
         output_ready            = true;
     }
+
+    inline int32s BufferedBlocks( void ) const { return FIFO_DD.GetSize(); }
 };
 
 
@@ -75,6 +75,8 @@ public:
         fifo_in      = &FIFO[0];
         fifo_out     = &FIFO[1];
 	}
+
+    inline int32s BufferedBlocks( void ) const { return fifo_in->GetSize() + fifo_out->GetSize(); }
 };
 
 #endif // _FSM_FEC_H_INCLUDED_
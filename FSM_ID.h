@@ -25,7 +25,8 @@ protected:
     /////////////////////////////////////////////////////////////
     void ReceiveUnit( _72b_t vector )
     {
-		bool idle_or_error = vector.IsType( C_BLOCK | E_BLOCK );
+		blk_t type = vector.T_TYPE();
+		bool  idle_or_error = type == C_BLOCK || type == E_BLOCK;
 
 		if( idle_or_error && /*IdleCount >= MIN_IPG_VECTORS &&*/ DeleteCount > 0 )
 		{
@@ -22,7 +22,7 @@ const int32s FIFO_II_SIZE = BLK_ROUNDUP( MAX_FRAME_BYTES, FEC_PAYLOAD_BYTES ) *
 class fsm_idle_insertion_t: public fsm_base_t< DLY_IDLE_INS, _72b_t >
 {
 private:
-    Queue< _72b_t, FIFO_II_SIZE > FIFO_II;
+    RunQueue< _72b_t, FIFO_II_SIZE > FIFO_II;     // idle fill is a single run
 
     /////////////////////////////////////////////////////////////
     // 
@@ -35,11 +35,8 @@ private:
 			return;
 		}
 
-		if( vector.IsType( S_BLOCK | C_BLOCK ))
-		{
-			while( FIFO_II.GetSize() < FIFO_II_SIZE - 1 )
-				FIFO_II.Add( IDLE_VECTOR );
-		}
+		if( vector.T_TYPE() == S_BLOCK || vector.T_TYPE() == C_BLOCK )
+			FIFO_II.Add( IDLE_VECTOR, FIFO_II_SIZE - 1 - FIFO_II.GetSize() );
 			
 		FIFO_II.Add( vector );
     }
@@ -60,11 +57,12 @@ private:
 public:
     fsm_idle_insertion_t()
     {
-		while( FIFO_II.GetSize() < FIFO_II_SIZE - 1 )
-			FIFO_II.Add( IDLE_VECTOR );
+		FIFO_II.Add( IDLE_VECTOR, FIFO_II_SIZE - 1 );
 
         output_ready = true;
     }
+
+    inline int32s BufferedVectors( void ) const { return FIFO_II.GetSize(); }
 };
 
 #endif // _FSM_IDLE_INSERTION_H_INCLUDED_
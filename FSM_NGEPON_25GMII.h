@@ -8,6 +8,10 @@
  * one 72-bit vector into two 36-bit columns in the
  * receive direction.
  *
+ * The width W is the number of columns moved per transfer:
+ * 1 for 25GMII, 2 for 50GMII and 4 for 100GMII. A wide MII
+ * combines two transfers into one vector of 2W columns.
+ *
  *********************************************************/
 
 
@@ -19,12 +23,18 @@
  /////////////////////////////////////////////////////////////////////
  // 25GMII state machine, Transmit Direction 
  /////////////////////////////////////////////////////////////////////
-class fsm_ngepon_25gmii_tx_t: public fsm_base_t< DLY_NGEPON_25GMII_TX, _36b_t, _72b_t >
+template< int16s W = 1 > class fsm_ngepon_25gmii_tx_t: public fsm_base_t< DLY_NGEPON_25GMII_TX, typename mii_units_t< W >::column_t, typename mii_units_t< W >::vector_t >
 {
 
+	public:
+
+		typedef fsm_base_t< DLY_NGEPON_25GMII_TX, typename mii_units_t< W >::column_t, typename mii_units_t< W >::vector_t > base_t;
+		typedef typename mii_units_t< W >::column_t column_t;
+		typedef typename mii_units_t< W >::vector_t vector_t;
+
 	private:
 
-		_72b_t vector;				// internal storage only
+		vector_t vector;			// internal storage only
 		int16s column_count;		// internal storage only
 
 	public:
@@ -34,14 +44,15 @@ class fsm_ngepon_25gmii_tx_t: public fsm_base_t< DLY_NGEPON_25GMII_TX, _36b_t, _
 		// until 2 consecutive transfers are received, at which time 
 		// a single 72-bit vector is made available to PCS  
 		////////////////////////////////////////////////////////////
-		void ReceiveUnit (_36b_t column)
+		void ReceiveUnit (column_t columns)
 		{
 			// if there is output data available, log a warning
 			if (this->output_ready == true)
 				MSG_WARN ("Overwritting vector in 25GMII TX");
 
 			// store received data locally 
-			this->vector[this->column_count] = column;
+			for (int16s n = 0; n < W; n++)
+				ColumnOf (this->vector, this->column_count * W + n) = ColumnOf (columns, n);
 			this->column_count++;
 
 			// signal data available 
@@ -56,7 +67,7 @@ class fsm_ngepon_25gmii_tx_t: public fsm_base_t< DLY_NGEPON_25GMII_TX, _36b_t, _
 		// This function sends a single 72-bit vector when data is 
 		// available
 		////////////////////////////////////////////////////////////
-		_72b_t TransmitUnit (void)
+		vector_t TransmitUnit (void)
 		{
 			// if there is no complete data available, log a warning
 			if (this->output_ready == false)
@@ -73,17 +84,33 @@ class fsm_ngepon_25gmii_tx_t: public fsm_base_t< DLY_NGEPON_25GMII_TX, _36b_t, _
 			this->column_count = 0;
 		}
 
+		/////////////////////////////////////////////////////////////
+		// Save/restore state (see sim_checkpoint.h)
+		/////////////////////////////////////////////////////////////
+		template< class archive_t > void Serialize (archive_t& ar)
+		{
+			base_t::Serialize (ar);
+			ar.Raw (this->vector);
+			ar.Raw (this->column_count);
+		}
+
 };
 
 /////////////////////////////////////////////////////////////////////
 // 25GMII state machine, Receive Direction 
 /////////////////////////////////////////////////////////////////////
-class fsm_ngepon_25gmii_rx_t: public fsm_base_t< DLY_NGEPON_25GMII_RX, _72b_t, _36b_t >
+template< int16s W = 1 > class fsm_ngepon_25gmii_rx_t: public fsm_base_t< DLY_NGEPON_25GMII_RX, typename mii_units_t< W >::vector_t, typename mii_units_t< W >::column_t >
 {
 
+	public:
+
+		typedef fsm_base_t< DLY_NGEPON_25GMII_RX, typename mii_units_t< W >::vector_t, typename mii_units_t< W >::column_t > base_t;
+		typedef typename mii_units_t< W >::column_t column_t;
+		typedef typename mii_units_t< W >::vector_t vector_t;
+
 	private:
 
-		_72b_t vector;
+		vector_t vector;
 		int16s last_index;
 
 	public:
@@ -93,18 +120,19 @@ class fsm_ngepon_25gmii_rx_t: public fsm_base_t< DLY_NGEPON_25GMII_RX, _72b_t, _
 		// it internally to be transmitted into RS one 36-bit vector
 		// at a time 
 		/////////////////////////////////////////////////////////////
-		void ReceiveUnit (_72b_t vctr)
+		void ReceiveUnit (vector_t vctr)
 		{
-			vector = vctr;
+			this->vector = vctr;
 		}
 
 		/////////////////////////////////////////////////////////////
-		// This function transmits the next 36-bit vector from the 
+		// This function transmits the next W 36-bit vectors from the 
 		// internal buffer
 		/////////////////////////////////////////////////////////////
-		_36b_t TransmitUnit (void)
+		column_t TransmitUnit (void)
 		{
-			return vector[last_index ^= 0x0001];
+			this->last_index ^= 0x0001;
+			return CollectColumns< W > ([this] (int16s n) { return ColumnOf (this->vector, this->last_index * W + n); });
 		}
 
 		fsm_ngepon_25gmii_rx_t()
@@ -113,6 +141,16 @@ class fsm_ngepon_25gmii_rx_t: public fsm_base_t< DLY_NGEPON_25GMII_RX, _72b_t, _
 			this->last_index = 0;
 			this->output_ready = true;
 		}
+
+		/////////////////////////////////////////////////////////////
+		// Save/restore state (see sim_checkpoint.h)
+		/////////////////////////////////////////////////////////////
+		template< class archive_t > void Serialize (archive_t& ar)
+		{
+			base_t::Serialize (ar);
+			ar.Raw (this->vector);
+			ar.Raw (this->last_index);
+		}
 };
 
 
@@ -15,10 +15,16 @@
 
 
 /////////////////////////////////////////////////////////////////////
-// MAC TX state machine 
+// MAC TX state machine; transmits W columns per transfer towards RS
+// (W = 1 for 25GMII, 2 for 50GMII, 4 for 100GMII)
 /////////////////////////////////////////////////////////////////////
-class fsm_ngepon_mac_tx_t: public fsm_base_t< DLY_NGEPON_MAC_TX, _frm_t, _36b_t >
+template< int16s W = 1 > class fsm_ngepon_mac_tx_t: public fsm_base_t< DLY_NGEPON_MAC_TX, _frm_t, typename mii_units_t< W >::column_t >
 {
+	public:
+
+		typedef fsm_base_t< DLY_NGEPON_MAC_TX, _frm_t, typename mii_units_t< W >::column_t > base_t;
+		typedef typename mii_units_t< W >::column_t column_t;
+
     private:
         
 		timestamp_t timestamp;
@@ -60,9 +66,17 @@ class fsm_ngepon_mac_tx_t: public fsm_base_t< DLY_NGEPON_MAC_TX, _frm_t, _36b_t
 		}
 
         /////////////////////////////////////////////////////////////
-        // Transmit 36-bit column towards RS
+        // Transmit W 36-bit columns towards RS
+        /////////////////////////////////////////////////////////////
+        column_t TransmitUnit (void)
+        {
+			return CollectColumns< W > ([this] (int16s) { return this->TransmitColumn(); });
+        }
+
+        /////////////////////////////////////////////////////////////
+        // Next 36-bit column of the frame, IPG or idle
         /////////////////////////////////////////////////////////////
-        _36b_t TransmitUnit (void)
+        inline _36b_t TransmitColumn (void)
         {
             /////////////////////////////////////////////////////////
             // If already transmitting a frame, continue...
@@ -145,11 +159,27 @@ class fsm_ngepon_mac_tx_t: public fsm_base_t< DLY_NGEPON_MAC_TX, _frm_t, _36b_t
 			this->timestamp     = 0;
 			this->transmitting  = false;
 			this->tx_sequence   = 0;
+			this->frame_bytes   = 0;
 			this->data_columns  = 0;
 			this->idle_deficit  = 0;
 			this->IPG_required  = 0;
         }
 
+		/////////////////////////////////////////////////////////////
+		// Save/restore state (see sim_checkpoint.h)
+		/////////////////////////////////////////////////////////////
+		template< class archive_t > void Serialize (archive_t& ar)
+		{
+			base_t::Serialize (ar);
+			ar.Raw (this->timestamp);
+			ar.Raw (this->transmitting);
+			ar.Raw (this->tx_sequence);
+			ar.Raw (this->frame_bytes);
+			ar.Raw (this->data_columns);
+			ar.Raw (this->idle_deficit);
+			ar.Raw (this->IPG_required);
+		}
+
 		/////////////////////////////////////////////////////////////
         // MAC is ready to accept a new frame from the MAC client
 		// Note that MAC may not be ready to start transmission due 
@@ -163,23 +193,41 @@ class fsm_ngepon_mac_tx_t: public fsm_base_t< DLY_NGEPON_MAC_TX, _frm_t, _36b_t
 };
 
 /////////////////////////////////////////////////////////////////////
-// MAC RX state machine 
+// MAC RX state machine; receives W columns per transfer from RS
 /////////////////////////////////////////////////////////////////////
-class fsm_ngepon_mac_rx_t: public fsm_base_t< DLY_NGEPON_MAC_RX, _36b_t, _frm_t >
+template< int16s W = 1 > class fsm_ngepon_mac_rx_t: public fsm_base_t< DLY_NGEPON_MAC_RX, typename mii_units_t< W >::column_t, _frm_t >
 {
+	public:
+
+		typedef fsm_base_t< DLY_NGEPON_MAC_RX, typename mii_units_t< W >::column_t, _frm_t > base_t;
+		typedef typename mii_units_t< W >::column_t column_t;
+
     private:
         
 		clk_t   timestamp;
 		bool    receiving;
 		int32s	rx_sequence;
 		int32u  BlockCountIn;
+		bool    errored;			// frame being received has lost a column
+		int32u  FramesDropped;
+		_frm_t  frame;				// frame being received; on a wide MII the next 
+									// frame may start in the transfer completing this one
 
 	public:
 
+        /////////////////////////////////////////////////////////////
+        // Receive W 36-bit columns
+        /////////////////////////////////////////////////////////////
+        void ReceiveUnit (column_t columns)
+        {
+			for (int16s n = 0; n < W; n++)
+				this->ReceiveColumn (ColumnOf (columns, n));
+        }
+
         /////////////////////////////////////////////////////////////
         // Receive 36-bit column 
         /////////////////////////////////////////////////////////////
-        void ReceiveUnit (_36b_t col)
+        inline void ReceiveColumn (_36b_t col)
         { 
 			// increase number of received blocks
 			this->BlockCountIn++;
@@ -193,7 +241,15 @@ class fsm_ngepon_mac_rx_t: public fsm_base_t< DLY_NGEPON_MAC_RX, _36b_t, _frm_t
 					std::cout << "MAC RX, column type: " << BlockName(col.C_TYPE()) << ", sequence [expected: " << this->rx_sequence << ", received: " << col.GetSeqNumber() << "], count: " << this->BlockCountIn << std::endl;
 			#endif // DEBUG_ENABLE_MAC_RX
 
-			if (col.IsType(E_BLOCK) || col.IsType(X_BLOCK) || col.IsType(Y_BLOCK) || col.IsType(P_BLOCK))
+			// an errored column within a frame fails its frame check sequence
+			if (col.IsType(E_BLOCK))
+			{
+				if (this->receiving == true)
+					this->errored = true;
+				return;
+			}
+
+			if (col.IsType(X_BLOCK) || col.IsType(Y_BLOCK) || col.IsType(P_BLOCK))
 				return;
 
             if (col.IsType(C_BLOCK))
@@ -201,6 +257,22 @@ class fsm_ngepon_mac_rx_t: public fsm_base_t< DLY_NGEPON_MAC_RX, _36b_t, _frm_t
                 if (this->receiving == true)
                 {
 					this->receiving = false;
+
+					// errored frames are dropped
+					if (this->errored == true)
+					{
+						this->errored = false;
+						this->FramesDropped++;
+						return;
+					}
+
+					// log a warning message, data is still in MAC
+					if (this->output_ready == true)
+					{
+						MSG_WARN("Received MAC frame is being overwritten");
+					}
+
+					this->output_block = this->frame;
 					this->output_ready = true;
                 }
 				return;
@@ -214,26 +286,27 @@ class fsm_ngepon_mac_rx_t: public fsm_base_t< DLY_NGEPON_MAC_RX, _36b_t, _frm_t
 				this->rx_sequence = col.GetSeqNumber();
 			}
 
-			// log a warning message, data is still in MAC
-			if (this->output_ready == true)
-			{
-				MSG_WARN("Received MAC frame is being overwritten");
-			}
-			
 			// log a warning message, unexpected column type was received
+			// (the frame has lost its S column)
 			if ((col.IsType(D_BLOCK) || col.IsType(T_BLOCK)) && this->receiving == false)
             {
                 MSG_WARN("Unexpected " << BlockName (col.C_TYPE()) << " column");
+				this->errored = true;
             }
 
 			// log a warning message, S column received in the middle of a MAC frame
+			// (the frame has lost its C column and is replaced by the new one)
             else if (col.IsType(S_BLOCK) && this->receiving == true)
             {
 			    MSG_WARN("S column received in the middle of a MAC frame");
+				this->FramesDropped++;
             }
 
+			if (col.IsType(S_BLOCK))
+				this->errored = false;
+
 			this->receiving = true;
-			this->output_block.AddColumn (col);
+			this->frame.AddColumn (col);
         }
 
 		fsm_ngepon_mac_rx_t()
@@ -243,7 +316,26 @@ class fsm_ngepon_mac_rx_t: public fsm_base_t< DLY_NGEPON_MAC_RX, _36b_t, _frm_t
 			this->receiving     = false;
 			this->rx_sequence   = 0;
 			this->BlockCountIn	= 0;
+			this->errored		= false;
+			this->FramesDropped	= 0;
         }
+
+		inline int32u GetFramesDropped (void) const { return this->FramesDropped; }
+
+		/////////////////////////////////////////////////////////////
+		// Save/restore state (see sim_checkpoint.h)
+		/////////////////////////////////////////////////////////////
+		template< class archive_t > void Serialize (archive_t& ar)
+		{
+			base_t::Serialize (ar);
+			ar.Raw (this->timestamp);
+			ar.Raw (this->receiving);
+			ar.Raw (this->rx_sequence);
+			ar.Raw (this->BlockCountIn);
+			ar.Raw (this->errored);
+			ar.Raw (this->FramesDropped);
+			ar.Raw (this->frame);
+		}
 };
 
 #endif //_FSM_NGEPON_MAC_H_INCLUDED_
\ No newline at end of file
@@ -53,7 +53,9 @@ template< int16s (*pf_packet_size) (void) > class fsm_ngepon_macc_t: public fsm_
 			this->frame_waiting = false;
 
 			// this function returns packet size excluding preamble and IPG
-			return _frm_t (timestamp_t::GetClock(), pf_packet_size());
+			_frm_t frame (timestamp_t::GetClock(), pf_packet_size());
+			frame.SetProbe (ProbePolicy.Select (frame.GetFrameSize()));
+			return frame;
 		}
 
 		fsm_ngepon_macc_t (bool brst_md = false)
@@ -70,6 +72,18 @@ template< int16s (*pf_packet_size) (void) > class fsm_ngepon_macc_t: public fsm_
             this->frame_ready_counter = this->burst_mode? BURST_GAP_BYTES : MIN_IPG_BYTES;
         }
 
+		/////////////////////////////////////////////////////////////
+		// Save/restore state (see sim_checkpoint.h)
+		/////////////////////////////////////////////////////////////
+		template< class archive_t > void Serialize (archive_t& ar)
+		{
+			fsm_base_t::Serialize (ar);
+			ar.Raw (this->frame_ready_counter);
+			ar.Raw (this->frame_count);
+			ar.Raw (this->frame_waiting);
+			ar.Raw (this->burst_mode);
+		}
+
         inline bool GrantStart (void) const      
 		{ 
 			return (this->frame_count == 1); 
@@ -110,7 +124,7 @@ template< int16s (*pf_packet_size) (void) > class fsm_ngepon_macc_t: public fsm_
                 // available after some random delay
 				//////////////////////////////////////////////////////////////
 				#ifdef SPARSE_TRAFFIC
-				this->frame_ready_counter += (int16s)( (rand() * FEC_CODEWORD_BYTES) / RAND_MAX);
+				this->frame_ready_counter += (int16s)( (SimRand() * FEC_CODEWORD_BYTES) / SIM_RAND_MAX);
 				#endif
 
 				///////////////////////////////////////////////////////////////
@@ -20,7 +20,10 @@ class fsm_ngepon_mpcp_tx_t: public fsm_base_t< DLY_NGEPON_MPCP_TX, _frm_t >
         clk_t   initiate_timer;    // Timer to keep track when channel will be ready for next transfer .
         bool	frameAvailable;	   // Indicator of a waiting frame to transfer.
         int16s  byte_time;         
+        bool    fec_rate_control;  // Continuous mode: leave room for FEC parity after each frame
+        int32s  fec_payload_bytes; // Bytes of the current FEC codeword payload already used
 
+    public:
         /////////////////////////////////////////////////////////////
         //  ReceiveUnit() receieves a frame from MAC Client only when 
 		//  Channel is ready and a frame is available at MAC Client
@@ -70,25 +73,51 @@ class fsm_ngepon_mpcp_tx_t: public fsm_base_t< DLY_NGEPON_MPCP_TX, _frm_t >
             //////////////////////////////////////////////////////////
 			initiate_timer = output_block.GetFrameSize() - E_HEADER_BYTES - CHECKSUM_BYTES + TAIL_GUARD;
 
+            //////////////////////////////////////////////////////////
+            // In continuous mode, FEC parity is inserted in place of
+            // idles. For every FEC_PAYLOAD_BYTES sent, hold the channel
+            // for another FEC_PARITY_BYTES, so that Idle Deletion finds 
+            // enough idles to remove.
+            //////////////////////////////////////////////////////////
+            if (this->fec_rate_control)
+            {
+                this->fec_payload_bytes += (int32s)initiate_timer;
+                initiate_timer += (this->fec_payload_bytes / FEC_PAYLOAD_BYTES) * FEC_PARITY_BYTES;
+                this->fec_payload_bytes %= FEC_PAYLOAD_BYTES;
+            }
+
 			////////////////////////////////////////////////////
             // Transfer a frame to the MAC 
             ////////////////////////////////////////////////////
             return output_block;
         }
 
- 
-    public:
-
         bool grantStart;
         ///////////////////////////////////////////////////////
         //  
         ///////////////////////////////////////////////////////
-        fsm_ngepon_mpcp_tx_t()
+        fsm_ngepon_mpcp_tx_t(bool fec_rate_ctrl = false)
         {
             byte_time        = 0;
             initiate_timer   = 0;
             frameAvailable	 = false;
             grantStart       = false;
+            fec_rate_control = fec_rate_ctrl;
+            fec_payload_bytes= 0;
+        }
+
+        ///////////////////////////////////////////////////////
+        // Save/restore state (see sim_checkpoint.h)
+        ///////////////////////////////////////////////////////
+        template< class archive_t > void Serialize (archive_t& ar)
+        {
+            fsm_base_t::Serialize (ar);
+            ar.Raw (initiate_timer);
+            ar.Raw (frameAvailable);
+            ar.Raw (byte_time);
+            ar.Raw (grantStart);
+            ar.Raw (fec_rate_control);
+            ar.Raw (fec_payload_bytes);
         }
 
         ///////////////////////////////////////////////////////
@@ -145,13 +174,18 @@ class fsm_ngepon_mpcp_tx_t: public fsm_base_t< DLY_NGEPON_MPCP_TX, _frm_t >
 /////////////////////////////////////////////////////////////////////
 class fsm_ngepon_mpcp_rx_t: public fsm_base_t< DLY_NGEPON_MPCP_RX, _frm_t >
 {
-    private:
+    public:
         /////////////////////////////////////////////////////////////
         void ReceiveUnit (_frm_t in_blk)
         {
             output_block = in_blk;
             output_ready = true;
         }
+
+        template< class archive_t > void Serialize (archive_t& ar)
+        {
+            fsm_base_t::Serialize (ar);
+        }
 };
 
 #endif //_FSM_NGEPON_MPCP_H_INCLUDED_
\ No newline at end of file
@@ -5,13 +5,88 @@
 #ifndef _FSM_NGEPON_RS_H_INCLUDED_
 #define _FSM_NGEPON_RS_H_INCLUDED_
 
+#include <vector>
 #include "FSM_base.h"
 
 /////////////////////////////////////////////////////////////////////
-// RS state machine, Transmit Direction 
+// Payload of one codeword in the RS TX buffer
 /////////////////////////////////////////////////////////////////////
-class fsm_ngepon_rs_tx_t: public fsm_base_t< DLY_NGEPON_RS_TX, _36b_t, _36b_t >
+struct rs_codeword_t
 {
+	_36b_t			word[PAYLOAD_SIZE];
+};
+
+const rs_codeword_t IDLE_CODEWORD = rs_codeword_t();		// content of a new buffer entry
+
+/////////////////////////////////////////////////////////////////////
+// Codeword storage shared by all RS TX instances of a thread. A 
+// buffer entry takes a codeword when it is first written and gives
+// it back once its payload has been transmitted, so the memory in
+// use follows the codewords in flight rather than the 8 links x 8 
+// entries of every RS. Codewords are allocated in chunks and never
+// returned to the heap.
+/////////////////////////////////////////////////////////////////////
+class rs_codeword_pool_t
+{
+	private:
+
+		static const int32s CHUNK = 8;					// codewords per allocation
+
+		std::vector< rs_codeword_t* >	chunks;
+		std::vector< rs_codeword_t* >	free_list;
+
+	public:
+
+		~rs_codeword_pool_t()
+		{
+			for (size_t n = 0; n < this->chunks.size(); n++)
+				delete[] this->chunks[n];
+		}
+
+		/////////////////////////////////////////////////////////////
+		// A codeword of idle columns, as in a new buffer
+		/////////////////////////////////////////////////////////////
+		rs_codeword_t* Take(void)
+		{
+			if (this->free_list.empty())
+			{
+				rs_codeword_t* chunk = new rs_codeword_t[CHUNK];
+				this->chunks.push_back(chunk);
+				for (int32s n = CHUNK - 1; n >= 0; n--)
+					this->free_list.push_back(chunk + n);
+			}
+
+			rs_codeword_t* codeword = this->free_list.back();
+			this->free_list.pop_back();
+			*codeword = IDLE_CODEWORD;							// copied as a whole, faster than column by column
+			return codeword;
+		}
+
+		void Give(rs_codeword_t* codeword)
+		{
+			this->free_list.push_back(codeword);
+		}
+};
+
+thread_local rs_codeword_pool_t RsCodewordPool;
+
+/////////////////////////////////////////////////////////////////////
+// RS state machine, Transmit Direction; moves W columns per transfer
+/////////////////////////////////////////////////////////////////////
+template< int16s W = 1 > class fsm_ngepon_rs_tx_t: public fsm_base_t< DLY_NGEPON_RS_TX, typename mii_units_t< W >::column_t >
+{
+	public:
+
+		typedef fsm_base_t< DLY_NGEPON_RS_TX, typename mii_units_t< W >::column_t > base_t;
+		typedef typename mii_units_t< W >::column_t column_t;
+
+		/////////////////////////////////////////////////////////////
+		// IsReadyForMoreData() is checked once per transfer; a payload
+		// longer than a transfer lets at most one codeword start in 
+		// it, for which the buffer always has room
+		/////////////////////////////////////////////////////////////
+		static_assert (W <= PAYLOAD_SIZE, "MII transfer longer than the FEC payload");
+
     private:
 
 		// based on kramer_3ca_3c_0716
@@ -27,11 +102,31 @@ class fsm_ngepon_rs_tx_t: public fsm_base_t< DLY_NGEPON_RS_TX, _36b_t, _36b_t >
 		bool			InStateTransferParityPlaceholder;
 		bool			InStateTransferPayloadWord;
 		bool			InStateReceiveWord;						// this extra flag controls whether the input process SD stays in RECEIVE_WORD state (when true) or in INITIATE_CODEWORD_RX state (when false)
-		_36b_t			TX_DATA_CTRL[8][8][PAYLOAD_SIZE];		// Channel Bonding Tx Data & Control buffer (TX_DATA and TX_CTRL) concatenated into a single 36-bit wide vector construct, indexed [LinkIndex][0..7][0..PAYLOAD_SIZE]
+		rs_codeword_t*	TX_DATA_CTRL[8][8];						// Channel Bonding Tx Data & Control buffer (TX_DATA and TX_CTRL) concatenated into a single 36-bit wide vector construct, indexed [LinkIndex][0..7], 
+																// codewords taken from RsCodewordPool on first use (NULL: all idle)
 		int8u			TX_DATA_CTRL_ENTRY;						// pointer to concatenation of TX_DATA_ENTRY and TX_CTRL_ENTRY
 		int32u			BlockSequenceIn;
 		int32u			BlockCountIn;
 	
+		/////////////////////////////////////////////////////////////
+		// Buffer entry for writing, taken from the pool if needed
+		/////////////////////////////////////////////////////////////
+		inline rs_codeword_t& Entry(int8u LinkIndex, int8u EntryIndex)
+		{
+			rs_codeword_t*& codeword = this->TX_DATA_CTRL[LinkIndex][EntryIndex];
+			if (codeword == NULL)
+				codeword = RsCodewordPool.Take();
+			return *codeword;
+		}
+
+		inline void ReleaseEntry(int8u LinkIndex, int8u EntryIndex)
+		{
+			rs_codeword_t*& codeword = this->TX_DATA_CTRL[LinkIndex][EntryIndex];
+			if (codeword != NULL)
+				RsCodewordPool.Give(codeword);
+			codeword = NULL;
+		}
+
 	public:
 
 		/////////////////////////////////////////////////////////////
@@ -57,13 +152,31 @@ class fsm_ngepon_rs_tx_t: public fsm_base_t< DLY_NGEPON_RS_TX, _36b_t, _36b_t >
 			return (this->EntryWriteIndex[paramLinkIndex] - this->EntryReadIndex[paramLinkIndex] < 4);
 		}
 
+		/////////////////////////////////////////////////////////////
+		// Codewords in the TX_DATA/TX_CTRL buffer of a link, being 
+		// received or waiting for transmission
+		/////////////////////////////////////////////////////////////
+		int32s BufferedCodewords(int8u paramLinkIndex) const
+		{
+			return (this->EntryWriteIndex[paramLinkIndex] - this->EntryReadIndex[paramLinkIndex]) & 7;
+		}
+
+        /////////////////////////////////////////////////////////////
+		// This function accepts W columns from MAC for transmission
+        /////////////////////////////////////////////////////////////
+        void ReceiveUnit(column_t columns)
+        {
+			for (int16s n = 0; n < W; n++)
+				this->ReceiveColumn(ColumnOf(columns, n));
+        }
+
         /////////////////////////////////////////////////////////////
 		// This function accepts a new vector from MAC for transmission
 		// This function is called every time MAC has 32-bit data vector
 		// ready for transmission; MAC always sends 36-bit blocks, 
 		// comprising TxData<31:0> and TxCtrl<3:0>
         /////////////////////////////////////////////////////////////
-        void ReceiveUnit(_36b_t frame)
+        inline void ReceiveColumn(_36b_t frame)
         {
 
 			// recover LinkIndex value for this transmission 
@@ -76,7 +189,7 @@ class fsm_ngepon_rs_tx_t: public fsm_base_t< DLY_NGEPON_RS_TX, _36b_t, _36b_t >
 			if (this->EntryWriteIndex[LinkIndex] - this->EntryReadIndex[LinkIndex] < 4 && this->InStateReceiveWord == false)
 			{
 				// state INITIATE_CODEWORD_RX
-				this->TX_DATA_CTRL[LinkIndex][this->EntryWriteIndex[LinkIndex]][0] = _36b_t(LinkIndex, this->EntryWriteIndex[LinkIndex]);
+				this->Entry(LinkIndex, this->EntryWriteIndex[LinkIndex]).word[0] = _36b_t(LinkIndex, this->EntryWriteIndex[LinkIndex]);
 				this->EntryWriteIndex[LinkIndex]++;
 				if (this->EntryWriteIndex[LinkIndex] == 8)
 					this->EntryWriteIndex[LinkIndex] = 0;
@@ -102,7 +215,7 @@ class fsm_ngepon_rs_tx_t: public fsm_base_t< DLY_NGEPON_RS_TX, _36b_t, _36b_t >
 					std::cout << ", saved OK @ [" << (int32u)LinkIndex << ":" << (int32u)this->EntryWriteIndex[LinkIndex] << ":" << (int32u)this->WordWriteIndex[LinkIndex] << "]";
 				#endif		
 
-				this->TX_DATA_CTRL[LinkIndex][this->EntryWriteIndex[LinkIndex]][this->WordWriteIndex[LinkIndex]] = frame;
+				this->Entry(LinkIndex, this->EntryWriteIndex[LinkIndex]).word[this->WordWriteIndex[LinkIndex]] = frame;
 				this->WordWriteIndex[LinkIndex]++;
 				this->InStateReceiveWord = this->WordWriteIndex[LinkIndex] < PAYLOAD_SIZE;
 			}
@@ -117,6 +230,14 @@ class fsm_ngepon_rs_tx_t: public fsm_base_t< DLY_NGEPON_RS_TX, _36b_t, _36b_t >
 
 		}
 
+		/////////////////////////////////////////////////////////////
+		// This function sends out W columns from RS into the MII
+		/////////////////////////////////////////////////////////////
+		column_t TransmitUnit(void)
+		{
+			return CollectColumns< W >([this](int16s) { return this->TransmitColumn(); });
+		}
+
 		/////////////////////////////////////////////////////////////
 		// This function sends out a new vector from RS into 25GMII
 		// This function is called every 32 clock cycles, transferring
@@ -124,7 +245,7 @@ class fsm_ngepon_rs_tx_t: public fsm_base_t< DLY_NGEPON_RS_TX, _36b_t, _36b_t >
 		// 4-bit control vector TXC <4:0>
 		// represented by a single _36b_t block 
 		/////////////////////////////////////////////////////////////
-		_36b_t TransmitUnit(void)
+		inline _36b_t TransmitColumn(void)
 		{
 
 			// recover LinkIndex value for this transmission 
@@ -156,7 +277,10 @@ class fsm_ngepon_rs_tx_t: public fsm_base_t< DLY_NGEPON_RS_TX, _36b_t, _36b_t >
 			if (this->InStateTransferPayloadWord == true)
 			{
 				// state TRANSFER_PAYLOAD_WORD
-				_36b_t TempTransferVector = TX_DATA_CTRL[LinkIndex][this->TX_DATA_CTRL_ENTRY][this->WordReadIndex[LinkIndex]];
+				const rs_codeword_t* codeword = this->TX_DATA_CTRL[LinkIndex][this->TX_DATA_CTRL_ENTRY];
+				if (codeword == NULL)
+					codeword = &IDLE_CODEWORD;
+				_36b_t TempTransferVector = codeword->word[this->WordReadIndex[LinkIndex]];
 				this->WordReadIndex[LinkIndex]++;
 				if (this->WordReadIndex[LinkIndex] >= PAYLOAD_SIZE)
 				{
@@ -165,6 +289,7 @@ class fsm_ngepon_rs_tx_t: public fsm_base_t< DLY_NGEPON_RS_TX, _36b_t, _36b_t >
 					this->InStateTransferParityPlaceholder = true;
 					// state PAYLOAD_COMPLETED
 					this->WordReadIndex[LinkIndex] = 0;
+					this->ReleaseEntry(LinkIndex, this->TX_DATA_CTRL_ENTRY);
 				}
 				#ifdef DEBUG_ENABLE_RS_TX_TX
 					std::cout << "RS_TX_TX: column type: " << BlockName(TempTransferVector.C_TYPE()) << ", WordReadIndex=" << (int16u)this->WordReadIndex[LinkIndex] << ", TX_DATA_CTRL_ENTRY=" << (int16u)this->TX_DATA_CTRL_ENTRY << std::endl;
@@ -203,11 +328,10 @@ class fsm_ngepon_rs_tx_t: public fsm_base_t< DLY_NGEPON_RS_TX, _36b_t, _36b_t >
 				this->CodeWordsLeft[iVar0] = 0;
 			}
 
-			// initialize data storage
+			// data storage is taken from the pool on first use
 			for (int8u iVar0 = 0; iVar0 < 8; iVar0++)
 				for (int8u iVar1 = 0; iVar1 < 8; iVar1++)
-					for (int8u iVar2 = 0; iVar2 < PAYLOAD_SIZE; iVar2++)
-						TX_DATA_CTRL[iVar0][iVar1][iVar2] = _36b_t();
+					TX_DATA_CTRL[iVar0][iVar1] = NULL;
 
 			// reset boolean flags
 			this->InStateTransferParityPlaceholder = false;
@@ -215,10 +339,52 @@ class fsm_ngepon_rs_tx_t: public fsm_base_t< DLY_NGEPON_RS_TX, _36b_t, _36b_t >
 			this->InStateReceiveWord = false;
 
 			// initialize other variables
+			this->TX_DATA_CTRL_ENTRY = 0;
 			this->BlockSequenceIn = 0;
 			this->BlockCountIn = 0;
         }
 
+		~fsm_ngepon_rs_tx_t()
+		{
+			for (int8u iVar0 = 0; iVar0 < 8; iVar0++)
+				for (int8u iVar1 = 0; iVar1 < 8; iVar1++)
+					this->ReleaseEntry(iVar0, iVar1);
+		}
+
+		// buffer entries are owned by one instance
+		fsm_ngepon_rs_tx_t(const fsm_ngepon_rs_tx_t&) = delete;
+		fsm_ngepon_rs_tx_t& operator=(const fsm_ngepon_rs_tx_t&) = delete;
+
+		/////////////////////////////////////////////////////////////
+		// Save/restore state (see sim_checkpoint.h); entries that
+		// are not in use are saved as a flag only
+		/////////////////////////////////////////////////////////////
+		template< class archive_t > void Serialize(archive_t& ar)
+		{
+			base_t::Serialize(ar);
+			ar.Raw(this->EntryWriteIndex);
+			ar.Raw(this->EntryReadIndex);
+			ar.Raw(this->WordWriteIndex);
+			ar.Raw(this->WordReadIndex);
+			ar.Raw(this->CodeWordsLeft);
+			ar.Raw(this->InStateTransferParityPlaceholder);
+			ar.Raw(this->InStateTransferPayloadWord);
+			ar.Raw(this->InStateReceiveWord);
+			for (int8u iVar0 = 0; iVar0 < 8; iVar0++)
+				for (int8u iVar1 = 0; iVar1 < 8; iVar1++)
+				{
+					bool in_use = this->TX_DATA_CTRL[iVar0][iVar1] != NULL;
+					ar.Raw(in_use);
+					if (in_use)
+						ar.Raw(this->Entry(iVar0, iVar1));
+					else
+						this->ReleaseEntry(iVar0, iVar1);
+				}
+			ar.Raw(this->TX_DATA_CTRL_ENTRY);
+			ar.Raw(this->BlockSequenceIn);
+			ar.Raw(this->BlockCountIn);
+		}
+
 };
 
 /////////////////////////////////////////////////////////////////////
@@ -241,6 +407,11 @@ class fsm_ngepon_rs_rx_t : public fsm_base_t< DLY_NGEPON_RS_RX, _36b_t, _36b_t >
 		fsm_ngepon_rs_rx_t()
 		{
 		}
+
+		template< class archive_t > void Serialize(archive_t& ar)
+		{
+			fsm_base_t::Serialize(ar);
+		}
 };
 
 #endif //_FSM_NGEPON_RS_H_INCLUDED_
\ No newline at end of file
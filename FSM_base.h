@@ -10,7 +10,11 @@
 #define _FSM_BASE_H_INCLUDED_
 
 #include "_types.h"
+#include "_random.h"
 #include <iostream>
+#include <utility>
+#include <string>
+#include <vector>
 
 using namespace std;
 
@@ -145,32 +149,94 @@ const int16s DLY_NGEPON_25GMII_RX		= 5;
 const int16s DLY_NGEPON_RS_RX			= 6;
 const int16s DLY_NGEPON_MAC_RX		    = 7;	
 const int16s DLY_NGEPON_MPCP_RX			= 8;
+const int16s DLY_NONE					= -1;	// not timed; the delay goes to the next stage
+
+// downstream PCS stages (see DownstreamTiming() in data_path.h)
+const int16s DLY_IDLE_DEL	    = 9;	
+const int16s DLY_66B_ENCODER	= 10;	
+const int16s DLY_SCRAMBLER	    = 11;	
+const int16s DLY_DATA_DET	    = 12;	
+const int16s DLY_FEC_DECODER	= 13;	
+const int16s DLY_DESCRAMBLER	= 14;	
+const int16s DLY_66B_DECODER	= 15;	
+const int16s DLY_IDLE_INS	    = 16;	
+
+#if defined( CHECK_DOWNSTREAM ) || defined( STAGE_GRAPH )
+const int32s DELAY_ARRAY_SIZE   = 17;   // NG-EPON stages, MPCP RX and downstream PCS stages
+#else
+const int32s DELAY_ARRAY_SIZE   = 8;
+#endif
 
-const int16s DLY_IDLE_DEL	    = 30;	
-const int16s DLY_66B_ENCODER	=31;	
-const int16s DLY_SCRAMBLER	    = 32;	
-const int16s DLY_DATA_DET	    = 33;	
-const int16s DLY_FEC_DECODER	= 34;	
-const int16s DLY_DESCRAMBLER	= 35;	
-const int16s DLY_66B_DECODER	= 36;	
-const int16s DLY_IDLE_INS	    = 37;	
+/////////////////////////////////////////////////////////////////////
+// Result columns of a data path: the delay indices of its stages in 
+// path order and their names, followed by TOTAL. The results of a 
+// path list only these columns, not the whole delay array.
+/////////////////////////////////////////////////////////////////////
+struct result_columns_t
+{
+    std::string             header;         // column names, the last one is TOTAL
+    std::vector< int16s >   delay;          // delay index of every column but TOTAL
+    int32s                  total_from;     // first column counted in TOTAL
 
-const int32s DELAY_ARRAY_SIZE   = 8;
+    result_columns_t() : total_from( 0 ) {}
+    result_columns_t( const CHAR* names, const int16s* ndx, int32s count, int32s total ) :
+        header( names ), delay( ndx, ndx + count ), total_from( total ) {}
+};
+
+
+/////////////////////////////////////////////////////////////////////
+// Probe frames: only frames selected by the MAC Client, and the 
+// columns made of them, record their per-stage delays. Every nth 
+// frame of the probe size (0 = any size) is selected; the statistics
+// collect probe frames only.
+/////////////////////////////////////////////////////////////////////
+#ifdef SHOW_64B_PACKETS_ONLY
+const int16s PROBE_FRAME_SIZE   = MPCP_PACKET_BYTES;
+#else
+const int16s PROBE_FRAME_SIZE   = 0;
+#endif
 
+struct probe_policy_t
+{
+    int32s  interval;
+    int16s  frame_size;
+    int32s  countdown;              // frames of the probe size until the next probe
+
+    void Init( int32s every, int16s size )
+    {
+        interval   = every > 1 ? every : 1;
+        frame_size = size;
+        countdown  = 1;
+    }
+
+    inline bool Select( int16s size )
+    {
+        if( frame_size != 0 && size != frame_size )
+            return false;
+        if( --countdown > 0 )
+            return false;
+        countdown = interval;
+        return true;
+    }
+};
+
+thread_local probe_policy_t ProbePolicy = { PROBE_INTERVAL, PROBE_FRAME_SIZE, 1 };
 
 class timestamp_t
 {
 private:
-    static clk_t    _global_clock;
+    static thread_local clk_t _global_clock;  // one clock per simulation thread
     clk_t           _timestamp;
     int16s          _delay[ DELAY_ARRAY_SIZE ];
 	int16s			_frame_size;
+    bool            _probe;             // delays are recorded (see probe_policy_t)
 
 public:
     timestamp_t( clk_t stamp = 0 ) 
     {
         // initialize local variables
 		this->_timestamp = stamp;
+		this->_probe     = true;
 		// initialide delay array 
 		for (int16u iVar0 = 0; iVar0 < DELAY_ARRAY_SIZE; iVar0++)
 			_delay[iVar0] = 0;
@@ -184,12 +250,16 @@ public:
     static void   ResetClock( clk_t clk = 0 )  { _global_clock = clk;  }
     inline clk_t  GetTimestamp( void )   const { return _timestamp;    }
     inline int16s GetDelay( int32s ndx ) const { return _delay[ ndx ]; }
+    inline bool   IsProbe( void )        const { return _probe;        }
+    inline void   SetProbe( bool probe )       { _probe = probe;       }
 
     /////////////////////////////////////////////////////////////
     // Measure delay in the current block 
     /////////////////////////////////////////////////////////////
     inline void MeasureDelay( int32s ndx )
     {
+        if( !_probe )
+            return;
         _delay[ ndx ] = static_cast<int16s>( _global_clock - _timestamp );
         if( ndx == 0 && _delay[ ndx ] < 0 )
         {
@@ -199,7 +269,7 @@ public:
     }
 };
 
-clk_t timestamp_t::_global_clock = 0;
+thread_local clk_t timestamp_t::_global_clock = 0;
 
 /////////////////////////////////////////////////////////////////////
 // 36-bit column representing one XGMII transfer
@@ -243,8 +313,23 @@ class _36b_t: public timestamp_t
             // return (( C_TYPE() & blk_type_field ) != 0 );
 			return (_block_type == blk_type_field);
         }
-        
-        
+
+        /////////////////////////////////////////////////////////////
+        // Only S, D and T columns carry frame data. All other columns
+        // (idles, parity, placeholders, burst sync) are not timed, so
+        // any two of the same type are identical and a run of them
+        // can be stored as one column and a count.
+        /////////////////////////////////////////////////////////////
+        inline bool IsControl( void ) const
+        {
+            return !( _block_type == S_BLOCK || _block_type == D_BLOCK || ( _block_type >= T_BLOCK && _block_type <= T3_BLOCK ));
+        }
+
+        inline void MeasureDelay( int32s ndx )
+        {
+            if( !IsControl() )
+                timestamp_t::MeasureDelay( ndx );
+        }
 };
 
 /////////////////////////////////////////////////////////////////////
@@ -351,6 +436,71 @@ class _66b_t: public _72b_t
         inline hdr_t SyncHeader( void ) const { return sync_header; }
 };
 
+/////////////////////////////////////////////////////////////////////
+// N consecutive 36-bit columns moved in a single transfer by a wide
+// MII (2 columns at 50G, 4 columns at 100G)
+/////////////////////////////////////////////////////////////////////
+template< int16s N > class _columns_t
+{
+    private:
+        _36b_t _column[N];
+
+        template< class next_t, int16s... I > _columns_t( next_t& next, std::integer_sequence< int16s, I... > ): _column{ next( I )... } {}
+
+    public:
+        _columns_t() {}
+
+        /////////////////////////////////////////////////////////////
+        // Column n is next( n ), called in order of the columns
+        /////////////////////////////////////////////////////////////
+        template< class next_t > explicit _columns_t( next_t next ): _columns_t( next, std::make_integer_sequence< int16s, N >() ) {}
+
+        inline _36b_t&       operator[]( int index )        { return _column[ index ]; }
+        inline const _36b_t& operator[]( int index ) const  { return _column[ index ]; }
+
+        inline void MeasureDelay( int16s location )
+        {
+            for( int16s n = 0; n < N; n++ )
+                _column[n].MeasureDelay( location );
+        }
+};
+
+/////////////////////////////////////////////////////////////////////
+// Units of an MII moving W columns per transfer: the column unit
+// between MAC and RS, and the vector unit between MII and PCS.
+// At 25G (W = 1) these are the 36-bit column and the 72-bit vector.
+/////////////////////////////////////////////////////////////////////
+template< int16s W > struct mii_units_t
+{
+    typedef _columns_t< W >         column_t;
+    typedef _columns_t< 2 * W >     vector_t;
+};
+
+template<> struct mii_units_t< 1 >
+{
+    typedef _36b_t                  column_t;
+    typedef _72b_t                  vector_t;
+};
+
+/////////////////////////////////////////////////////////////////////
+// n-th column of any of the units above
+/////////////////////////////////////////////////////////////////////
+inline _36b_t& ColumnOf( _36b_t& unit, int16s )                                { return unit; }
+inline _36b_t& ColumnOf( _72b_t& unit, int16s n )                              { return unit[n]; }
+template< int16s N > inline _36b_t& ColumnOf( _columns_t< N >& unit, int16s n ) { return unit[n]; }
+
+/////////////////////////////////////////////////////////////////////
+// Column unit of a W-column MII, built by calling next( n ) for each
+// column
+/////////////////////////////////////////////////////////////////////
+template< int16s W, class next_t > inline typename mii_units_t< W >::column_t CollectColumns( next_t next )
+{
+    if constexpr( W == 1 )
+        return next( 0 );
+    else
+        return _columns_t< W >( next );
+}
+
 
 /////////////////////////////////////////////////////////////////////
 // MAC Frame
@@ -393,6 +543,15 @@ template< int16s L, class in_t, class out_t = in_t > class fsm_base_t
         out_t   output_block;
         bool    output_ready;
         
+    public:
+        typedef in_t    input_t;
+        typedef out_t   output_t;
+
+        static const int16s location = L;   // delay index
+
+        /////////////////////////////////////////////////////////////
+        // Public so that a pipeline knowing the exact FSM type can 
+        // call them without virtual dispatch (see sim_pipeline.h)
         /////////////////////////////////////////////////////////////
         virtual void    ReceiveUnit( in_t in_blk ) = 0;
         /////////////////////////////////////////////////////////////
@@ -401,9 +560,7 @@ template< int16s L, class in_t, class out_t = in_t > class fsm_base_t
             output_ready = false;
             return output_block; 
         }
-       
-        
-    public:
+
         fsm_base_t() 
         {
             output_ready = false;
@@ -417,11 +574,31 @@ template< int16s L, class in_t, class out_t = in_t > class fsm_base_t
         inline operator out_t()	
         {
             out_t out_blk1 = TransmitUnit();
-			out_blk1.MeasureDelay(L);
+			if (L != DLY_NONE)
+				out_blk1.MeasureDelay(L);
+            return out_blk1; 
+        }
+        /////////////////////////////////////////////////////////////
+        // Same as above, but the delay goes into a stage index 
+        // assigned at run time (see sim_graph.h)
+        /////////////////////////////////////////////////////////////
+        inline out_t Transmit( int32s delay_ndx )
+        {
+            out_t out_blk1 = TransmitUnit();
+            if( delay_ndx != DLY_NONE )
+                out_blk1.MeasureDelay( delay_ndx );
             return out_blk1; 
         }
         /////////////////////////////////////////////////////////////
         bool OutputReady( void ) const { return output_ready; }
+        /////////////////////////////////////////////////////////////
+        // Save/restore state (see sim_checkpoint.h)
+        /////////////////////////////////////////////////////////////
+        template< class archive_t > void Serialize( archive_t& ar )
+        {
+            ar.Raw( output_block );
+            ar.Raw( output_ready );
+        }
 };
 
 
@@ -11,7 +11,7 @@ using namespace std;
 /********************************************************************/
 int main(int argc, char* argv[])
 {
-	const size_t BUFFER_SIZE = 32;
+	const size_t BUFFER_SIZE = 48;
 	CHAR buffer[BUFFER_SIZE] = { '\0' };
 
 	////////////////////////////////////////////////////////////
@@ -20,6 +20,66 @@ int main(int argc, char* argv[])
 	////////////////////////////////////////////////////////////
 	InitAllocator();
 
+	////////////////////////////////////////////////////////////
+	// options apply to every mode below (e.g. -graph to -golden);
+	// the arguments of a mode are skipped as unknown options
+	////////////////////////////////////////////////////////////
+	ParseOptions(argc, argv);
+#ifdef STAGE_GRAPH
+	if (SimOptions.stage_graph != NULL && !StageGraph.Parse(SimOptions.stage_graph))
+		return 1;
+#endif
+
+	////////////////////////////////////////////////////////////
+	// Offline conversion of binary results into CSV:
+	//   MPRS_upstream -bin2csv <file>_OUT1.bin <file>.csv
+	////////////////////////////////////////////////////////////
+	if (argc > 3 && strcmp(argv[1], "-bin2csv") == 0)
+	{
+		int64s frames = ConvertRecordsToCsv(argv[2], argv[3]);
+		if (frames < 0)
+		{
+			cerr << "Cannot convert " << argv[2] << " into " << argv[3] << endl;
+			return 1;
+		}
+		clog << "Converted " << frames << " frames into " << argv[3] << endl;
+		return 0;
+	}
+
+	////////////////////////////////////////////////////////////
+	// Microbenchmarks of the building blocks (see sim_bench.h):
+	//   MPRS_upstream -bench <results>.csv [<baseline>.csv]
+	////////////////////////////////////////////////////////////
+	if (argc > 2 && strcmp(argv[1], "-bench") == 0)
+		return RunBenchmarks(argv[2], argc > 3 ? argv[3] : NULL);
+
+	////////////////////////////////////////////////////////////
+	// Throughput and scaling of the complete upstream path:
+	//   MPRS_upstream -throughput <results>.csv [<frames> [<max parallel>]]
+	////////////////////////////////////////////////////////////
+	if (argc > 2 && strcmp(argv[1], "-throughput") == 0)
+		return RunThroughputBenchmark(argv[2], argc > 3 ? atoi(argv[3]) : 0, argc > 4 ? atoi(argv[4]) : 0);
+
+	////////////////////////////////////////////////////////////
+	// Golden-result regression (see sim_golden.h):
+	//   MPRS_upstream -golden <digest> [<frames>] [options]
+	//   MPRS_upstream -golden-diff <digest A> <digest B>
+	////////////////////////////////////////////////////////////
+	if (argc > 2 && strcmp(argv[1], "-golden") == 0)
+		return RunGolden(argv[2], argc > 3 ? atoi(argv[3]) : 0);
+	if (argc > 3 && strcmp(argv[1], "-golden-diff") == 0)
+		return CompareGoldenDigests(argv[2], argv[3]);
+
+	////////////////////////////////////////////////////////////
+	// Analytic model of the upstream path (see sim_analytic.h):
+	//   MPRS_upstream -analytic <results>.csv [NAME=<values> ...]
+	//   MPRS_upstream -analytic-check [<frames>]
+	////////////////////////////////////////////////////////////
+	if (argc > 2 && strcmp(argv[1], "-analytic") == 0)
+		return RunAnalytic(argv[2], argc - 3, argv + 3);
+	if (argc > 1 && strcmp(argv[1], "-analytic-check") == 0)
+		return RunAnalyticCheck(argc > 2 ? atoi(argv[2]) : 0);
+
 	////////////////////////////////////////////////////////////
 	// Get timestamp for file name _MMDDYY_HHMMSS_
 	////////////////////////////////////////////////////////////
@@ -30,7 +90,7 @@ int main(int argc, char* argv[])
 
 	int32s pos = _snprintf_s(buffer, BUFFER_SIZE, BUFFER_SIZE - 1,
 		"%s_%02i%02i%02i_%02i%02i%02i",
-		(argc > 1 ? argv[1] : ""),
+		SimOptions.prefix,
 		parsed_time.tm_mon + 1,
 		parsed_time.tm_mday,
 		parsed_time.tm_year - 100,
@@ -38,8 +98,8 @@ int main(int argc, char* argv[])
 		parsed_time.tm_min,
 		parsed_time.tm_sec);
 
-	if (pos < 0 || pos > BUFFER_SIZE - 10)
-		pos = BUFFER_SIZE - 10;
+	if (pos < 0 || pos > (int32s)BUFFER_SIZE - 16)
+		pos = BUFFER_SIZE - 16;
 
 	////////////////////////////////////////////////////////////
 	// Initialize output streams
@@ -48,7 +108,10 @@ int main(int argc, char* argv[])
 	buffer[pos] = '\0';  OPEN_CONF_STREAM(buffer, BUFFER_SIZE);
 	buffer[pos] = '\0';  OPEN_INFO_STREAM(buffer, BUFFER_SIZE);
 	buffer[pos] = '\0';  OPEN_OUT1_STREAM(buffer, BUFFER_SIZE);
+	buffer[pos] = '\0';  OPEN_OUT1_DS_STREAM(buffer, BUFFER_SIZE);
 	buffer[pos] = '\0';  OPEN_OUT2_STREAM(buffer, BUFFER_SIZE);
+	buffer[pos] = '\0';  OPEN_BIN1_STREAM(buffer, BUFFER_SIZE, DirectionColumns(false), DirectionColumns(true));
+	buffer[pos] = '\0';  OPEN_METRICS(buffer);
 
 
 	////////////////////////////////////////////////////////////
@@ -64,6 +127,7 @@ int main(int argc, char* argv[])
 	////////////////////////////////////////////////////////////
 
 	MSG_INFO("<<<<< Elapsed time: " << (int32s)(time(NULL) - sim_start_time) << " sec.");
+	OutputWarningSummary();
 
 	////////////////////////////////////////////////////////////
 	// Close output streams
@@ -72,7 +136,9 @@ int main(int argc, char* argv[])
 	CLOSE_CONF_STREAM();
 	CLOSE_INFO_STREAM();
 	CLOSE_OUT1_STREAM();
+	CLOSE_OUT1_DS_STREAM();
 	CLOSE_OUT2_STREAM();
+	CLOSE_BIN1_STREAM();
 
 	return ret;
 }
@@ -76,6 +76,110 @@ template< class item_t, int32s SIZE > class Queue
     {
         if( index < qSize )  qArray[ qMap( index ) ] = item;
     }
+    ////////////////////////////////////////////////////////////////
+    template< class archive_t > void Serialize( archive_t& ar )
+    {
+        ar.Raw( qArray );
+        ar.Raw( qHead );
+        ar.Raw( qSize );
+        ar.Raw( qLimit );
+    }
+};
+
+////////////////////////////////////////////////////////////////////
+// Queue with run-length encoded items: Add( item, count ) stores a 
+// run of count identical items (e.g. idle vectors) as one element, 
+// so the run costs O(1) in memory and time. Get() returns one item 
+// at a time. Sizes and limits are counted in items, as in Queue.
+////////////////////////////////////////////////////////////////////
+template< class item_t, int32s SIZE > class RunQueue
+{
+  private:
+    item_t  qArray[ SIZE ];
+    int32s  qRun[ SIZE ];       // items in each element
+    int32s  qHead;              // first element
+    int32s  qRuns;              // number of elements
+    int32s  qSize;              // number of items
+    int32s  qLimit;
+
+    ////////////////////////////////////////////////////////////////
+    inline int32s  qMap( int32s index ) const
+    {
+        if((index += qHead) >= SIZE )   index -= SIZE;
+        return index;
+    }
+    ////////////////////////////////////////////////////////////////
+
+
+  public:
+    RunQueue( int32s queue_limit = SIZE )
+    {
+        qHead   = 0;
+        qRuns   = 0;
+        qSize   = 0;
+        SetLimit( queue_limit );
+    }
+
+    ////////////////////////////////////////////////////////////////
+    inline void SetLimit( int32s queue_limit )
+    {
+        qLimit  = MIN<int32s>( queue_limit, SIZE );
+    }
+
+    ////////////////////////////////////////////////////////////////
+    inline bool     IsEmpty(void)   const   { return qSize <= 0;    }
+    inline bool     IsFull(void)    const   { return qSize >= qLimit; }
+    inline int32s   GetSize(void)   const   { return qSize; }
+    inline int32s   GetRuns(void)   const   { return qRuns; }
+    inline void     Clear  (void)           { qSize = qRuns = 0; }
+    ////////////////////////////////////////////////////////////////
+    inline item_t Peek( int32s index = 0 )  const
+    {
+        int32s run = 0;
+        while( run < qRuns - 1 && index >= qRun[ qMap( run ) ] )
+            index -= qRun[ qMap( run++ ) ];
+        return qArray[ qMap( run ) ];
+    }
+    ////////////////////////////////////////////////////////////////
+    // Add count copies of item; as many as fit if the queue is 
+    // nearly full
+    ////////////////////////////////////////////////////////////////
+    inline void Add( item_t item, int32s count = 1 )
+    {
+        count = MIN<int32s>( count, qLimit - qSize );
+        if( count <= 0 )
+            return;
+
+        int32s index  = qMap( qRuns++ );
+        qArray[ index ] = item;
+        qRun[ index ]   = count;
+        qSize          += count;
+    }
+    ////////////////////////////////////////////////////////////////
+    inline item_t Get(void)
+    {
+        int32s index = qHead;
+        if( !IsEmpty() )
+        {
+            qSize--;
+            if( --qRun[ index ] == 0 )
+            {
+                qHead = qMap( 1 );
+                qRuns--;
+            }
+        }
+        return qArray[ index ];
+    }
+    ////////////////////////////////////////////////////////////////
+    template< class archive_t > void Serialize( archive_t& ar )
+    {
+        ar.Raw( qArray );
+        ar.Raw( qRun );
+        ar.Raw( qHead );
+        ar.Raw( qRuns );
+        ar.Raw( qSize );
+        ar.Raw( qLimit );
+    }
 };
 
 
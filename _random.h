@@ -0,0 +1,41 @@
+/**********************************************************
+ * Filename:    _random.h
+ *
+ * Description: Random-number generator with explicit state.
+ *              Uses the same linear congruential generator
+ *              as the Visual C++ run-time rand(), so results
+ *              match earlier runs, but the state can be saved,
+ *              restored and reseeded by the simulation.
+ *
+ *********************************************************/
+
+#ifndef _RANDOM_H_V001_INCLUDED_
+#define _RANDOM_H_V001_INCLUDED_
+
+#include "_types.h"
+
+#define SIM_RAND_MAX    0x7FFF
+
+thread_local int32u sim_rand_state = 1;     // one sequence per simulation thread
+
+///////////////////////////////////////////////////////////
+// Seed the generator (equivalent of srand())
+///////////////////////////////////////////////////////////
+inline void SimSrand( int32u seed )     { sim_rand_state = seed; }
+
+///////////////////////////////////////////////////////////
+// Next value in [0, SIM_RAND_MAX] (equivalent of rand())
+///////////////////////////////////////////////////////////
+inline int32s SimRand( void )
+{
+    sim_rand_state = sim_rand_state * 214013L + 2531011L;
+    return (int32s)(( sim_rand_state >> 16 ) & SIM_RAND_MAX );
+}
+
+///////////////////////////////////////////////////////////
+// Access to the state for checkpoints
+///////////////////////////////////////////////////////////
+inline int32u SimRandState( void )              { return sim_rand_state; }
+inline void   SimRandRestore( int32u state )    { sim_rand_state = state; }
+
+#endif // _RANDOM_H_V001_INCLUDED_
@@ -1,4 +1,10 @@
 #include "stats.h"
+#include "sim_checkpoint.h"
+#include "sim_profile.h"
+#include "sim_metrics.h"
+#include "sim_golden.h"
+#include "sim_graph.h"
+#include "sim_pipeline.h"
 
 #include "FSM_misc.h"
 #include "FSM_ID.h"
@@ -13,29 +19,84 @@
 #include "FSM_NGEPON_25GMII.h"
 
 #include <ostream>
+#include <vector>
+#include <mutex>
 
 const int32s TEST_FRAMES = 10000;
-int64s frame_bytes = 0;
+
+/////////////////////////////////////////////////////////////////////
+// With CONVERGENCE_STOP, the run ends as soon as the mean and the
+// CONVERGENCE_PERCENTILE of the end-to-end delay are known within
+// CONVERGENCE_PRECISION (relative half-width of the confidence 
+// interval), but never before MIN_TEST_FRAMES or after MAX_TEST_FRAMES.
+// A batch holds at least 10 / (1 - CONVERGENCE_PERCENTILE) frames, so
+// that its percentile is not simply its largest delay. If all batch
+// percentiles are equal, their interval has zero width and says 
+// nothing; it counts only after CONVERGENCE_FLAT_BATCHES batches.
+/////////////////////////////////////////////////////////////////////
+const DOUBLE CONVERGENCE_PRECISION  = 0.01;
+const DOUBLE CONVERGENCE_PERCENTILE = 0.99;
+const DOUBLE CONVERGENCE_CONFIDENCE = 0.95;
+const int32s CONVERGENCE_BATCH      = 1000;     // collected frames per batch
+const int32s CONVERGENCE_MIN_BATCHES= 5;
+const int32s CONVERGENCE_FLAT_BATCHES = 30;
+const int32s MIN_TEST_FRAMES        = CONVERGENCE_MIN_BATCHES * CONVERGENCE_BATCH;
+const int32s MAX_TEST_FRAMES        = 1000 * TEST_FRAMES;
+thread_local int64s frame_bytes = 0;
 
 using namespace std;
 
 ///////////////////////////////////////////////////////////////////
-// Callback function to return packet sizes
+// Callback function to return packet sizes. The size is a function
+// of two draws of SimRand(), so that the analytic model can
+// enumerate all of them (see sim_analytic.h); the second draw is
+// made only for packets longer than the minimum.
 ///////////////////////////////////////////////////////////////////
+inline bool IsMinPacketDraw(int32s draw)
+{
+    return (double)draw / SIM_RAND_MAX <= 0.25;
+}
 
-int16s PacketSize(void) 
+inline int16s PacketSizeOfDraw(int32s draw)
 {
-    double p = (double)rand() / RAND_MAX;
+    return (int16s) (((double)draw / SIM_RAND_MAX) * (MAX_PACKET_BYTES - MIN_PACKET_BYTES) + MIN_PACKET_BYTES);
+}
 
-    if (p <= 0.25)	return MIN_PACKET_BYTES;
-    return (int16s) (((double)rand() / RAND_MAX) * (MAX_PACKET_BYTES - MIN_PACKET_BYTES) + MIN_PACKET_BYTES);
+int16s PacketSize(void) 
+{
+    if (IsMinPacketDraw(SimRand()))	return MIN_PACKET_BYTES;
+    return PacketSizeOfDraw(SimRand());
 }
 
 /////////////////////////////////////////////////////////////////////
-// objects for collecting statistics
+// objects for collecting statistics; thread-local, so that several
+// simulations can run in parallel threads
 /////////////////////////////////////////////////////////////////////
-#define DISTRIB_BINS 1400
-Distrib< DISTRIB_BINS > DelayHistogram[ DELAY_ARRAY_SIZE + 1];
+#ifdef DELAY_QUANTILE_SKETCH
+#define DELAY_SKETCH_K 200        // rank error of about 1.7/K (< 1%)
+typedef QuantileSketch< DELAY_SKETCH_K > delay_hist_t;
+#else
+#define DELAY_HIST_SUB_BITS 7     // relative precision of 2^-7 (< 0.8%)
+typedef LogHistogram< DELAY_HIST_SUB_BITS > delay_hist_t;
+#endif
+thread_local delay_hist_t DelayHistogram[ DELAY_ARRAY_SIZE + 1];
+thread_local BatchMeansCI DelayConvergence(CONVERGENCE_BATCH, CONVERGENCE_PERCENTILE, CONVERGENCE_CONFIDENCE);
+
+/////////////////////////////////////////////////////////////////////
+// With WARMUP_DETECTION, the first WARMUP_WINDOW collected frames
+// are buffered and the warm-up transient found among them by MSER-5 
+// is excluded from the statistics
+/////////////////////////////////////////////////////////////////////
+const int32s WARMUP_WINDOW = 1000;       // collected frames
+
+struct delay_record_t
+{
+    int16s delay[ DELAY_ARRAY_SIZE + 1 ];   // stage delays and total delay
+};
+
+thread_local std::vector< delay_record_t > WarmupBuffer;
+thread_local bool   warmup_done      = true;
+thread_local int32s warmup_truncated = 0;
 
 ///////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////
@@ -48,71 +109,337 @@ Distrib< DISTRIB_BINS > DelayHistogram[ DELAY_ARRAY_SIZE + 1];
 #define ALL_MODULES(header, val)                      \
 {                                                       \
     MSG_OUT2(header << ",");                          \
-    for (n=0; n <= DELAY_ARRAY_SIZE; n++)              \
-        MSG_OUT2("," << DelayHistogram[n].##val);     \
+    for (n=0; n < (int32s)ResultColumns.delay.size(); n++)  \
+        MSG_OUT2("," << DelayHistogram[ ResultColumns.delay[n] ].##val);  \
+    MSG_OUT2("," << DelayHistogram[ DELAY_ARRAY_SIZE ].##val);  \
     MSG_OUT2(endl);                                   \
 }
 
 //#define HEADER_STRING   "CLIENT,MPCP_TX,MAC_TX,XGMII_TX,IDLE_DEL,66B_ENCODER,SCRAMBLER,DATA_DET,FEC_DECODER,DESCRAMBLER,66B_DECODER,IDLE_INS,XGMII_RX,MAC_RX,MPCP_RX,TOTAL"
+#ifdef CHECK_DOWNSTREAM
+#define HEADER_STRING   "CLIENT,MPCP_TX,MAC_TX,RS_TX,25GMII_TX,25GMII_RX,RS_RX,MAC_RX,MPCP_RX,IDLE_DEL,66B_ENCODER,SCRAMBLER,DATA_DET,FEC_DECODER,DESCRAMBLER,66B_DECODER,IDLE_INS,TOTAL"
+#else
 #define HEADER_STRING   "CLIENT,MPCP_TX,MAC_TX,RS_TX,25GMII_TX,25GMII_RX,RS_RX,MAC_RX,TOTAL"
+#endif
 
 /////////////////////////////////////////////////////////////
-// void CollectStats(const _frm_t& frame) 
+// with STAGE_GRAPH, the columns follow the stage list
 /////////////////////////////////////////////////////////////
-void CollectStats(const _frm_t& frame)
-{ 
-    frame_bytes += frame.GetFrameSize();
+#ifdef STAGE_GRAPH
+#undef  HEADER_STRING
+#define HEADER_STRING       StageGraph.Header()
+#define TOTAL_DELAY_FROM    StageGraph.TotalFrom()
+#else
+#define TOTAL_DELAY_FROM    DLY_NGEPON_MAC_TX
+#endif
+
+/////////////////////////////////////////////////////////////
+// HEADER_STRING names every entry of the delay array (golden
+// digests). The results of a direction list only the stages 
+// on its path, in path order (ResultColumns of its thread).
+/////////////////////////////////////////////////////////////
+const int16s UPSTREAM_DELAYS[] = { DLY_NGEPON_MACC, DLY_NGEPON_MPCP_TX, DLY_NGEPON_MAC_TX, DLY_NGEPON_RS_TX,
+    DLY_NGEPON_25GMII_TX, DLY_NGEPON_25GMII_RX, DLY_NGEPON_RS_RX, DLY_NGEPON_MAC_RX };
+const result_columns_t UPSTREAM_COLUMNS("CLIENT,MPCP_TX,MAC_TX,RS_TX,25GMII_TX,25GMII_RX,RS_RX,MAC_RX,TOTAL",
+    UPSTREAM_DELAYS, 8, DLY_NGEPON_MAC_TX);
+
+#if defined(CHECK_DOWNSTREAM) && !defined(STAGE_GRAPH)
+const int16s DOWNSTREAM_DELAYS[] = { DLY_NGEPON_MACC, DLY_NGEPON_MPCP_TX, DLY_NGEPON_MAC_TX, DLY_IDLE_DEL, 
+    DLY_66B_ENCODER, DLY_SCRAMBLER, DLY_DATA_DET, DLY_FEC_DECODER, DLY_DESCRAMBLER, DLY_66B_DECODER, 
+    DLY_IDLE_INS, DLY_NGEPON_MAC_RX, DLY_NGEPON_MPCP_RX };
+const result_columns_t DOWNSTREAM_COLUMNS("CLIENT,MPCP_TX,MAC_TX,IDLE_DEL,66B_ENCODER,SCRAMBLER,DATA_DET,FEC_DECODER,DESCRAMBLER,66B_DECODER,IDLE_INS,MAC_RX,MPCP_RX,TOTAL",
+    DOWNSTREAM_DELAYS, 13, DLY_NGEPON_MAC_TX);
+#endif
+
+inline result_columns_t DirectionColumns(bool downstream)
+{
+#if defined(STAGE_GRAPH)
+    (void)downstream;               // the graph is the only path
+    return StageGraph.Columns();
+#elif defined(CHECK_DOWNSTREAM)
+    return downstream ? DOWNSTREAM_COLUMNS : UPSTREAM_COLUMNS;
+#else
+    (void)downstream;
+    return UPSTREAM_COLUMNS;
+#endif
+}
+
+thread_local result_columns_t ResultColumns = DirectionColumns(false);
+
+/////////////////////////////////////////////////////////////
+// Direction of the calling thread ("Upstream" or "Downstream"),
+// named in its report and INFO lines if both are simulated
+/////////////////////////////////////////////////////////////
+thread_local const CHAR* StatsDirection = NULL;
+
+inline string DirectionPrefix(void)
+{
+    return StatsDirection != NULL ? string(StatsDirection) + ": " : string();
+}
+
+/////////////////////////////////////////////////////////////
+// serializes the final reports when upstream and downstream
+// run in parallel threads
+/////////////////////////////////////////////////////////////
+std::mutex OutputStatsLock;
+
+/////////////////////////////////////////////////////////////
+// void SampleDelays(const int16s* delays, delay_hist_t* histograms, BatchMeansCI& convergence) 
+// delays[] holds DELAY_ARRAY_SIZE stage delays followed by 
+// the total delay; histograms[] has one more entry for it
+/////////////////////////////////////////////////////////////
+void SampleDelays(const int16s* delays, delay_hist_t* histograms, BatchMeansCI& convergence)
+{
+    FOR_ALL(DELAY_ARRAY_SIZE + 1, dly_ndx)
+        histograms[ dly_ndx ].Sample(delays[ dly_ndx ]);
+    convergence.Sample(delays[ DELAY_ARRAY_SIZE ]);
+}
+
+inline void SampleDelays(const int16s* delays)
+{
+    SampleDelays(delays, DelayHistogram, DelayConvergence);
+}
+
+/////////////////////////////////////////////////////////////
+// void FinishWarmup(void) 
+// Locates the end of the warm-up transient (MSER-5 over the 
+// total delay of the buffered frames) and samples only the 
+// frames after it
+/////////////////////////////////////////////////////////////
+void FinishWarmup(void)
+{
+    if (warmup_done)
+        return;
+
+    std::vector< stat_t > series(WarmupBuffer.size());
+    for (size_t n = 0; n < WarmupBuffer.size(); n++)
+        series[n] = WarmupBuffer[n].delay[ DELAY_ARRAY_SIZE ];
+
+    warmup_truncated = series.empty()? 0 : MserTruncation(&series[0], (int32s)series.size(), 5);
+    for (size_t n = warmup_truncated; n < WarmupBuffer.size(); n++)
+        SampleDelays(WarmupBuffer[n].delay);
+
+    MSG_INFO(DirectionPrefix() << "Warm-up (MSER-5): truncated " << warmup_truncated << " of " << WarmupBuffer.size() << " frames");
+    WarmupBuffer.clear();
+    warmup_done = true;
+}
 
+/////////////////////////////////////////////////////////////
+// bool FrameDelays(const _frm_t& frame, int16s* delays) 
+// Fills delays[] (DELAY_ARRAY_SIZE + 1 entries) with the stage 
+// delays and the total delay of the frame; false if the frame
+// is not part of the delay statistics. Changes no statistics.
+/////////////////////////////////////////////////////////////
+inline bool FrameDelays(const _frm_t& frame, int16s* delays)
+{
 #ifdef SHOW_64B_PACKETS_ONLY
     if (frame.GetFrameSize() != MPCP_PACKET_BYTES + PREAMBLE_BYTES)
-        return;
+        return false;
 #endif
+    if (!frame.IsProbe())
+        return false;
 
-    int16s delay, total_delay = 0;
-    MSG_OUT1(frame.GetFrameSize() - PREAMBLE_BYTES << ",,");
-
+    int16s total_delay = 0;
     FOR_ALL(DELAY_ARRAY_SIZE, dly_ndx)
     {
-        delay = frame.GetDelay(dly_ndx);
-        DelayHistogram[ dly_ndx ].Sample(delay);
-        MSG_OUT1(delay << ",");
+        delays[ dly_ndx ] = frame.GetDelay(dly_ndx);
 
         //////////////////////////////////////////////////////////
         // calculates total delay after messages were timestamped, 
         // i.e., excluding the MAC Client and MPCP delay
         //////////////////////////////////////////////////////////
-        if (dly_ndx >= DLY_NGEPON_MAC_TX)
-            total_delay += delay;
+        if (dly_ndx >= TOTAL_DELAY_FROM)
+            total_delay += delays[ dly_ndx ];
     }
-    
-    DelayHistogram[ DELAY_ARRAY_SIZE ].Sample(total_delay);
-    MSG_OUT1(total_delay << endl);
+    delays[ DELAY_ARRAY_SIZE ] = total_delay;
+    return true;
+}
+
+/////////////////////////////////////////////////////////////
+// bool CollectStats(const _frm_t& frame) 
+// false if the frame is not part of the delay statistics
+/////////////////////////////////////////////////////////////
+bool CollectStats(const _frm_t& frame)
+{ 
+    frame_bytes += frame.GetFrameSize();
+
+    // golden-result runs record every frame (see sim_golden.h)
+    if (GoldenDigest != NULL)
+        GoldenDigest->AddFrame(frame);
+
+    int16s delays[ DELAY_ARRAY_SIZE + 1 ];
+    if (!FrameDelays(frame, delays))
+        return false;
+
+#if defined(RESULT_1_OUTPUT_FILE) || defined(RESULT_1_OUTPUT_SCREEN)
+    // the row is written at once, so rows of other threads on the
+    // same stream (the screen) cannot break it up
+    ostringstream row;
+    row << frame.GetFrameSize() - PREAMBLE_BYTES << ",,";
+    FOR_ALL((int32s)ResultColumns.delay.size(), n)
+        row << delays[ ResultColumns.delay[n] ] << ",";
+    row << delays[ DELAY_ARRAY_SIZE ] << "\n";
+    MSG_OUT1(row.str());
+#endif
+    RSLT1_BINARY_OUT(frame.GetFrameSize() - PREAMBLE_BYTES, delays);
+
+#ifdef WARMUP_DETECTION
+    //////////////////////////////////////////////////////////
+    // hold back the first WARMUP_WINDOW frames until the 
+    // warm-up transient has been located
+    //////////////////////////////////////////////////////////
+    if (!warmup_done)
+    {
+        delay_record_t rec;
+        memcpy(rec.delay, delays, sizeof(rec.delay));
+        WarmupBuffer.push_back(rec);
+        if ((int32s)WarmupBuffer.size() >= WARMUP_WINDOW)
+            FinishWarmup();
+        return true;
+    }
+#endif
+
+    SampleDelays(delays);
+    return true;
 }
  
+/////////////////////////////////////////////////////////////
+// void ExportMetrics(void)
+// Metrics of the direction simulated by the calling thread, 
+// with the stage counters last captured from its pipeline
+/////////////////////////////////////////////////////////////
+void ExportMetrics(void)
+{
+    if (!MetricsExporter.IsOpen())
+        return;
+
+    metrics_snapshot_t metrics;
+    metrics.SetLabel("direction", MetricsDirection);
+
+    clk_t clock = timestamp_t::GetClock();
+    metrics.Counter("mprs_clock_byte_times_total", "Simulated time in byte times", (DOUBLE)clock);
+    metrics.Counter("mprs_frame_bytes_total", "Bytes of the frames delivered", (DOUBLE)frame_bytes);
+    metrics.Gauge("mprs_throughput", "Bytes of the frames delivered per byte time", clock > 0 ? (DOUBLE)frame_bytes / clock : 0.0);
+    metrics.Gauge("mprs_delay_mean_byte_times", "Mean total delay over the batches", DelayConvergence.GetMean());
+    metrics.Gauge("mprs_delay_mean_half_width_byte_times", "Half-width of the confidence interval of the mean total delay", DelayConvergence.GetMeanHalfWidth());
+    metrics.Gauge("mprs_delay_batches", "Batches of frames in the total delay statistics", DelayConvergence.GetBatches());
+
+    for (size_t n = 0; n < MetricsStages.size(); n++)
+    {
+        const stage_metrics_t& stage = MetricsStages[n];
+        metric_labels_t labels(1, make_pair(string("stage"), string(stage.name)));
+
+        metrics.Counter("mprs_stage_units_in_total", "Units (frames, columns or vectors) received by a stage", (DOUBLE)stage.units_in, labels);
+        metrics.Counter("mprs_stage_units_out_total", "Units (frames, columns or vectors) transmitted by a stage", (DOUBLE)stage.units_out, labels);
+        metrics.Counter("mprs_stage_stalls_total", "Clocks on which a stage held a unit the next stage did not take", (DOUBLE)stage.stalls, labels);
+        if (stage.occupancy >= 0)
+            metrics.Gauge("mprs_stage_occupancy", "Units in the buffer of a stage", stage.occupancy, labels);
+    }
+
+    /////////////////////////////////////////////////////////////
+    // per-stage delays, labeled with the columns of the results
+    /////////////////////////////////////////////////////////////
+    vector< string > columns = GoldenFields(ResultColumns.header);
+    FOR_ALL((int32s)columns.size(), col)
+    {
+        int32s ndx = col < (int32s)ResultColumns.delay.size() ? ResultColumns.delay[col] : DELAY_ARRAY_SIZE;
+        const delay_hist_t& hist = DelayHistogram[ndx];
+        metric_labels_t labels(1, make_pair(string("stage"), columns[col]));
+        vector< pair< DOUBLE, DOUBLE > > points;
+#ifdef DELAY_QUANTILE_SKETCH
+        if (hist.GetCount() == 0)
+            continue;
+
+        const DOUBLE QUANTILES[] = { 0.5, 0.9, 0.99, 0.999 };
+        FOR_ALL(4, q)
+            points.push_back(make_pair(QUANTILES[q], (DOUBLE)hist.GetPercentileValue(QUANTILES[q])));
+        metrics.Summary("mprs_delay_byte_times", "Delay of the collected frames in a stage", points, hist.GetTotal(), (int64u)hist.GetCount(), labels);
+#else
+        /////////////////////////////////////////////////////////////
+        // the same 16 bounds in every export: 0 and 2^k - 1 up to the
+        // largest delay (int16s). Each bound is the top of a bucket,
+        // so the cumulative counts are exact.
+        /////////////////////////////////////////////////////////////
+        int64u cumulative = 0;
+        int32s bin = 0;
+        for (int32s bound = 0; bound <= 0x7FFF; bound = 2 * bound + 1)
+        {
+            for (; bin <= delay_hist_t::GetBinOf(bound); bin++)
+                cumulative += hist.GetBin(bin);
+            points.push_back(make_pair((DOUBLE)bound, (DOUBLE)cumulative));
+        }
+        metrics.Histogram("mprs_delay_byte_times", "Delay of the collected frames in a stage", points, hist.GetTotal(), (int64u)hist.GetCount(), labels);
+#endif
+    }
+
+    vector< pair< string, int64s > > warnings = WarnRegistry.Counts(WarnDirection);
+    for (size_t n = 0; n < warnings.size(); n++)
+        metrics.Counter("mprs_warnings_total", "Warnings raised at a call site", (DOUBLE)warnings[n].second,
+                        metric_labels_t(1, make_pair(string("source"), warnings[n].first)));
+
+    if (!MetricsExporter.Write(metrics, strcmp(MetricsDirection, "downstream") == 0 ? "_DS" : ""))
+        MSG_WARN("Cannot write the metrics files");
+}
+
 /////////////////////////////////////////////////////////////
 // void OutputStats(void)
+// labeled with StatsDirection if both directions are simulated
 /////////////////////////////////////////////////////////////
 void OutputStats(void)
 { 
+    std::lock_guard< std::mutex > lock(OutputStatsLock);
+
+    FinishWarmup();
+    if (StatsDirection != NULL)
+    {
+        MSG_INFO(StatsDirection << ":");
+        MSG_OUT2(StatsDirection << endl);
+    }
     MSG_INFO("Throughput: " << static_cast<double>(frame_bytes)/timestamp_t::GetClock());
+    MSG_INFO("Mean total delay: " << DelayConvergence.GetMean() 
+        << " +/- " << DelayConvergence.GetMeanHalfWidth()
+        << " (" << 100 * DelayConvergence.GetConfidence() << "% CI, relative precision " 
+        << DelayConvergence.GetMeanPrecision() << ")");
+    MSG_INFO("p" << 100 * DelayConvergence.GetPercentile() << " total delay: " << DelayConvergence.GetPctl()
+        << " +/- " << DelayConvergence.GetPctlHalfWidth()
+        << " (" << 100 * DelayConvergence.GetConfidence() << "% CI, relative precision " 
+        << DelayConvergence.GetPctlPrecision() << ")");
+    MSG_INFO("Batches: " << DelayConvergence.GetBatches() << " x " << DelayConvergence.GetBatchSize() << " frames");
     MSG_OUT2("Throughput,"  << static_cast<double>(frame_bytes)/timestamp_t::GetClock() << endl);
     
     int32s n;
-    MSG_OUT2("Delay (byte times),," << HEADER_STRING << endl);
+    MSG_OUT2("Delay (byte times),," << ResultColumns.header << endl);
     ALL_MODULES("Total frames",  GetCount());
     ALL_MODULES("Min delay",     GetMin()  );
     ALL_MODULES("Max delay",     GetMax()  );
     ALL_MODULES("Max drift",     GetRange());
+    ALL_MODULES("p50 delay",     GetPercentileValue(0.5));
+    ALL_MODULES("p99 delay",     GetPercentileValue(0.99));
+    ALL_MODULES("p99.9 delay",   GetPercentileValue(0.999));
     MSG_OUT2(endl);
 
     /////////////////////////////////////////////////////////////
-    // output histograms 
+    // output histograms; each row is a log-linear bucket labeled 
+    // with the lowest delay it contains 
+    /////////////////////////////////////////////////////////////
+#if defined(SHOW_HISTOGRAM) && defined(DELAY_QUANTILE_SKETCH)
     /////////////////////////////////////////////////////////////
-#ifdef SHOW_HISTOGRAM
-    MSG_OUT2("Delay (byte times),," << HEADER_STRING << endl);
-    FOR_ALL(DISTRIB_BINS, bin)
-        ALL_MODULES(bin, GetBinNorm(bin));
+    // a sketch has no bins; output the delay at each percentile 
+    /////////////////////////////////////////////////////////////
+    MSG_OUT2("Percentile,," << ResultColumns.header << endl);
+    FOR_ALL(100, pcnt)
+        ALL_MODULES(pcnt + 1, GetPercentileValue((pcnt + 1) / 100.0));
+#elif defined(SHOW_HISTOGRAM)
+    int32s bins = 0;
+    FOR_ALL(DELAY_ARRAY_SIZE + 1, ndx)
+        bins = MAX(bins, DelayHistogram[ndx].GetBins());
+
+    MSG_OUT2("Delay (byte times),," << ResultColumns.header << endl);
+    FOR_ALL(bins, bin)
+        ALL_MODULES(delay_hist_t::GetBinFloor(bin), GetBinNorm(bin));
 #endif
+
+    ExportMetrics();
 }
 
 /////////////////////////////////////////////////////////////
@@ -122,16 +449,255 @@ void ClearStats(void)
 { 
     timestamp_t::ResetClock();
     frame_bytes = 0;
+    ProbePolicy.Init(PROBE_INTERVAL, PROBE_FRAME_SIZE);
     FOR_ALL(DELAY_ARRAY_SIZE + 1, n)             
         DelayHistogram[n].Clear();
+    DelayConvergence.Clear();
+    MetricsTimer.Reset();
+    MetricsStages.clear();
+
+    WarmupBuffer.clear();
+    WarmupBuffer.reserve(WARMUP_WINDOW);
+#ifdef WARMUP_DETECTION
+    warmup_done = false;
+#endif
+    warmup_truncated = 0;
+}
+
+/////////////////////////////////////////////////////////////
+// bool SimulationDone(int32s frame_count)
+/////////////////////////////////////////////////////////////
+inline bool SimulationDone(int32s frame_count)
+{
+#ifdef CONVERGENCE_STOP
+    if (frame_count >= MAX_TEST_FRAMES)
+    {
+        MSG_INFO(DirectionPrefix() << "Frame budget exhausted before convergence: " << frame_count << " frames");
+        return true;
+    }
+    if (frame_count >= MIN_TEST_FRAMES && DelayConvergence.Converged(CONVERGENCE_PRECISION, CONVERGENCE_MIN_BATCHES, CONVERGENCE_FLAT_BATCHES))
+    {
+        MSG_INFO(DirectionPrefix() << "Converged after " << frame_count << " frames");
+        return true;
+    }
+    return false;
+#else
+    return frame_count >= TEST_FRAMES;
+#endif
 }
 
 /////////////////////////////////////////////////////////////////////
-// void DownstreamTiming(void)
+// Upstream path: instances of finite state machines and the state
+// of the simulation loop. Kept together so that the complete state
+// can be saved into and restored from a checkpoint.
 /////////////////////////////////////////////////////////////////////
-void DownstreamTiming(void)
+struct upstream_context_t
+{
+	fsm_ngepon_macc_t< PacketSize >		FSM_MAC_CLIENT;				// defined in FSM_NGEPON_MACC.h
+    fsm_ngepon_mpcp_tx_t				FSM_MPCP_TX;				// defined in FSM_NGEPON_MPCP.h
+    fsm_ngepon_mac_tx_t< MII_WIDTH >	FSM_MAC_TX;					// defined in FSM_NGEPON_MAC.h
+	fsm_ngepon_rs_tx_t< MII_WIDTH >		FSM_RS_TX;					// defined in FSM_NGEPON_RS.h
+    fsm_ngepon_25gmii_tx_t< MII_WIDTH >	FSM_25GMII_TX;				// defined in FSM_NGEPON_25GMII.h
+#ifdef BIT_ERROR_INJECTION
+	fsm_bit_error_t< MII_WIDTH >		FSM_BIT_ERRORS;				// defined in FSM_BER.h
+#endif
+	fsm_ngepon_25gmii_rx_t< MII_WIDTH >	FSM_25GMII_RX;				// defined in FSM_NGEPON_25GMII.h
+	fsm_ngepon_rs_rx_t					FSM_RS_RX;					// defined in FSM_NGEPON_RS.h
+	fsm_ngepon_mac_rx_t< MII_WIDTH >	FSM_MAC_RX;					// defined in FSM_NGEPON_MAC.h
+	fsm_ngepon_mpcp_rx_t				FSM_MPCP_RX;				// defined in FSM_NGEPON_MPCP.h
+
+	int32s								frame_count;
+	int32u								VectorCount36b;
+
+	upstream_context_t() : FSM_MAC_CLIENT(true)
+	{
+		frame_count    = 0;
+		VectorCount36b = 0;
+	}
+
+	template< class archive_t > void Serialize(archive_t& ar)
+	{
+		FSM_MAC_CLIENT.Serialize(ar);
+		FSM_MPCP_TX.Serialize(ar);
+		FSM_MAC_TX.Serialize(ar);
+		FSM_RS_TX.Serialize(ar);
+		FSM_25GMII_TX.Serialize(ar);
+#ifdef BIT_ERROR_INJECTION
+		FSM_BIT_ERRORS.Serialize(ar);
+#endif
+		FSM_25GMII_RX.Serialize(ar);
+		FSM_RS_RX.Serialize(ar);
+		FSM_MAC_RX.Serialize(ar);
+		FSM_MPCP_RX.Serialize(ar);
+		ar.Raw(frame_count);
+		ar.Raw(VectorCount36b);
+	}
+};
+
+/////////////////////////////////////////////////////////////////////
+// Checkpoint content: global clock, random-number generator, 
+// collected statistics and the upstream context. The layout 
+// signature rejects snapshots written by an incompatible build.
+/////////////////////////////////////////////////////////////////////
+const int32u CHECKPOINT_LAYOUT = (int32u)(sizeof(upstream_context_t) * 1021 + sizeof(delay_hist_t) * 31 + sizeof(probe_policy_t) * 7 + DELAY_ARRAY_SIZE);
+
+template< class archive_t > void SerializeUpstream(archive_t& ar, upstream_context_t& ctx)
+{
+	clk_t  clock = timestamp_t::GetClock();
+	int32u rand_state = SimRandState();
+
+	ar.Raw(clock);
+	ar.Raw(rand_state);
+	ar.Raw(frame_bytes);
+	FOR_ALL(DELAY_ARRAY_SIZE + 1, n)
+		DelayHistogram[n].Serialize(ar);
+	DelayConvergence.Serialize(ar);
+	ar.Vector(WarmupBuffer);
+	ar.Raw(warmup_done);
+	ar.Raw(warmup_truncated);
+	ar.Raw(ProbePolicy);
+	ctx.Serialize(ar);
+
+	if (ar.IsLoading())
+	{
+		timestamp_t::ResetClock(clock);
+		SimRandRestore(rand_state);
+	}
+}
+
+bool SaveCheckpoint(upstream_context_t& ctx)
+{
+	snapshot_t snapshot;
+	SerializeUpstream(snapshot, ctx);
+
+	bool ok = snapshot.Save(SimOptions.checkpoint_file, CHECKPOINT_LAYOUT);
+	if (ok)
+	{
+		MSG_INFO("Checkpoint at frame " << ctx.frame_count << " saved into " << SimOptions.checkpoint_file);
+	}
+	else
+	{
+		MSG_WARN("Cannot save checkpoint into " << SimOptions.checkpoint_file);
+	}
+	return ok;
+}
+
+bool LoadCheckpoint(upstream_context_t& ctx, const CHAR* file_name)
+{
+	snapshot_t snapshot;
+	if (!snapshot.Load(file_name, CHECKPOINT_LAYOUT))
+		return false;
+
+	SerializeUpstream(snapshot, ctx);
+	return !snapshot.Failed();
+}
+
+/////////////////////////////////////////////////////////////////////
+// The upstream path; the column loop is generated from this list 
+// (see sim_pipeline.h). The bit-error stage copies every vector, so
+// it is left out unless BIT_ERROR_INJECTION is defined.
+/////////////////////////////////////////////////////////////////////
+#ifdef BIT_ERROR_INJECTION
+typedef pipeline_t< fsm_ngepon_macc_t< PacketSize >, fsm_ngepon_mpcp_tx_t, fsm_ngepon_mac_tx_t< MII_WIDTH >, fsm_ngepon_rs_tx_t< MII_WIDTH >,
+                    fsm_ngepon_25gmii_tx_t< MII_WIDTH >, fsm_bit_error_t< MII_WIDTH >, fsm_ngepon_25gmii_rx_t< MII_WIDTH >,
+                    fsm_ngepon_mac_rx_t< MII_WIDTH >, fsm_ngepon_mpcp_rx_t > upstream_pipeline_t;
+
+inline upstream_pipeline_t UpstreamPipeline(upstream_context_t& ctx)
+{
+	return upstream_pipeline_t(ctx.VectorCount36b, ctx.FSM_MAC_CLIENT, ctx.FSM_MPCP_TX, ctx.FSM_MAC_TX, ctx.FSM_RS_TX,
+	                           ctx.FSM_25GMII_TX, ctx.FSM_BIT_ERRORS, ctx.FSM_25GMII_RX, ctx.FSM_MAC_RX, ctx.FSM_MPCP_RX);
+}
+#else
+typedef pipeline_t< fsm_ngepon_macc_t< PacketSize >, fsm_ngepon_mpcp_tx_t, fsm_ngepon_mac_tx_t< MII_WIDTH >, fsm_ngepon_rs_tx_t< MII_WIDTH >,
+                    fsm_ngepon_25gmii_tx_t< MII_WIDTH >, fsm_ngepon_25gmii_rx_t< MII_WIDTH >, fsm_ngepon_mac_rx_t< MII_WIDTH >,
+                    fsm_ngepon_mpcp_rx_t > upstream_pipeline_t;
+
+inline upstream_pipeline_t UpstreamPipeline(upstream_context_t& ctx)
+{
+	return upstream_pipeline_t(ctx.VectorCount36b, ctx.FSM_MAC_CLIENT, ctx.FSM_MPCP_TX, ctx.FSM_MAC_TX, ctx.FSM_RS_TX,
+	                           ctx.FSM_25GMII_TX, ctx.FSM_25GMII_RX, ctx.FSM_MAC_RX, ctx.FSM_MPCP_RX);
+}
+#endif
+
+/////////////////////////////////////////////////////////////////////
+// void RunUpstream(upstream_context_t& ctx, int32s frame_limit)
+// Runs the upstream path until SimulationDone(), or for exactly 
+// frame_limit frames if frame_limit > 0 (quietly, for benchmarks). 
+// Uses only the statistics of the calling thread.
+/////////////////////////////////////////////////////////////////////
+void RunUpstream(upstream_context_t& ctx, int32s frame_limit)
+{
+	upstream_pipeline_t pipeline = UpstreamPipeline(ctx);
+
+	int32u& VectorCount36b = ctx.VectorCount36b;
+	int32s& frame_count = ctx.frame_count;
+
+    bool done = frame_limit > 0 ? frame_count >= frame_limit : SimulationDone(frame_count);
+
+    /////////////////////////////////////////////////////////////////////
+    // frames leaving MPCP RX
+    /////////////////////////////////////////////////////////////////////
+	auto sink = [&](const _frm_t& frame)
+	{
+		frame_count++;
+		if (frame_count%1000 == 0 && frame_limit == 0)
+			std::cout << "Packet counter: " << frame_count << std::endl;
+		{
+			PROFILE_SCOPE(PRF_STATS);
+			CollectStats(frame);
+			done = frame_limit > 0 ? frame_count >= frame_limit : SimulationDone(frame_count);
+		}
+		METRICS_POLL(pipeline.StageMetrics(MetricsStages));
+
+		/////////////////////////////////////////////////////////////
+		// checkpoints are taken at frame boundaries: periodically
+		// and when SIGINT/SIGTERM was received
+		/////////////////////////////////////////////////////////////
+		if (SimOptions.checkpoint_interval > 0 && frame_count % SimOptions.checkpoint_interval == 0)
+			SaveCheckpoint(ctx);
+
+		if (checkpoint_signal != 0)
+		{
+			MSG_INFO("Signal " << (int32s)checkpoint_signal << " received, stopping at frame " << frame_count);
+			SaveCheckpoint(ctx);
+			done = true;
+		}
+	};
+
+    /////////////////////////////////////////////////////////////////////
+    // data propagation through upstream path, one MII transfer 
+    // (MII_WIDTH 36-bit columns) per step. The step count is part of the checkpoint, so the clock 
+    // domains keep their phase across a resume.
+    /////////////////////////////////////////////////////////////////////
+    while (!done)
+    {
+		PROFILE_COLUMN();
+		VectorCount36b++;
+		pipeline.Step(sink);
+    }
+    METRICS_CAPTURE(pipeline.StageMetrics(MetricsStages));
+}
+
+/////////////////////////////////////////////////////////////////////
+// void OutputBitErrors(const upstream_context_t& ctx)
+// Errors injected between 25GMII TX and RX and their effect on MAC RX
+/////////////////////////////////////////////////////////////////////
+void OutputBitErrors(const upstream_context_t& ctx)
 {
+#ifdef BIT_ERROR_INJECTION
+	const fsm_bit_error_t< MII_WIDTH >& channel = ctx.FSM_BIT_ERRORS;
+	if (!channel.Enabled())
+		return;
 
+	const CHAR* unit = channel.PerColumn() ? " columns" : " bits";
+	MSG_INFO("Bit errors: " << channel.GetErrorCount() << unit << " of " << channel.GetUnitCount()
+	         << " (rate " << (channel.GetUnitCount() > 0 ? (DOUBLE)channel.GetErrorCount() / channel.GetUnitCount() : 0.0) << "), "
+	         << channel.GetColumnCount() << " errored columns, " << ctx.FSM_MAC_RX.GetFramesDropped() << " frames dropped by MAC RX");
+#else
+	(void)ctx;
+	if (SimOptions.bit_errors.rate > 0 || SimOptions.bit_errors.burst_rate > 0)
+		MSG_WARN("Bit errors need BIT_ERROR_INJECTION (see sim_config.h); the link was error-free");
+#endif
 }
 
 /////////////////////////////////////////////////////////////////////
@@ -142,110 +708,368 @@ void UpstreamTiming(void)
     /////////////////////////////////////////////////////////////////////
     // instances of finite state machines
     /////////////////////////////////////////////////////////////////////
-	fsm_ngepon_macc_t< PacketSize >		FSM_MAC_CLIENT(true);		// defined in FSM_misc.h
+	upstream_context_t* context = new upstream_context_t;
+	upstream_context_t& ctx = *context;
+
+	if (SimOptions.resume_file != NULL)
+	{
+		if (!LoadCheckpoint(ctx, SimOptions.resume_file))
+		{
+			MSG_WARN("Cannot resume from checkpoint " << SimOptions.resume_file);
+			delete context;
+			return;
+		}
+		MSG_INFO("Resumed from " << SimOptions.resume_file << " at frame " << ctx.frame_count);
+
+		// forking a variant: continue with a different random sequence
+		if (SimOptions.seed_given)
+			SimSrand(SimOptions.seed);
+	}
+	InstallCheckpointHandlers();
+
+#ifdef CHECK_DOWNSTREAM
+    StatsDirection = "Upstream";
+#endif
+    ResultColumns = DirectionColumns(false);
+    MSG_OUT1("Frame size,," << ResultColumns.header << endl);
+
+    PROFILE_START();
+    RunUpstream(ctx, 0);
+    PROFILE_REPORT();
+    OutputBitErrors(ctx);
+    OutputStats();
+    delete context;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Downstream path: the OLT transmits continuously. FEC parity is 
+// inserted by the Data Detector in place of idles removed by Idle 
+// Deletion; the ONU removes the parity in the FEC Decoder and Idle 
+// Insertion restores the original rate.
+/////////////////////////////////////////////////////////////////////
+enum downstream_stage_t
+{
+	DS_MACC, DS_MPCP_TX, DS_MAC_TX, DS_IDLE_DEL, DS_66B_ENCODER, DS_SCRAMBLER, DS_DATA_DET,
+	DS_FEC_DECODER, DS_DESCRAMBLER, DS_66B_DECODER, DS_IDLE_INS, DS_MAC_RX, DS_MPCP_RX,
+	DS_STAGES
+};
+
+const CHAR* const DOWNSTREAM_STAGE_NAME[ DS_STAGES ] =
+{
+	"MACC", "MPCP_TX", "MAC_TX", "IDLE_DEL", "66B_ENCODER", "SCRAMBLER", "DATA_DET",
+	"FEC_DECODER", "DESCRAMBLER", "66B_DECODER", "IDLE_INS", "MAC_RX", "MPCP_RX"
+};
+
+struct downstream_context_t
+{
+	fsm_ngepon_macc_t< PacketSize >		FSM_MAC_CLIENT;				// defined in FSM_NGEPON_MACC.h
     fsm_ngepon_mpcp_tx_t				FSM_MPCP_TX;				// defined in FSM_NGEPON_MPCP.h
-    fsm_ngepon_mac_tx_t					FSM_MAC_TX;					// defined in FSM_NGEPON_MAC.h
-	fsm_ngepon_rs_tx_t					FSM_RS_TX;					// defined in FSM_NGEPON_RS.h
-    fsm_ngepon_25gmii_tx_t				FSM_25GMII_TX;				// defined in FSM_XGMII.h
-	fsm_ngepon_25gmii_rx_t				FSM_25GMII_RX;				// defined in FSM_XGMII.h
-	fsm_ngepon_rs_rx_t					FSM_RS_RX;					// defined in FSM_NGEPON_RS.h
-	fsm_ngepon_mac_rx_t					FSM_MAC_RX;					// defined in FSM_NGEPON_MAC.h
+    fsm_ngepon_mac_tx_t< >				FSM_MAC_TX;					// defined in FSM_NGEPON_MAC.h
+    fsm_olt_idle_deletion_t				FSM_OLT_IDLE_DELETION;		// defined in FSM_ID.h
+    fsm_64b66b_encoder_t				FSM_64B66B_ENCODER;			// defined in FSM_misc.h
+    fsm_scrambler_t						FSM_SCRAMBLER;				// defined in FSM_misc.h
+    fsm_olt_data_detector_t				FSM_OLT_DATA_DETECTOR;		// defined in FSM_DD.h
+    fsm_fec_decoder_t					FSM_FEC_DECODER;			// defined in FSM_FEC.h
+    fsm_descrambler_t					FSM_DESCRAMBLER;			// defined in FSM_misc.h
+    fsm_66b64b_decoder_t				FSM_66B64B_DECODER;			// defined in FSM_misc.h
+    fsm_idle_insertion_t				FSM_IDLE_INSERTION;			// defined in FSM_II.h
+	fsm_ngepon_mac_rx_t< >				FSM_MAC_RX;					// defined in FSM_NGEPON_MAC.h
 	fsm_ngepon_mpcp_rx_t				FSM_MPCP_RX;				// defined in FSM_NGEPON_MPCP.h
-    //fsm_onu_idle_deletion_t			FSM_ONU_IDLE_DELETION;  // defined in FSM_ID.h
-    //fsm_64b66b_encoder_t			FSM_64B66B_ENCODER;     // defined in FSM_misc.h
-    //fsm_scrambler_t					FSM_SCRAMBLER;          // defined in FSM_misc.h
-    //fsm_onu_data_detector_t			FSM_ONU_DATA_DETECTOR;  // defined in FSM_DD.h
-    //fsm_fec_decoder_t				FSM_FEC_DECODER;        // defined in FSM_FEC.h
-    //fsm_descrambler_t				FSM_DESCRAMBLER;        // defined in FSM_misc.h
-    //fsm_66b64b_decoder_t			FSM_66B64B_DECODER;     // defined in FSM_misc.h
-    //fsm_idle_insertion_t			FSM_IDLE_INSERTION;	    // defined in FSM_II.h
-    //fsm_xgmii_rx_t					FSM_XGMII_RX;           // defined in FSM_XGMII.h
-    //fsm_mac_rx_t					FSM_MAC_RX;             // defined in FSM_MAC.h
-    //fsm_mpcp_rx_t					FSM_MPCP_RX;		    // defined in FSM_MPCP.h
 
-	int32u VectorCount36b = 0;
+	int32s								frame_count;
+	int64u								units_out[ DS_STAGES ];		// units transmitted by each stage (METRICS_EXPORT)
+
+	downstream_context_t() : FSM_MAC_CLIENT(false), FSM_MPCP_TX(true)
+	{
+		frame_count = 0;
+		FOR_ALL(DS_STAGES, n)
+			units_out[n] = 0;
+	}
+};
 
+#ifdef METRICS_EXPORT
+    #define DS_COUNT(ctx, stage, units)     { (ctx).units_out[stage] += (units); }
+#else
+    #define DS_COUNT(ctx, stage, units)
+#endif
 
-    MSG_OUT1("Frame size,," << HEADER_STRING << endl);
+/////////////////////////////////////////////////////////////////////
+// void DownstreamStageMetrics(const downstream_context_t& ctx, 
+//                             vector< stage_metrics_t >& stages)
+// Counters of the downstream stages (see sim_metrics.h). A stage 
+// receives what the previous one transmitted: two MAC TX columns make 
+// a vector of Idle Deletion, an Idle Insertion vector two MAC RX 
+// columns. No downstream stage holds a unit, each one takes its input
+// on every clock, so there are no stalls.
+/////////////////////////////////////////////////////////////////////
+void DownstreamStageMetrics(const downstream_context_t& ctx, vector< stage_metrics_t >& stages)
+{
+	stages.clear();
+	FOR_ALL(DS_STAGES, n)
+	{
+		stage_metrics_t stage;
+		stage.name      = DOWNSTREAM_STAGE_NAME[n];
+		stage.units_in  = ctx.units_out[n > 0 ? n - 1 : n];		// the source counts its frames once
+		stage.units_out = ctx.units_out[n];
+		stage.stalls    = 0;
+		stage.occupancy = -1;
+		stages.push_back(stage);
+	}
+	stages[DS_IDLE_DEL].units_in /= 2;
+	stages[DS_MAC_RX].units_in   *= 2;
+
+	stages[DS_DATA_DET].occupancy    = ctx.FSM_OLT_DATA_DETECTOR.BufferedBlocks();
+	stages[DS_FEC_DECODER].occupancy = ctx.FSM_FEC_DECODER.BufferedBlocks();
+	stages[DS_IDLE_INS].occupancy    = ctx.FSM_IDLE_INSERTION.BufferedVectors();
+}
+
+/////////////////////////////////////////////////////////////////////
+// void RunDownstream(downstream_context_t& ctx, int32s frame_limit)
+// Runs the downstream path until SimulationDone(), or for exactly 
+// frame_limit frames if frame_limit > 0. Uses only the statistics 
+// of the calling thread.
+/////////////////////////////////////////////////////////////////////
+void RunDownstream(downstream_context_t& ctx, int32s frame_limit)
+{
+	int32s& frame_count = ctx.frame_count;
 
     /////////////////////////////////////////////////////////////////////
-    // data propagation through upstream path
+    // data propagation through downstream path
     /////////////////////////////////////////////////////////////////////
-    for (int32s frame_count = 0; frame_count < TEST_FRAMES;)
+    bool done = frame_limit > 0 ? frame_count >= frame_limit : SimulationDone(frame_count);
+    while (!done)
     {
-		
 		/////////////////////////////////////////////////////////////////
-		// This section operates over byte clock. A single vector out of 
-		// MAC becomes available every 4 byte clock cycles
+		// Two 36-bit columns out of MAC make up one 72-bit vector. Each
+		// column takes 4 byte clock cycles.
 		/////////////////////////////////////////////////////////////////
-		for (int16s byte_ndx = 0; byte_ndx < COLUMN_BYTES; byte_ndx++)
+		_36b_t column[2];
+
+		FOR_ALL(2, col_ndx)
 		{
-			// increase local clock refereces (1 byte resolution)
-			timestamp_t::IncrementClock();
-			FSM_MAC_CLIENT.IncrementMACClientClock();
-			FSM_MPCP_TX.IncrementByteClock();
-			
-			// transfer data from MAC Client into MPCP layer for further transmission 
-			if (FSM_MPCP_TX.ChannelReady() && FSM_MAC_CLIENT.FrameAvailable() && FSM_MAC_TX.MacReady())
+			for (int16s byte_ndx = 0; byte_ndx < COLUMN_BYTES; byte_ndx++)
 			{
-				FSM_MPCP_TX << (_frm_t)FSM_MAC_CLIENT;
-				FSM_MPCP_TX.grantStart = FSM_MAC_CLIENT.GrantStart();
-				FSM_RS_TX.CbCtrlRequest(0, 300); // @TODO@ dynamic bandwidth granting could be implemented for testing purposes
-			}
+				timestamp_t::IncrementClock();
+				ctx.FSM_MAC_CLIENT.IncrementMACClientClock();
+				ctx.FSM_MPCP_TX.IncrementByteClock();
 
-			// If frame is available at MPCP, pass it to MAC 
-			if (FSM_MPCP_TX.OutputReady())
-				FSM_MAC_TX << (_frm_t)FSM_MPCP_TX;
+				if (ctx.FSM_MPCP_TX.ChannelReady() && ctx.FSM_MAC_CLIENT.FrameAvailable() && ctx.FSM_MAC_TX.MacReady())
+				{
+					ctx.FSM_MPCP_TX << (_frm_t)ctx.FSM_MAC_CLIENT;
+					DS_COUNT(ctx, DS_MACC, 1);
+				}
 
+				if (ctx.FSM_MPCP_TX.OutputReady())
+				{
+					ctx.FSM_MAC_TX << (_frm_t)ctx.FSM_MPCP_TX;
+					DS_COUNT(ctx, DS_MPCP_TX, 1);
+				}
+			}
+			column[ col_ndx ] = (_36b_t)ctx.FSM_MAC_TX;
 		}
+		DS_COUNT(ctx, DS_MAC_TX, 2);
 
 		/////////////////////////////////////////////////////////////////
-		// The section below operates over 36-bit columns on rising and 
-		// falling edges of the 25GMII clock, moving data from MAC into
-		// RS and from RS into 25GMII 
+		// OLT PCS: Idle Deletion removes FEC_PSIZE idle vectors for 
+		// every FEC_DSIZE vectors; the Data Detector transmits a block
+		// on every vector clock, inserting parity in their place
 		/////////////////////////////////////////////////////////////////
-
-		// pass data from MAC to RS only if RS needs data 
-		if (FSM_RS_TX.IsReadyForMoreData(0))
-			FSM_RS_TX << (_36b_t)FSM_MAC_TX;
-
-		// pass data from RS into 25GMII unconditionally
-		_36b_t TempVectorDataPath1 = (_36b_t)FSM_RS_TX;
-		VectorCount36b++;
-		#ifdef DEBUG_ENABLE_DATA_PATH_1
-			std::cout << "Data path 1 column type: " << BlockName(TempVectorDataPath1.C_TYPE()) << ", sequence " << TempVectorDataPath1.GetSeqNumber() << ", nbr: " << VectorCount36b << std::endl;
-		#endif // DEBUG_ENABLE_DATA_PATH_1
-		if (VectorCount36b > 1000)
-			VectorCount36b = VectorCount36b;
-		FSM_25GMII_TX << TempVectorDataPath1;
-
-		// std::cout << "Point 0001:" << tempVector1.GetSeqNumber() << std::endl;
-
-		/////////////////////////////////////////////////////////////////
-		// The section below operates over 72-bit columns 
-		// One vector is passed on every falling edge of the clock.
-		/////////////////////////////////////////////////////////////////
-		if (FSM_25GMII_TX.OutputReady()) 
+		ctx.FSM_OLT_IDLE_DELETION << _72b_t(column[0], column[1]);
+		if (ctx.FSM_OLT_IDLE_DELETION.OutputReady())
 		{
-			FSM_25GMII_RX << (_72b_t)FSM_25GMII_TX;
+			ctx.FSM_64B66B_ENCODER << (_72b_t)ctx.FSM_OLT_IDLE_DELETION;
+			ctx.FSM_SCRAMBLER      << (_66b_t)ctx.FSM_64B66B_ENCODER;
+			ctx.FSM_OLT_DATA_DETECTOR << (_66b_t)ctx.FSM_SCRAMBLER;
+			DS_COUNT(ctx, DS_IDLE_DEL, 1);
+			DS_COUNT(ctx, DS_66B_ENCODER, 1);
+			DS_COUNT(ctx, DS_SCRAMBLER, 1);
 		}
+		ctx.FSM_FEC_DECODER << (_66b_t)ctx.FSM_OLT_DATA_DETECTOR;
+		DS_COUNT(ctx, DS_DATA_DET, 1);
 
 		/////////////////////////////////////////////////////////////////
-		// The section below operates over 36-bit columns on rising and 
-		// falling edges of the 25GMII clock
+		// ONU PCS: the FEC Decoder releases a codeword once its parity
+		// has been received; Idle Insertion transmits a vector on every
+		// vector clock, filling the gaps left by removed parity
 		/////////////////////////////////////////////////////////////////
-		FSM_MAC_RX << (_36b_t)FSM_25GMII_RX;
+		if (ctx.FSM_FEC_DECODER.OutputReady())
+		{
+			ctx.FSM_DESCRAMBLER    << (_66b_t)ctx.FSM_FEC_DECODER;
+			ctx.FSM_66B64B_DECODER << (_66b_t)ctx.FSM_DESCRAMBLER;
+			ctx.FSM_IDLE_INSERTION << (_72b_t)ctx.FSM_66B64B_DECODER;
+			DS_COUNT(ctx, DS_FEC_DECODER, 1);
+			DS_COUNT(ctx, DS_DESCRAMBLER, 1);
+			DS_COUNT(ctx, DS_66B_DECODER, 1);
+		}
+		_72b_t vector = (_72b_t)ctx.FSM_IDLE_INSERTION;
+		DS_COUNT(ctx, DS_IDLE_INS, 1);
 
-		if (FSM_MAC_RX.OutputReady()) // if a complete MAC frame available...        
+		FOR_ALL(2, col_ndx)
 		{
+			ctx.FSM_MAC_RX << vector[ col_ndx ];
+			if (!ctx.FSM_MAC_RX.OutputReady())  // if a complete MAC frame available...
+				continue;
+
 			frame_count++;
-			if (frame_count%1000 == 0)
-				std::cout << "Packet counter: " << frame_count << std::endl;
-			FSM_MPCP_RX << (_frm_t)FSM_MAC_RX;
-			CollectStats((_frm_t)FSM_MPCP_RX);
+			if (frame_count%1000 == 0 && frame_limit == 0)
+				std::cout << "Downstream packet counter: " << frame_count << std::endl;
+
+			ctx.FSM_MPCP_RX << (_frm_t)ctx.FSM_MAC_RX;
+			DS_COUNT(ctx, DS_MAC_RX, 1);
+			DS_COUNT(ctx, DS_MPCP_RX, 1);
+			CollectStats((_frm_t)ctx.FSM_MPCP_RX);
+			done = frame_limit > 0 ? frame_count >= frame_limit : SimulationDone(frame_count);
+			METRICS_POLL(DownstreamStageMetrics(ctx, MetricsStages));
 		}
 
+		// no downstream checkpoints; just stop on SIGINT/SIGTERM
+		if (checkpoint_signal != 0)
+			done = true;
     }
+    METRICS_CAPTURE(DownstreamStageMetrics(ctx, MetricsStages));
+}
 
+/////////////////////////////////////////////////////////////////////
+// void DownstreamTiming(void)
+/////////////////////////////////////////////////////////////////////
+void DownstreamTiming(void)
+{
+	downstream_context_t* context = new downstream_context_t;
+
+	USE_OUT1_DOWNSTREAM();
+	USE_BIN1_DOWNSTREAM();
+	USE_METRICS_DOWNSTREAM();
+#ifdef CHECK_UPSTREAM
+    StatsDirection = "Downstream";
+#endif
+    ResultColumns = DirectionColumns(true);
+    MSG_OUT1("Frame size,," << ResultColumns.header << endl);
+    RunDownstream(*context, 0);
     OutputStats();
+    delete context;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Stage graph (see sim_graph.h): frames leaving the last stage are 
+// counted and collected
+/////////////////////////////////////////////////////////////////////
+struct graph_sink_t
+{
+	int32s	frame_count;
+	bool	progress;
+
+	graph_sink_t(bool show_progress) : frame_count(0), progress(show_progress) {}
+
+	inline void operator()(const _frm_t& frame)
+	{
+		frame_count++;
+		if (frame_count%1000 == 0 && progress)
+			std::cout << "Packet counter: " << frame_count << std::endl;
+		CollectStats(frame);
+		METRICS_POLL();
+	}
+};
+
+/////////////////////////////////////////////////////////////////////
+// void RunGraph(stage_graph_t& graph, int32s frame_limit)
+// Runs the configured stage graph until SimulationDone(), or for 
+// exactly frame_limit frames if frame_limit > 0
+/////////////////////////////////////////////////////////////////////
+void RunGraph(stage_graph_t& graph, int32s frame_limit)
+{
+	graph_sink_t sink(frame_limit == 0);
+
+	bool done = frame_limit > 0 ? sink.frame_count >= frame_limit : SimulationDone(sink.frame_count);
+	while (!done && checkpoint_signal == 0)
+	{
+		int32s frames = sink.frame_count;
+		graph.Step(sink);
+		if (sink.frame_count != frames)
+			done = frame_limit > 0 ? sink.frame_count >= frame_limit : SimulationDone(sink.frame_count);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////
+// bool GraphTiming(void)
+// false if the stage graph cannot be scheduled
+/////////////////////////////////////////////////////////////////////
+bool GraphTiming(void)
+{
+	stage_graph_t* graph = new stage_graph_t(StageGraph);
+	if (!graph->Scheduled())
+	{
+		delete graph;
+		return false;
+	}
+
+	MSG_INFO("Stage graph: " << StageGraph.List());
+    ResultColumns = DirectionColumns(false);
+    MSG_OUT1("Frame size,," << ResultColumns.header << endl);
+    RunGraph(*graph, 0);
+
+    OutputStats();
+    delete graph;
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////
+// int RunGolden(const CHAR* file_name, int32s frames)
+// Golden-result run: fixed seed, fixed number of frames; every 
+// frame and the final per-stage histograms go into a digest
+/////////////////////////////////////////////////////////////////////
+int RunGolden(const CHAR* file_name, int32s frames)
+{
+    golden_digest_t digest;
+
+    if (frames <= 0)
+        frames = TEST_FRAMES;
+    if (!digest.Open(file_name, GOLDEN_SEED, frames, HEADER_STRING))
+    {
+        cerr << "Cannot create " << file_name << endl;
+        return 1;
+    }
+
+    ClearStats();
+    ProbePolicy.Init(1, 0);         // the digest has the delays of every frame
+    SimSrand(GOLDEN_SEED);
+    GoldenDigest = &digest;
+
+#ifdef STAGE_GRAPH
+    stage_graph_t* graph = new stage_graph_t(StageGraph);
+    if (!graph->Scheduled())
+    {
+        delete graph;
+        GoldenDigest = NULL;
+        return 1;
+    }
+    RunGraph(*graph, frames);
+    FinishWarmup();
+    delete graph;
+#else
+    upstream_context_t* context = new upstream_context_t;
+    RunUpstream(*context, frames);
+    FinishWarmup();
+    delete context;
+#endif
+
+    GoldenDigest = NULL;
+
+    vector< string > stages = GoldenFields(HEADER_STRING);
+    FOR_ALL(DELAY_ARRAY_SIZE + 1, n)
+    {
+        const delay_hist_t& hist = DelayHistogram[n];
+        digest.AddHistogramHeader(stages[n], hist.GetCount(), hist.GetMin(), hist.GetMax());
+#ifdef DELAY_QUANTILE_SKETCH
+        FOR_ALL(100, pcnt)
+            digest.AddHistogramRow(stages[n], pcnt + 1, hist.GetPercentileValue((pcnt + 1) / 100.0));
+#else
+        FOR_ALL(hist.GetBins(), bin)
+            if (hist.GetBin(bin) != 0)
+                digest.AddHistogramRow(stages[n], delay_hist_t::GetBinFloor(bin), (stat_t)hist.GetBin(bin));
+#endif
+    }
+    digest.Close();
+
+    clog << "Golden digest of " << frames << " frames written into " << file_name << endl;
+    return 0;
 }
@@ -0,0 +1,756 @@
+/**********************************************************
+ * Filename:    sim_analytic.h
+ *
+ * Description: Analytic model of the upstream path, for
+ *              parameter sweeps that take minutes per point
+ *              in the cycle-accurate simulation, run with
+ *
+ *   MPRS_upstream -analytic <results.csv> [NAME=<values> ...]
+ *
+ *              NAME is SYNC_LENGTH, TERMINATOR_LENGTH, FEC_DSIZE,
+ *              FEC_PSIZE, TAIL_GUARD or BURST_FRAMES; <values> is
+ *              a list (40,60,80) or a range (20:100:10). Other
+ *              parameters keep their values from FSM_base.h. The
+ *              CSV file has one row per combination of values.
+ *
+ *   MPRS_upstream -analytic-check [<frames>]
+ *
+ *              compares the model at the built-in parameters
+ *              with a cycle-accurate run of <frames> frames; the
+ *              exit code is non-zero if they differ by more than
+ *              ANALYTIC_TOLERANCE.
+ *
+ *              The model is exact for the traffic mix (all draws
+ *              of PacketSize() are enumerated), for the Deficit
+ *              Idle Counter (a Markov chain of idle_deficit) and
+ *              for the RS TX codeword buffer: MAC TX always has a
+ *              column for RS TX (idles between frames), so the
+ *              buffer indexes run through a fixed cycle, which is
+ *              replayed once to find the buffer delay and the
+ *              backpressure at every position of the cycle. The
+ *              approximations are that a frame starts at a random
+ *              position of that cycle and that admission within a
+ *              burst waits for MAC TX rather than for MPCP. The
+ *              wire efficiency counts the burst preamble, the
+ *              delimiter, FEC parity and the terminator, which
+ *              the upstream simulation models as a gap only. The
+ *              model covers the 25GMII path (MII_WIDTH 1).
+ *
+ *********************************************************/
+
+#ifndef _SIM_ANALYTIC_H_INCLUDED_
+#define _SIM_ANALYTIC_H_INCLUDED_
+
+#include <chrono>
+#include <vector>
+#include <map>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include "_types.h"
+
+using namespace std;
+
+const DOUBLE ANALYTIC_TOLERANCE     = 0.03;         // largest relative difference in -analytic-check
+const int32s ANALYTIC_CHECK_FRAMES  = 5 * TEST_FRAMES;
+const int32u ANALYTIC_CHECK_SEED    = 1;
+const int64s ANALYTIC_MAX_TICKS     = 1 << 22;      // longest search for the codeword cycle
+
+/////////////////////////////////////////////////////////////////////
+// RS TX codeword buffer, as in fsm_ngepon_rs_tx_t: a ring of entries
+// and the number of entries the input may run ahead of the output
+/////////////////////////////////////////////////////////////////////
+const int32s RS_TX_ENTRIES          = 8;
+const int32s RS_TX_ENTRIES_AHEAD    = 4;
+
+/////////////////////////////////////////////////////////////////////
+// Parameters of a sweep point; the defaults are the built-in values
+/////////////////////////////////////////////////////////////////////
+struct analytic_params_t
+{
+    int32s  sync_length;
+    int32s  terminator_length;
+    int32s  fec_dsize;
+    int32s  fec_psize;
+    int32s  tail_guard;
+    int32s  burst_frames;
+
+    analytic_params_t()
+    {
+        sync_length       = SYNC_LENGTH;
+        terminator_length = TERMINATOR_LENGTH;
+        fec_dsize         = FEC_DSIZE;
+        fec_psize         = FEC_PSIZE;
+        tail_guard        = TAIL_GUARD;
+        burst_frames      = BURST_FRAMES;
+    }
+
+    /////////////////////////////////////////////////////////////////
+    // derived as in FSM_base.h
+    /////////////////////////////////////////////////////////////////
+    inline int32s PayloadColumns( void ) const  { return 2 * this->fec_dsize; }                 // PAYLOAD_SIZE
+    inline int32s ParityColumns( void )  const  { return 2 * this->fec_psize; }                 // PARITY_SIZE
+    inline int32s CodewordBytes( void )  const  { return ( this->fec_dsize + this->fec_psize ) * VECTOR_BYTES; }
+    inline int32s DelayBound( void )     const  { return this->sync_length + 5; }
+    inline int32s BurstGapBytes( void )  const  { return this->CodewordBytes() + 2 * this->DelayBound() * VECTOR_BYTES; }
+};
+
+/////////////////////////////////////////////////////////////////////
+// Names of the swept parameters and their smallest values
+/////////////////////////////////////////////////////////////////////
+struct analytic_param_name_t
+{
+    const CHAR*                 name;
+    int32s analytic_params_t::* field;
+    int32s                      min_value;
+    int32s                      max_value;
+};
+
+const analytic_param_name_t ANALYTIC_PARAM_NAMES[] =
+{
+    { "SYNC_LENGTH",        &analytic_params_t::sync_length,        0, 100000 },
+    { "TERMINATOR_LENGTH",  &analytic_params_t::terminator_length,  0, 100000 },
+    { "FEC_DSIZE",          &analytic_params_t::fec_dsize,          1, 127    },   // payload slot index is 8 bits
+    { "FEC_PSIZE",          &analytic_params_t::fec_psize,          1, 127    },
+    { "TAIL_GUARD",         &analytic_params_t::tail_guard,         0, 100000 },
+    { "BURST_FRAMES",       &analytic_params_t::burst_frames,       1, 100000 },
+};
+const int32s ANALYTIC_PARAMS = sizeof( ANALYTIC_PARAM_NAMES ) / sizeof( ANALYTIC_PARAM_NAMES[0] );
+
+/////////////////////////////////////////////////////////////////////
+// Results of a sweep point; delays in byte times, for the frames
+// that the simulation collects statistics for
+/////////////////////////////////////////////////////////////////////
+struct analytic_result_t
+{
+    DOUBLE  throughput;         // delivered frame bytes per byte time, as in OutputStats()
+    DOUBLE  efficiency;         // delivered frame bytes per byte of a burst on the wire
+    DOUBLE  mean_delay;
+    int32s  p50_delay;
+    int32s  p99_delay;
+    int32s  max_delay;
+    DOUBLE  mac_tx_delay;       // means of the stages that vary
+    DOUBLE  rs_tx_delay;
+    DOUBLE  mac_rx_delay;
+    int32s  cycle_codewords;    // length of the RS TX buffer cycle
+};
+
+/////////////////////////////////////////////////////////////////////
+// One cycle of the RS TX codeword buffer with MAC TX always sending.
+// For every column tick of the cycle: whether RS TX took a column
+// from MAC TX and, if so, the payload slot it went into and the
+// column ticks until it was transmitted.
+/////////////////////////////////////////////////////////////////////
+struct rs_tx_cycle_t
+{
+    vector< int32s >    accepted;       // ticks of the cycle at which a column is taken
+    vector< int32s >    slot;           // per accepted tick
+    vector< int32s >    delay;          // per accepted tick
+    int32s              ticks;
+    int32s              codewords;
+
+    /////////////////////////////////////////////////////////////////
+    // tick of the n-th accepted tick after the accepted tick ndx,
+    // counted from the start of the cycle containing ndx
+    /////////////////////////////////////////////////////////////////
+    inline int64s TickAfter( int32s ndx, int32s n ) const
+    {
+        int32s size = (int32s)this->accepted.size();
+        return this->accepted[ ( ndx + n ) % size ] + (int64s)this->ticks * (( ndx + n ) / size );
+    }
+};
+
+/////////////////////////////////////////////////////////////////////
+// The analytic model. The traffic mix and the Deficit Idle Counter
+// do not depend on the swept parameters and are computed once.
+/////////////////////////////////////////////////////////////////////
+class analytic_model_t
+{
+    private:
+
+        vector< DOUBLE >    packet_pmf;         // by packet size (without preamble)
+        vector< DOUBLE >    sparse_pmf;         // extra gap before a frame (SPARSE_TRAFFIC)
+        vector< DOUBLE >    ipg_columns;        // per packet size: mean IPG columns after it
+        vector< DOUBLE >    ipg_pmf;            // IPG columns after any frame
+
+        /////////////////////////////////////////////////////////////
+        // All draws of PacketSize()
+        /////////////////////////////////////////////////////////////
+        void BuildPacketMix( void )
+        {
+            const DOUBLE draws = SIM_RAND_MAX + 1.0;
+            DOUBLE min_share = 0;
+
+            this->packet_pmf.assign( MAX_PACKET_BYTES + 1, 0.0 );
+            for( int32s draw = 0; draw <= SIM_RAND_MAX; draw++ )
+                if( IsMinPacketDraw( draw ))
+                    min_share += 1 / draws;
+
+            this->packet_pmf[ MIN_PACKET_BYTES ] += min_share;
+            for( int32s draw = 0; draw <= SIM_RAND_MAX; draw++ )
+                this->packet_pmf[ PacketSizeOfDraw( draw ) ] += ( 1 - min_share ) / draws;
+
+            /////////////////////////////////////////////////////////
+            // sparse traffic delays every frame by a random part
+            // of a codeword (see fsm_ngepon_macc_t::FrameAvailable)
+            /////////////////////////////////////////////////////////
+            this->sparse_pmf.assign( 1, 1.0 );
+#ifdef SPARSE_TRAFFIC
+            this->sparse_pmf.assign( FEC_CODEWORD_BYTES + 1, 0.0 );
+            for( int32s draw = 0; draw <= SIM_RAND_MAX; draw++ )
+                this->sparse_pmf[ (int16s)(( draw * FEC_CODEWORD_BYTES ) / SIM_RAND_MAX ) ] += 1 / draws;
+#endif
+        }
+
+        /////////////////////////////////////////////////////////////
+        // Deficit Idle Counter: idle_deficit after a frame depends
+        // only on its value before and the frame size, so it is a
+        // Markov chain over 0..3 (see CalculateIPGBytes())
+        /////////////////////////////////////////////////////////////
+        static inline int32s NextDeficit( int32s frame_bytes, int32s deficit )
+        {
+            return ( frame_bytes + deficit ) & 0x03;
+        }
+
+        static inline int32s IpgColumns( int32s frame_bytes, int32s deficit )
+        {
+            return ( MIN_IPG_BYTES + deficit - NextDeficit( frame_bytes, deficit )) / COLUMN_BYTES;
+        }
+
+        void BuildIdleDeficit( void )
+        {
+            DOUBLE deficit_pmf[ COLUMN_BYTES ] = { 1.0 };
+
+            for( int32s iteration = 0; iteration < 1000; iteration++ )
+            {
+                DOUBLE next[ COLUMN_BYTES ] = { 0 };
+                FOR_ALL( COLUMN_BYTES, d )
+                    for( int32s size = MIN_PACKET_BYTES; size <= MAX_PACKET_BYTES; size++ )
+                        next[ NextDeficit( size + PREAMBLE_BYTES, d ) ] += deficit_pmf[ d ] * this->packet_pmf[ size ];
+
+                DOUBLE change = 0;
+                FOR_ALL( COLUMN_BYTES, d )
+                {
+                    change += fabs( next[ d ] - deficit_pmf[ d ] );
+                    deficit_pmf[ d ] = next[ d ];
+                }
+                if( change < 1e-15 )
+                    break;
+            }
+
+            this->ipg_columns.assign( MAX_PACKET_BYTES + 1, 0.0 );
+            this->ipg_pmf.assign( MIN_IPG_BYTES / COLUMN_BYTES + 2, 0.0 );
+            for( int32s size = MIN_PACKET_BYTES; size <= MAX_PACKET_BYTES; size++ )
+                FOR_ALL( COLUMN_BYTES, d )
+                {
+                    int32s columns = IpgColumns( size + PREAMBLE_BYTES, d );
+                    this->ipg_columns[ size ]  += deficit_pmf[ d ] * columns;
+                    this->ipg_pmf[ columns ]   += deficit_pmf[ d ] * this->packet_pmf[ size ];
+                }
+        }
+
+        static inline int32s DataColumns( int32s size )
+        {
+            return BLK_ROUNDUP( size + PREAMBLE_BYTES, COLUMN_BYTES );
+        }
+
+        /////////////////////////////////////////////////////////////
+        // Replays the index arithmetic of fsm_ngepon_rs_tx_t (input
+        // before output at every tick) from the start of a run until
+        // its state at the start of a codeword repeats; the output
+        // starts with the first frame, after the initial burst gap
+        /////////////////////////////////////////////////////////////
+        static bool BuildCodewordCycle( const analytic_params_t& prm, rs_tx_cycle_t& cycle )
+        {
+            const int32s payload = prm.PayloadColumns();
+            const int32s parity  = prm.ParityColumns();
+            const int64s start   = BLK_ROUNDUP( prm.BurstGapBytes(), COLUMN_BYTES );
+
+            int32s  write_entry = 0, read_entry = 0, entry = 0;
+            int32s  word_write  = 0, word_read  = 0;
+            bool    receiving   = false, in_payload = false, in_parity = false;
+
+            vector< int64s >    written( RS_TX_ENTRIES * payload, -1 );   // tick of the unsent column in a slot
+            vector< int32s >    slot_of;        // per tick, -1 if no column was taken
+            vector< int64s >    sent_at;        // per tick
+            map< int64s, int64s > seen;         // state at the start of a codeword -> tick
+            int64s  cycle_start = -1, cycle_end = -1;
+
+            for( int64s tick = 0; tick < ANALYTIC_MAX_TICKS; tick++ )
+            {
+                slot_of.push_back( -1 );
+                sent_at.push_back( -1 );
+
+                /////////////////////////////////////////////////////
+                // input: IsReadyForMoreData() and ReceiveColumn()
+                /////////////////////////////////////////////////////
+                if( write_entry - read_entry < RS_TX_ENTRIES_AHEAD )
+                {
+                    if( !receiving )
+                    {
+                        write_entry = ( write_entry + 1 ) % RS_TX_ENTRIES;
+                        word_write  = 1;
+                        receiving   = true;
+                    }
+                    written[ write_entry * payload + word_write ] = tick;
+                    slot_of[ tick ] = word_write++;
+                    receiving = word_write < payload;
+                }
+
+                /////////////////////////////////////////////////////
+                // output: TransmitColumn(), never short of codewords
+                /////////////////////////////////////////////////////
+                if( tick < start )
+                    continue;
+
+                if( !in_payload && !in_parity )
+                {
+                    if( cycle_end >= 0 && tick >= cycle_end + ( cycle_end - cycle_start ) + ( RS_TX_ENTRIES + 2 ) * ( payload + parity ))
+                        break;
+
+                    if( cycle_start < 0 )
+                    {
+                        int64s state = (( write_entry * RS_TX_ENTRIES + read_entry ) * 256 + word_write ) * 2 + receiving;
+                        map< int64s, int64s >::iterator found = seen.find( state );
+                        if( found != seen.end() )
+                        {
+                            cycle_start = found->second;
+                            cycle_end   = tick;
+                        }
+                        else
+                            seen[ state ] = tick;
+                    }
+
+                    entry      = read_entry;
+                    read_entry = ( read_entry + 1 ) % RS_TX_ENTRIES;
+                    word_read  = 0;
+                    in_payload = true;
+                }
+
+                if( in_payload )
+                {
+                    int64s& column = written[ entry * payload + word_read ];
+                    if( column >= 0 )
+                    {
+                        sent_at[ column ] = tick;
+                        column = -1;
+                    }
+                    if( ++word_read >= payload )
+                    {
+                        in_payload = false;
+                        in_parity  = true;
+                        word_read  = 0;
+                    }
+                }
+                else if( ++word_read >= parity )
+                    in_parity = false;
+            }
+
+            if( cycle_end < 0 )
+                return false;
+
+            /////////////////////////////////////////////////////////
+            // the cycle that follows the first repetition; all its
+            // columns have been sent by now
+            /////////////////////////////////////////////////////////
+            cycle.ticks     = (int32s)( cycle_end - cycle_start );
+            cycle.accepted.clear();
+            cycle.slot.clear();
+            cycle.delay.clear();
+
+            int64s first = cycle_end, last = cycle_end + cycle.ticks;
+            for( int64s tick = first; tick < last; tick++ )
+            {
+                if( slot_of[ tick ] < 0 )
+                    continue;
+                if( sent_at[ tick ] < 0 )
+                    return false;           // overwritten before it was sent
+                cycle.accepted.push_back( (int32s)( tick - first ));
+                cycle.slot.push_back( slot_of[ tick ] );
+                cycle.delay.push_back( (int32s)( sent_at[ tick ] - tick ));
+            }
+            cycle.codewords = cycle.ticks / ( payload + parity );
+            return !cycle.accepted.empty();
+        }
+
+        DOUBLE MeanIpgColumns( void ) const
+        {
+            DOUBLE ipg = 0;
+            FOR_ALL( (int32s)this->ipg_pmf.size(), n )
+                ipg += n * this->ipg_pmf[ n ];
+            return ipg;
+        }
+
+    public:
+
+        analytic_model_t()
+        {
+            this->BuildPacketMix();
+            this->BuildIdleDeficit();
+        }
+
+        /////////////////////////////////////////////////////////////
+        // Frame-level timing for the hybrid simulation: byte times
+        // per column that MAC TX gets through RS TX and mean IPG
+        // columns; false if the parameters are outside the model
+        /////////////////////////////////////////////////////////////
+        bool FrameTiming( const analytic_params_t& prm, DOUBLE& column_time, DOUBLE& ipg_columns ) const
+        {
+            rs_tx_cycle_t cycle;
+            if( !BuildCodewordCycle( prm, cycle ))
+                return false;
+
+            column_time = (DOUBLE)COLUMN_BYTES * cycle.ticks / cycle.accepted.size();
+            ipg_columns = this->MeanIpgColumns();
+            return true;
+        }
+
+        /////////////////////////////////////////////////////////////
+        // false if the parameters are outside the model
+        /////////////////////////////////////////////////////////////
+        bool Evaluate( const analytic_params_t& prm, analytic_result_t& res ) const
+        {
+            rs_tx_cycle_t cycle;
+            if( !BuildCodewordCycle( prm, cycle ))
+                return false;
+
+            const int32s payload  = prm.PayloadColumns();
+            const int32s parity   = prm.ParityColumns();
+            const int32s accepted = (int32s)cycle.accepted.size();
+            const DOUBLE col_time = (DOUBLE)COLUMN_BYTES * cycle.ticks / accepted;     // byte times per MAC TX column
+            const DOUBLE first    = 1.0 / prm.burst_frames;                             // share of first frames of a burst
+
+            /////////////////////////////////////////////////////////
+            // Delay up to the RS TX output, joint with the payload
+            // slot of the /S/ column. A frame that follows another
+            // one is admitted right after the T column of the
+            // previous frame and starts after its IPG; the first
+            // frame of a burst is admitted at any byte time and
+            // latched by MAC TX at its next column.
+            /////////////////////////////////////////////////////////
+            map< pair< int32s, int32s >, DOUBLE > head;     // (MAC TX + RS TX delay, slot) -> probability
+            DOUBLE mac_tx = 0, rs_tx = 0;
+
+            if( prm.burst_frames > 1 )
+                FOR_ALL( accepted, ndx )
+                    FOR_ALL( (int32s)this->ipg_pmf.size(), ipg )
+                    {
+                        if( this->ipg_pmf[ ipg ] == 0 )
+                            continue;
+                        DOUBLE weight = ( 1 - first ) * this->ipg_pmf[ ipg ] / accepted;
+                        int32s start  = ( ndx + ipg + 1 ) % accepted;
+                        int32s wait   = (int32s)( COLUMN_BYTES * ( cycle.TickAfter( ndx, ipg + 1 ) - cycle.accepted[ ndx ] )) - 1;
+                        int32s buffer = COLUMN_BYTES * cycle.delay[ start ];
+
+                        head[ make_pair( wait + buffer, cycle.slot[ start ] ) ] += weight;
+                        mac_tx += weight * wait;
+                        rs_tx  += weight * buffer;
+                    }
+
+            int32s ndx = 0;
+            FOR_ALL( COLUMN_BYTES * cycle.ticks, byte )
+            {
+                while( ndx < accepted && COLUMN_BYTES * cycle.accepted[ ndx ] < byte )
+                    ndx++;
+
+                int32s latch  = ndx % accepted;                     // past the last column: first of the next cycle
+                int64s base   = (int64s)( ndx / accepted ) * cycle.ticks;
+                DOUBLE weight = first / ( COLUMN_BYTES * cycle.ticks );
+                int32s start  = ( latch + 1 ) % accepted;
+                int32s wait   = (int32s)( COLUMN_BYTES * ( cycle.TickAfter( latch, 1 ) + base )) - byte;
+                int32s buffer = COLUMN_BYTES * cycle.delay[ start ];
+
+                head[ make_pair( wait + buffer, cycle.slot[ start ] ) ] += weight;
+                mac_tx += weight * wait;
+                rs_tx  += weight * buffer;
+            }
+
+            /////////////////////////////////////////////////////////
+            // MAC RX holds a frame until the column after its T
+            // column; every codeword boundary in between adds the
+            // parity placeholders and the codeword header
+            /////////////////////////////////////////////////////////
+            map< int32s, DOUBLE > frame_columns;
+            for( int32s size = MIN_PACKET_BYTES; size <= MAX_PACKET_BYTES; size++ )
+            {
+#ifdef SHOW_64B_PACKETS_ONLY
+                if( size != MPCP_PACKET_BYTES )
+                    continue;
+                frame_columns[ DataColumns( size ) ] = 1.0;
+#else
+                if( this->packet_pmf[ size ] > 0 )
+                    frame_columns[ DataColumns( size ) ] += this->packet_pmf[ size ];
+#endif
+            }
+
+            vector< DOUBLE > total;
+            DOUBLE mac_rx = 0;
+            for( map< pair< int32s, int32s >, DOUBLE >::const_iterator h = head.begin(); h != head.end(); ++h )
+                for( map< int32s, DOUBLE >::const_iterator f = frame_columns.begin(); f != frame_columns.end(); ++f )
+                {
+                    int32s slot     = h->first.second;
+                    int32s columns  = f->first;
+                    int32s crossed  = ( slot - 1 + columns ) / ( payload - 1 );
+                    int32s rx       = COLUMN_BYTES * ( columns + crossed * ( parity + 1 ));
+                    int32s delay    = h->first.first + COLUMN_BYTES + rx;      // 25GMII pairs two columns
+                    DOUBLE weight   = h->second * f->second;
+
+                    if( delay >= (int32s)total.size() )
+                        total.resize( delay + 1, 0.0 );
+                    total[ delay ] += weight;
+                    mac_rx += weight * rx;
+                }
+
+            DOUBLE sum = 0, mean = 0;
+            res.p50_delay = res.p99_delay = res.max_delay = 0;
+            FOR_ALL( (int32s)total.size(), delay )
+            {
+                if( total[ delay ] == 0 )
+                    continue;
+                if( sum < 0.5 && sum + total[ delay ] >= 0.5 )
+                    res.p50_delay = delay;
+                if( sum < 0.99 && sum + total[ delay ] >= 0.99 )
+                    res.p99_delay = delay;
+                sum  += total[ delay ];
+                mean += total[ delay ] * delay;
+                res.max_delay = delay;
+            }
+            res.mean_delay      = mean / sum;
+            res.mac_tx_delay    = mac_tx;
+            res.rs_tx_delay     = rs_tx;
+            res.mac_rx_delay    = mac_rx;
+            res.cycle_codewords = cycle.codewords;
+
+            /////////////////////////////////////////////////////////
+            // Throughput: within a burst, frames are admitted as fast
+            // as MAC TX gets its columns through RS TX, or as MPCP
+            // lets them (frame + tail guard); the last frame of a
+            // burst is followed by the burst gap
+            /////////////////////////////////////////////////////////
+            DOUBLE ipg = this->MeanIpgColumns();
+
+            DOUBLE interval = 0, last = 0, frame_bytes = 0, wire_bytes = 0;
+            for( int32s size = MIN_PACKET_BYTES; size <= MAX_PACKET_BYTES; size++ )
+            {
+                DOUBLE p = this->packet_pmf[ size ];
+                if( p == 0 )
+                    continue;
+
+                DOUBLE mac_time = col_time * ( DataColumns( size ) + ipg );
+                int32s mpcp     = size - E_HEADER_BYTES - CHECKSUM_BYTES + prm.tail_guard;
+                FOR_ALL( (int32s)this->sparse_pmf.size(), extra )
+                {
+                    interval += p * this->sparse_pmf[ extra ] * MAX( mac_time, (DOUBLE)( mpcp + extra ));
+                    last     += p * this->sparse_pmf[ extra ] * ( mpcp + extra );
+                }
+                frame_bytes += p * COLUMN_BYTES * DataColumns( size );
+                wire_bytes  += p * COLUMN_BYTES * ( DataColumns( size ) + this->ipg_columns[ size ] );
+            }
+
+            DOUBLE burst = ( prm.burst_frames - 1 ) * interval + last + prm.BurstGapBytes();
+            res.throughput = prm.burst_frames * frame_bytes / burst;
+
+            /////////////////////////////////////////////////////////
+            // A burst on the wire: preamble (sync pattern), burst
+            // delimiter, two protected idles, the frames and more
+            // than DELAY_BOUND idles, in whole FEC codewords, then
+            // the terminator (see fsm_onu_data_detector_t)
+            /////////////////////////////////////////////////////////
+            DOUBLE vectors   = 2 + prm.burst_frames * wire_bytes / VECTOR_BYTES + prm.DelayBound() + 1;
+            DOUBLE codewords = vectors / prm.fec_dsize + ( prm.fec_dsize - 1.0 ) / ( 2.0 * prm.fec_dsize );
+            DOUBLE on_wire   = ( prm.sync_length + 1 + prm.terminator_length ) * VECTOR_BYTES + codewords * prm.CodewordBytes();
+            res.efficiency = prm.burst_frames * frame_bytes / on_wire;
+            return true;
+        }
+};
+
+/////////////////////////////////////////////////////////////////////
+// NAME=<values> of a sweep: a list (a,b,c) or a range (from:to:step)
+/////////////////////////////////////////////////////////////////////
+bool ParseAnalyticSweep( const CHAR* arg, int32s& param, vector< int32s >& values )
+{
+    const CHAR* eq = strchr( arg, '=' );
+    if( eq == NULL )
+        return false;
+
+    param = -1;
+    FOR_ALL( ANALYTIC_PARAMS, n )
+        if( strlen( ANALYTIC_PARAM_NAMES[n].name ) == (size_t)( eq - arg ) && strncmp( arg, ANALYTIC_PARAM_NAMES[n].name, eq - arg ) == 0 )
+            param = n;
+    if( param < 0 )
+        return false;
+
+    const analytic_param_name_t& name = ANALYTIC_PARAM_NAMES[ param ];
+    int from, to, step;             // for sscanf
+    values.clear();
+
+    if( sscanf( eq + 1, "%d:%d:%d", &from, &to, &step ) == 3 )
+    {
+        if( step <= 0 || to < from )
+            return false;
+        for( int32s value = from; value <= to; value += step )
+            values.push_back( value );
+    }
+    else
+    {
+        for( const CHAR* s = eq + 1; *s != '\0'; )
+        {
+            CHAR* end;
+            values.push_back( (int32s)strtol( s, &end, 10 ));
+            if( end == s || ( *end != ',' && *end != '\0' ))
+                return false;
+            s = *end == ',' ? end + 1 : end;
+        }
+    }
+
+    FOR_ALL( (int32s)values.size(), n )
+        if( values[n] < name.min_value || values[n] > name.max_value )
+            return false;
+    return !values.empty();
+}
+
+/////////////////////////////////////////////////////////////////////
+// Sweep over all combinations of the given values; returns the exit
+// code of the program
+/////////////////////////////////////////////////////////////////////
+int RunAnalytic( const CHAR* result_file, int argc, char* argv[] )
+{
+    typedef chrono::steady_clock analytic_clock_t;
+
+    vector< int32s >            params;
+    vector< vector< int32s > >  values;
+
+    for( int32s arg = 0; arg < argc; arg++ )
+    {
+        int32s              param;
+        vector< int32s >    list;
+        if( !ParseAnalyticSweep( argv[ arg ], param, list ))
+        {
+            cerr << "Invalid sweep " << argv[ arg ] << endl;
+            return 1;
+        }
+        params.push_back( param );
+        values.push_back( list );
+    }
+
+    ofstream csv( result_file );
+    if( !csv.is_open() )
+    {
+        cerr << "Cannot create " << result_file << endl;
+        return 1;
+    }
+
+    FOR_ALL( ANALYTIC_PARAMS, n )
+        csv << ANALYTIC_PARAM_NAMES[n].name << ",";
+    csv << "throughput,efficiency,mean_delay,p50_delay,p99_delay,max_delay,mac_tx_delay,rs_tx_delay,mac_rx_delay,cycle_codewords" << endl;
+
+    analytic_clock_t::time_point t0 = analytic_clock_t::now();
+    analytic_model_t model;
+    vector< int32s > index( params.size(), 0 );
+    int32s points = 0, failed = 0;
+
+    for( ;; )
+    {
+        analytic_params_t prm;
+        FOR_ALL( (int32s)params.size(), n )
+            prm.*( ANALYTIC_PARAM_NAMES[ params[n] ].field ) = values[n][ index[n] ];
+
+        FOR_ALL( ANALYTIC_PARAMS, n )
+            csv << prm.*( ANALYTIC_PARAM_NAMES[n].field ) << ",";
+
+        analytic_result_t res;
+        if( model.Evaluate( prm, res ))
+            csv << res.throughput << "," << res.efficiency << "," << res.mean_delay << "," << res.p50_delay << "," << res.p99_delay << ","
+                << res.max_delay << "," << res.mac_tx_delay << "," << res.rs_tx_delay << "," << res.mac_rx_delay << "," << res.cycle_codewords << endl;
+        else
+        {
+            csv << ",,,,,,,,," << endl;
+            failed++;
+        }
+        points++;
+
+        /////////////////////////////////////////////////////////////
+        // next combination; the last parameter changes fastest
+        /////////////////////////////////////////////////////////////
+        int32s n = (int32s)params.size() - 1;
+        for( ; n >= 0; n-- )
+        {
+            if( ++index[n] < (int32s)values[n].size() )
+                break;
+            index[n] = 0;
+        }
+        if( n < 0 )
+            break;
+    }
+    csv.close();
+
+    DOUBLE ms = chrono::duration< DOUBLE, milli >( analytic_clock_t::now() - t0 ).count();
+    cout << "Analytic model: " << points << " points in " << ms << " ms";
+    if( failed > 0 )
+        cout << ", " << failed << " outside the model (RS TX buffer overrun)";
+    cout << endl;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Model against a cycle-accurate run at the built-in parameters;
+// returns the exit code of the program
+/////////////////////////////////////////////////////////////////////
+int RunAnalyticCheck( int32s frames )
+{
+    if( MII_WIDTH != 1 )
+    {
+        cerr << "The analytic model covers MII_WIDTH 1 only" << endl;
+        return 1;
+    }
+    if( frames <= 0 )
+        frames = ANALYTIC_CHECK_FRAMES;
+
+    analytic_model_t  model;
+    analytic_result_t res;
+    if( !model.Evaluate( analytic_params_t(), res ))
+    {
+        cerr << "The built-in parameters are outside the analytic model" << endl;
+        return 1;
+    }
+
+    ClearStats();
+    SimSrand( ANALYTIC_CHECK_SEED );
+    upstream_context_t* ctx = new upstream_context_t;
+    RunUpstream( *ctx, frames );
+    FinishWarmup();
+    delete ctx;
+
+    const delay_hist_t& hist = DelayHistogram[ DELAY_ARRAY_SIZE ];
+    struct
+    {
+        const CHAR* name;
+        DOUBLE      model;
+        DOUBLE      simulation;
+        bool        checked;
+    } rows[] =
+    {
+        { "Throughput",     res.throughput,         (DOUBLE)frame_bytes / timestamp_t::GetClock(),          true  },
+        { "Mean delay",     res.mean_delay,         hist.GetAvg(),                                          true  },
+        { "p50 delay",      (DOUBLE)res.p50_delay,  hist.GetPercentileValue( 0.5 ),                         true  },
+        { "p99 delay",      (DOUBLE)res.p99_delay,  hist.GetPercentileValue( 0.99 ),                        true  },
+        { "Max delay",      (DOUBLE)res.max_delay,  hist.GetMax(),                                          false },
+        { "MAC_TX delay",   res.mac_tx_delay,       DelayHistogram[ DLY_NGEPON_MAC_TX ].GetAvg(),           false },
+        { "RS_TX delay",    res.rs_tx_delay,        DelayHistogram[ DLY_NGEPON_RS_TX ].GetAvg(),            false },
+        { "MAC_RX delay",   res.mac_rx_delay,       DelayHistogram[ DLY_NGEPON_MAC_RX ].GetAvg(),           false },
+    };
+
+    int32s failed = 0;
+    cout << "Analytic model against " << frames << " simulated frames:" << endl;
+    for( size_t n = 0; n < sizeof( rows ) / sizeof( rows[0] ); n++ )
+    {
+        DOUBLE diff = rows[n].simulation != 0 ? ( rows[n].model - rows[n].simulation ) / rows[n].simulation : 0;
+        bool   bad  = rows[n].checked && fabs( diff ) > ANALYTIC_TOLERANCE;
+        failed += bad;
+        cout << "  " << rows[n].name << ": model " << rows[n].model << ", simulation " << rows[n].simulation
+             << " (" << 100 * diff << "%)" << ( bad ? " FAILED" : "" ) << endl;
+    }
+    return failed > 0 ? 1 : 0;
+}
+
+#endif // _SIM_ANALYTIC_H_INCLUDED_
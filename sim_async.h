@@ -0,0 +1,296 @@
+/**********************************************************
+ * Filename:    sim_async.h
+ *
+ * Description: Asynchronous back end for the output streams
+ *              of sim_output.h. Simulation threads format a
+ *              message and push it into a lock-free ring;
+ *              a dedicated writer thread drains the ring in
+ *              batches and flushes the streams only when the
+ *              ring runs empty. Only complete lines enter the
+ *              ring, so lines of several threads never mix.
+ *              The writer sleeps on a condition variable while
+ *              the ring is empty and is started by the first
+ *              stream opened or message pushed.
+ *
+ *********************************************************/
+
+#ifndef _SIM_ASYNC_H_INCLUDED_
+#define _SIM_ASYNC_H_INCLUDED_
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <sstream>
+#include <ostream>
+#include "_types.h"
+
+using namespace std;
+
+const size_t ASYNC_RING_SIZE = 1 << 16;   // number of records; must be a power of 2
+const int32s ASYNC_MAX_STREAMS = 8;       // distinct streams flushed by the writer
+
+class async_log_t
+{
+    private:
+        /////////////////////////////////////////////////////////////
+        // A slot in the ring. seq == position when the slot is free
+        // for the producer, seq == position + 1 when it holds a record
+        /////////////////////////////////////////////////////////////
+        struct record_t
+        {
+            atomic< size_t >    seq;
+            ostream*            target;
+            string              text;
+        };
+
+        /////////////////////////////////////////////////////////////
+        // Text of a thread for a stream after its last newline
+        /////////////////////////////////////////////////////////////
+        struct partial_t
+        {
+            ostream*            target;
+            string              text;
+        };
+
+        record_t*           ring;
+        atomic< size_t >    head;           // next position to be claimed by a producer
+        size_t              tail;           // next position to be written (writer thread only)
+        atomic< size_t >    flushed;        // all records below this position are on disk
+        atomic< bool >      running;
+        atomic< bool >      waiting;        // writer is about to sleep or sleeping
+        once_flag           started;
+        mutex               lock;           // guards the sleeps of the writer and of Drain()
+        condition_variable  wake;           // a record was pushed or the log is closing
+        condition_variable  drained;        // the writer flushed and ran out of records
+        thread              writer;
+
+        /////////////////////////////////////////////////////////////
+        // Records ready for the writer; with seq_cst, a producer
+        // either sees waiting set or its record is seen here
+        /////////////////////////////////////////////////////////////
+        inline bool Pending( void ) const
+        {
+            return this->ring[ this->tail & ( ASYNC_RING_SIZE - 1 ) ].seq.load() == this->tail + 1;
+        }
+
+        static inline partial_t* Partials( void )
+        {
+            static thread_local partial_t partials[ ASYNC_MAX_STREAMS ];
+            return partials;
+        }
+
+        /////////////////////////////////////////////////////////////
+        // Writer thread: write records in batches, flush when idle
+        /////////////////////////////////////////////////////////////
+        void WriterLoop( void )
+        {
+            ostream* touched[ ASYNC_MAX_STREAMS ];
+            int32s   touched_cnt = 0;
+
+            for( ;; )
+            {
+                record_t* rec = &this->ring[ this->tail & ( ASYNC_RING_SIZE - 1 ) ];
+
+                if( rec->seq.load( memory_order_acquire ) == this->tail + 1 )
+                {
+                    rec->target->write( rec->text.data(), rec->text.size() );
+
+                    bool known = false;
+                    FOR_ALL( touched_cnt, n )
+                        known = known || touched[n] == rec->target;
+                    if( !known && touched_cnt < ASYNC_MAX_STREAMS )
+                        touched[ touched_cnt++ ] = rec->target;
+                    else if( !known )
+                        rec->target->flush();
+
+                    rec->text.clear();
+                    rec->seq.store( this->tail + ASYNC_RING_SIZE, memory_order_release );
+                    this->tail++;
+                    continue;
+                }
+
+                /////////////////////////////////////////////////////////
+                // Ring is empty: flush everything written so far and
+                // sleep until the next record
+                /////////////////////////////////////////////////////////
+                FOR_ALL( touched_cnt, n )
+                    touched[n]->flush();
+                touched_cnt = 0;
+
+                unique_lock< mutex > guard( this->lock );
+                this->flushed.store( this->tail, memory_order_release );
+                this->drained.notify_all();
+
+                if( !this->running.load( memory_order_acquire ) &&
+                    this->head.load( memory_order_acquire ) == this->tail )
+                    return;
+
+                this->waiting.store( true );
+                this->wake.wait( guard, [this] { return Pending() || !this->running.load(); } );
+                this->waiting.store( false );
+            }
+        }
+
+        /////////////////////////////////////////////////////////////
+        // Place one record of complete lines into the ring
+        /////////////////////////////////////////////////////////////
+        void PushLines( ostream& target, const string& text )
+        {
+            Start();
+
+            size_t pos = this->head.load( memory_order_relaxed );
+            record_t* rec;
+
+            for( ;; )
+            {
+                rec = &this->ring[ pos & ( ASYNC_RING_SIZE - 1 ) ];
+                size_t seq = rec->seq.load( memory_order_acquire );
+
+                if( seq == pos )
+                {
+                    if( this->head.compare_exchange_weak( pos, pos + 1, memory_order_relaxed ))
+                        break;
+                }
+                else if( seq < pos )            // ring full
+                {
+                    this_thread::yield();
+                    pos = this->head.load( memory_order_relaxed );
+                }
+                else                            // another producer took the slot
+                    pos = this->head.load( memory_order_relaxed );
+            }
+
+            rec->target = &target;
+            rec->text.assign( text );
+            rec->seq.store( pos + 1 );
+
+            if( this->waiting.load() )
+            {
+                lock_guard< mutex > guard( this->lock );
+                this->wake.notify_one();
+            }
+        }
+
+    public:
+        async_log_t()
+        {
+            this->ring = new record_t[ ASYNC_RING_SIZE ];
+            for( size_t i = 0; i < ASYNC_RING_SIZE; i++ )
+                this->ring[i].seq.store( i, memory_order_relaxed );
+
+            this->head.store( 0 );
+            this->tail = 0;
+            this->flushed.store( 0 );
+            this->running.store( true );
+            this->waiting.store( false );
+        }
+
+        ~async_log_t()
+        {
+            {
+                lock_guard< mutex > guard( this->lock );
+                this->running.store( false, memory_order_release );
+                this->wake.notify_one();
+            }
+            if( this->writer.joinable() )
+                this->writer.join();
+            delete [] this->ring;
+        }
+
+        /////////////////////////////////////////////////////////////
+        // Start the writer thread, once; called when a stream is
+        // opened and before the first record
+        /////////////////////////////////////////////////////////////
+        void Start( void )
+        {
+            call_once( this->started, [this] { this->writer = thread( &async_log_t::WriterLoop, this ); } );
+        }
+
+        /////////////////////////////////////////////////////////////
+        // Per-thread formatting buffer, configured for the target
+        /////////////////////////////////////////////////////////////
+        static inline ostringstream& Buffer( const ostream& target )
+        {
+            static thread_local ostringstream buf;
+            buf.str( string() );
+            buf.precision( target.precision() );
+            return buf;
+        }
+
+        /////////////////////////////////////////////////////////////
+        // Push a formatted message. The text up to its last newline,
+        // preceded by what the thread left unfinished for the same
+        // stream, goes into the ring as one record; the rest waits 
+        // for the end of its line. Never blocks on I/O; only if the
+        // ring is completely full does the producer yield until the
+        // writer frees a slot.
+        /////////////////////////////////////////////////////////////
+        void Push( ostream& target, const ostringstream& buf )
+        {
+            string     text = buf.str();
+            partial_t* partials = Partials();
+            partial_t* partial  = NULL;
+
+            FOR_ALL( ASYNC_MAX_STREAMS, n )
+                if( partial == NULL && ( partials[n].target == &target || partials[n].target == NULL ))
+                    partial = &partials[n];
+
+            size_t eol = text.rfind( '\n' );
+            if( partial == NULL )                   // more streams than slots
+            {
+                PushLines( target, text );
+                return;
+            }
+
+            partial->target = &target;
+            if( eol == string::npos )
+            {
+                partial->text += text;
+                return;
+            }
+
+            partial->text.append( text, 0, eol + 1 );
+            PushLines( target, partial->text );
+            partial->text.assign( text, eol + 1, string::npos );
+        }
+
+        /////////////////////////////////////////////////////////////
+        // Wait until everything pushed so far is written and flushed;
+        // an unfinished line of the calling thread is pushed as is
+        /////////////////////////////////////////////////////////////
+        void Drain( void )
+        {
+            partial_t* partials = Partials();
+            FOR_ALL( ASYNC_MAX_STREAMS, n )
+                if( partials[n].target != NULL && !partials[n].text.empty() )
+                {
+                    PushLines( *partials[n].target, partials[n].text );
+                    partials[n].text.clear();
+                }
+
+            size_t pos = this->head.load( memory_order_acquire );
+            if( pos == 0 )
+                return;
+
+            unique_lock< mutex > guard( this->lock );
+            this->drained.wait( guard, [this, pos] { return this->flushed.load( memory_order_acquire ) >= pos; } );
+        }
+};
+
+async_log_t AsyncLog;
+
+#define ASYNC_OUT( stream, msg )                                        \
+{ ostringstream& _async_buf = async_log_t::Buffer( stream );            \
+  _async_buf << msg << '\n';                                            \
+  AsyncLog.Push( stream, _async_buf ); }
+
+#define ASYNC_OUT_NOLN( stream, msg )                                   \
+{ ostringstream& _async_buf = async_log_t::Buffer( stream );            \
+  _async_buf << msg;                                                    \
+  AsyncLog.Push( stream, _async_buf ); }
+
+#define ASYNC_DRAIN()   AsyncLog.Drain()
+
+#endif // _SIM_ASYNC_H_INCLUDED_
@@ -0,0 +1,465 @@
+/**********************************************************
+ * Filename:    sim_bench.h
+ *
+ * Description: Microbenchmarks of the simulation building
+ *              blocks, run with
+ *
+ *   MPRS_upstream -bench <results.csv> [<baseline.csv>]
+ *
+ *              Every benchmark is warmed up, scaled so that a
+ *              repetition takes at least BENCH_MIN_REP_NS and
+ *              repeated BENCH_REPETITIONS times. The CSV file
+ *              has one row per benchmark (ns per operation).
+ *              If a baseline file from an earlier build is
+ *              given, benchmarks that became slower by more
+ *              than the noise are reported and the exit code
+ *              is non-zero.
+ *
+ *              Throughput and scaling of the complete upstream
+ *              path, run with
+ *
+ *   MPRS_upstream -throughput <results.csv> [<frames> [<max parallel>]]
+ *
+ *              runs 1, 2, 4, ... up to <max parallel> identical
+ *              simulations (fixed seed, fixed frame count) in
+ *              parallel threads and reports simulated columns
+ *              and frames per wall-clock second and peak RSS.
+ *
+ *********************************************************/
+
+#ifndef _SIM_BENCH_H_INCLUDED_
+#define _SIM_BENCH_H_INCLUDED_
+
+#include <chrono>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <thread>
+#include <memory>
+#include "_types.h"
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+    #include <psapi.h>
+    #pragma comment( lib, "psapi.lib" )
+#else
+    #include <sys/resource.h>
+#endif
+
+using namespace std;
+
+const int32s BENCH_REPETITIONS   = 15;
+const int64s BENCH_MIN_REP_NS    = 10000000;    // 10 ms
+const DOUBLE BENCH_REGRESSION    = 0.10;        // smallest reported slowdown (10%)
+const int32s BENCH_STREAM_COLUMNS= 1 << 16;     // recorded MAC TX output
+
+const int32u BENCH_SEED          = 1;           // all throughput runs simulate the same traffic
+
+volatile int64s bench_sink = 0;                 // keeps results alive
+
+struct bench_result_t
+{
+    string  name;
+    int64s  ops;                // operations per repetition
+    DOUBLE  mean_ns;            // per operation
+    DOUBLE  ci_ns;              // 95% confidence half-width of the mean
+    DOUBLE  stddev_ns;
+    DOUBLE  min_ns;
+    DOUBLE  median_ns;
+};
+
+/////////////////////////////////////////////////////////////////////
+// Run body( ops ) repeatedly; body performs ops operations
+/////////////////////////////////////////////////////////////////////
+template< class body_t > bench_result_t RunBenchmark( const CHAR* name, body_t body )
+{
+    typedef chrono::steady_clock bench_clock_t;
+
+    bench_result_t  res;
+    int64s          ops = 1000;
+    int64s          ns  = 0;
+
+    /////////////////////////////////////////////////////////////////
+    // warm-up: grow the repetition until it is long enough to time
+    /////////////////////////////////////////////////////////////////
+    for( ;; )
+    {
+        bench_clock_t::time_point t0 = bench_clock_t::now();
+        body( ops );
+        ns = chrono::duration_cast< chrono::nanoseconds >( bench_clock_t::now() - t0 ).count();
+        if( ns >= BENCH_MIN_REP_NS )
+            break;
+        ops *= ns > 0 && BENCH_MIN_REP_NS / ns < 8 ? 2 : 8;
+    }
+
+    /////////////////////////////////////////////////////////////////
+    // every repetition is one sample of the time per operation
+    /////////////////////////////////////////////////////////////////
+    BatchMeansCI    ci( 1, 0.5, 0.95 );
+    Stats           st;
+    vector< DOUBLE > samples;
+
+    FOR_ALL( BENCH_REPETITIONS, rep )
+    {
+        bench_clock_t::time_point t0 = bench_clock_t::now();
+        body( ops );
+        ns = chrono::duration_cast< chrono::nanoseconds >( bench_clock_t::now() - t0 ).count();
+
+        DOUBLE ns_op = (DOUBLE)ns / ops;
+        ci.Sample( ns_op );
+        st.Sample( ns_op );
+        samples.push_back( ns_op );
+    }
+    sort( samples.begin(), samples.end() );
+
+    res.name      = name;
+    res.ops       = ops;
+    res.mean_ns   = ci.GetMean();
+    res.ci_ns     = ci.GetMeanHalfWidth();
+    res.stddev_ns = sqrt( st.GetVar() * BENCH_REPETITIONS / ( BENCH_REPETITIONS - 1 ));
+    res.min_ns    = samples.front();
+    res.median_ns = samples[ samples.size() / 2 ];
+
+    cout << "Benchmark " << name << ": " << res.mean_ns << " +/- " << res.ci_ns << " ns/op" << endl;
+    return res;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Input data for the FSM benchmarks: output of MAC TX for back-to-
+// back frames, and the frames recovered from it by MAC RX
+/////////////////////////////////////////////////////////////////////
+void RecordMacStream( vector< _36b_t >& columns, vector< _frm_t >& frames )
+{
+    fsm_ngepon_mac_tx_t< > mac_tx;
+    fsm_ngepon_mac_rx_t< > mac_rx;
+
+    timestamp_t::ResetClock();
+    FOR_ALL( BENCH_STREAM_COLUMNS, n )
+    {
+        FOR_ALL( COLUMN_BYTES, byte_ndx )
+            timestamp_t::IncrementClock();
+
+        if( mac_tx.MacReady() )
+            mac_tx << _frm_t( timestamp_t::GetClock(), PacketSize() );
+
+        _36b_t col = (_36b_t)mac_tx;
+        columns.push_back( col );
+
+        mac_rx << col;
+        if( mac_rx.OutputReady() )
+            frames.push_back( (_frm_t)mac_rx );
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+// Baseline comparison: a benchmark regressed if its mean grew by
+// more than BENCH_REGRESSION and by more than both intervals
+/////////////////////////////////////////////////////////////////////
+int32s CompareBenchmarks( const vector< bench_result_t >& results, const CHAR* baseline_file )
+{
+    ifstream baseline( baseline_file );
+    string   line;
+    int32s   regressions = 0;
+
+    if( !baseline.is_open() )
+    {
+        cerr << "Cannot open baseline " << baseline_file << endl;
+        return -1;
+    }
+
+    getline( baseline, line );      // header
+    while( getline( baseline, line ))
+    {
+        size_t comma = line.find( ',' );
+        if( comma == string::npos )
+            continue;
+
+        string  name = line.substr( 0, comma );
+        DOUBLE  base_mean = 0, base_ci = 0;
+        int64s  base_ops = 0;
+        if( sscanf( line.c_str() + comma + 1, "%lld,%lf,%lf", &base_ops, &base_mean, &base_ci ) != 3 )
+            continue;
+
+        FOR_ALL( (int32s)results.size(), n )
+        {
+            const bench_result_t& r = results[n];
+            if( r.name != name )
+                continue;
+
+            DOUBLE change = base_mean > 0 ? r.mean_ns / base_mean - 1 : 0;
+            bool   slower = change > BENCH_REGRESSION && r.mean_ns - r.ci_ns > base_mean + base_ci;
+
+            cout << ( slower ? "REGRESSION " : "           " ) << name << ": "
+                 << base_mean << " -> " << r.mean_ns << " ns/op (" << ( change >= 0 ? "+" : "" ) << 100 * change << "%)" << endl;
+            regressions += slower;
+        }
+    }
+    return regressions;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Run all benchmarks; returns the exit code of the program
+/////////////////////////////////////////////////////////////////////
+int RunBenchmarks( const CHAR* result_file, const CHAR* baseline_file )
+{
+    vector< bench_result_t > results;
+    vector< _36b_t >         columns;
+    vector< _frm_t >         frames;
+
+    SimSrand( 1 );
+    RecordMacStream( columns, frames );
+    const int64s stream_size = (int64s)columns.size();
+
+    /////////////////////////////////////////////////////////////////
+    results.push_back( RunBenchmark( "Queue::Add/Get", [&]( int64s ops )
+    {
+        static Queue< _36b_t, 64 > queue;
+        int64s sum = 0;
+        for( int64s n = 0; n < ops; n++ )
+        {
+            queue.Add( columns[ n & 0xFF ] );
+            sum += queue.Get().GetSeqNumber();
+        }
+        bench_sink += sum;
+    } ));
+
+    /////////////////////////////////////////////////////////////////
+    results.push_back( RunBenchmark( "_72b_t::T_TYPE", [&]( int64s ops )
+    {
+        _72b_t vectors[ 8 ] = { _72b_t( 0, S_BLOCK ), _72b_t( 0, D_BLOCK ), _72b_t( 0, T_BLOCK ), _72b_t( 0, C_BLOCK ),
+                                _72b_t( columns[0], columns[1] ), _72b_t( 0, P_BLOCK ), _72b_t( 0, E_BLOCK ), _72b_t( 0, Y_BLOCK ) };
+        int64s sum = 0;
+        for( int64s n = 0; n < ops; n++ )
+            sum += vectors[ n & 0x07 ].T_TYPE();
+        bench_sink += sum;
+    } ));
+
+    /////////////////////////////////////////////////////////////////
+    results.push_back( RunBenchmark( "_66b_t construction", [&]( int64s ops )
+    {
+        int64s sum = 0;
+        for( int64s n = 0; n < ops; n++ )
+        {
+            _66b_t block( (clk_t)n, D_BLOCK, (int32s)n );
+            sum += block[1].GetSeqNumber();
+        }
+        bench_sink += sum;
+    } ));
+
+    /////////////////////////////////////////////////////////////////
+    // RS TX is fed at the rate it accepts data, with a grant per frame
+    /////////////////////////////////////////////////////////////////
+    unique_ptr< fsm_ngepon_rs_tx_t< > > rs_tx( new fsm_ngepon_rs_tx_t< > );
+    int64s rs_pos = 0;
+    results.push_back( RunBenchmark( "fsm_ngepon_rs_tx_t::ReceiveUnit/TransmitUnit", [&]( int64s ops )
+    {
+        int64s sum = 0;
+        for( int64s n = 0; n < ops; n++ )
+        {
+            if( rs_tx->IsReadyForMoreData( 0 ))
+            {
+                const _36b_t& col = columns[ rs_pos++ & ( BENCH_STREAM_COLUMNS - 1 ) ];
+                if( col.IsType( S_BLOCK ))
+                    rs_tx->CbCtrlRequest( 0, 300 );
+                rs_tx->ReceiveUnit( col );
+            }
+            sum += rs_tx->TransmitUnit().GetSeqNumber();
+        }
+        bench_sink += sum;
+    } ));
+    rs_tx.reset();
+
+    /////////////////////////////////////////////////////////////////
+    // MAC TX sends back-to-back frames
+    /////////////////////////////////////////////////////////////////
+    fsm_ngepon_mac_tx_t< > mac_tx;
+    results.push_back( RunBenchmark( "fsm_ngepon_mac_tx_t::TransmitUnit", [&]( int64s ops )
+    {
+        int64s sum = 0;
+        for( int64s n = 0; n < ops; n++ )
+        {
+            if( mac_tx.MacReady() )
+                mac_tx.ReceiveUnit( frames[ n % frames.size() ] );
+            sum += mac_tx.TransmitUnit().GetSeqNumber();
+        }
+        bench_sink += sum;
+    } ));
+
+    /////////////////////////////////////////////////////////////////
+    // MAC RX restarts with the recorded stream, so that the column
+    // sequence numbers stay consistent
+    /////////////////////////////////////////////////////////////////
+    fsm_ngepon_mac_rx_t< > mac_rx;
+    int64s rx_pos = 0;
+    results.push_back( RunBenchmark( "fsm_ngepon_mac_rx_t::ReceiveUnit", [&]( int64s ops )
+    {
+        int64s sum = 0;
+        for( int64s n = 0; n < ops; n++ )
+        {
+            if( rx_pos == stream_size )
+            {
+                mac_rx = fsm_ngepon_mac_rx_t< >();
+                rx_pos = 0;
+            }
+            mac_rx.ReceiveUnit( columns[ rx_pos++ ] );
+            if( mac_rx.OutputReady() )
+                sum += ((_frm_t)mac_rx).GetFrameSize();
+        }
+        bench_sink += sum;
+    } ));
+
+    /////////////////////////////////////////////////////////////////
+    results.push_back( RunBenchmark( "Distrib::Sample", [&]( int64s ops )
+    {
+        static Distrib< 1000 > distrib( 0, 2.0 );
+        for( int64s n = 0; n < ops; n++ )
+            distrib.Sample( (stat_t)( n & 0x7FF ));
+        bench_sink += (int64s)distrib.GetCount();
+    } ));
+
+    /////////////////////////////////////////////////////////////////
+    // the delays are sampled into local statistics, never into those
+    // of a simulation run
+    /////////////////////////////////////////////////////////////////
+    vector< delay_hist_t > histograms( DELAY_ARRAY_SIZE + 1 );
+    BatchMeansCI convergence( CONVERGENCE_BATCH, CONVERGENCE_PERCENTILE, CONVERGENCE_CONFIDENCE );
+    results.push_back( RunBenchmark( "CollectStats", [&]( int64s ops )
+    {
+        int16s delays[ DELAY_ARRAY_SIZE + 1 ];
+        for( int64s n = 0; n < ops; n++ )
+            if( FrameDelays( frames[ n % frames.size() ], delays ))
+                SampleDelays( delays, &histograms[0], convergence );
+        bench_sink += (int64s)histograms[ DELAY_ARRAY_SIZE ].GetCount();
+    } ));
+
+    /////////////////////////////////////////////////////////////////
+    // machine-readable results
+    /////////////////////////////////////////////////////////////////
+    ofstream csv( result_file );
+    if( !csv.is_open() )
+    {
+        cerr << "Cannot create " << result_file << endl;
+        return 1;
+    }
+    csv << "benchmark,ops_per_rep,mean_ns,ci95_ns,stddev_ns,min_ns,median_ns,repetitions" << endl;
+    FOR_ALL( (int32s)results.size(), n )
+    {
+        const bench_result_t& r = results[n];
+        csv << r.name << "," << r.ops << "," << r.mean_ns << "," << r.ci_ns << "," << r.stddev_ns << ","
+            << r.min_ns << "," << r.median_ns << "," << BENCH_REPETITIONS << endl;
+    }
+    csv.close();
+
+    if( baseline_file == NULL )
+        return 0;
+
+    int32s regressions = CompareBenchmarks( results, baseline_file );
+    if( regressions < 0 )
+        return 1;
+    if( regressions > 0 )
+        cout << regressions << " benchmark(s) regressed" << endl;
+    return regressions > 0 ? 2 : 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Peak resident set size of the process in KB
+/////////////////////////////////////////////////////////////////////
+int64s PeakRssKB( void )
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if( !GetProcessMemoryInfo( GetCurrentProcess(), &pmc, sizeof( pmc )))
+        return 0;
+    return (int64s)( pmc.PeakWorkingSetSize / 1024 );
+#else
+    struct rusage usage;
+    if( getrusage( RUSAGE_SELF, &usage ) != 0 )
+        return 0;
+    return (int64s)usage.ru_maxrss;             // KB on Linux
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////
+// One simulation of the throughput benchmark; all statistics are
+// thread-local, so the runs do not interact
+/////////////////////////////////////////////////////////////////////
+void ThroughputRun( int32s frames, int64s* columns )
+{
+    ClearStats();
+    SimSrand( BENCH_SEED );
+
+    upstream_context_t* ctx = new upstream_context_t;
+    RunUpstream( *ctx, frames );
+    *columns = (int64s)ctx->VectorCount36b * MII_WIDTH;
+    delete ctx;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Scaling curve over the number of parallel simulations; returns 
+// the exit code of the program
+/////////////////////////////////////////////////////////////////////
+int RunThroughputBenchmark( const CHAR* result_file, int32s frames, int32s max_parallel )
+{
+    typedef chrono::steady_clock bench_clock_t;
+
+    ofstream csv( result_file );
+    if( !csv.is_open() )
+    {
+        cerr << "Cannot create " << result_file << endl;
+        return 1;
+    }
+
+    if( frames <= 0 )
+        frames = TEST_FRAMES;
+    if( max_parallel <= 0 )
+        max_parallel = MAX< int32s >( 1, (int32s)thread::hardware_concurrency() );
+
+    /////////////////////////////////////////////////////////////////
+    // there is one ONU per simulation until multiple ONUs are modeled
+    /////////////////////////////////////////////////////////////////
+    const int32s onus = 1;
+    DOUBLE       single_rate = 0;
+
+    csv << "onus,parallel,frames_per_sim,wall_s,columns_per_s,frames_per_s,columns_per_s_per_sim,speedup,efficiency,peak_rss_kb" << endl;
+
+    for( int32s parallel = 1; ; parallel = MIN< int32s >( 2 * parallel, max_parallel ))
+    {
+        vector< int64s > columns( parallel, 0 );
+        vector< thread > threads;
+
+        bench_clock_t::time_point t0 = bench_clock_t::now();
+        FOR_ALL( parallel, n )
+            threads.push_back( thread( ThroughputRun, frames, &columns[n] ));
+        FOR_ALL( parallel, n )
+            threads[n].join();
+        DOUBLE wall = chrono::duration< DOUBLE >( bench_clock_t::now() - t0 ).count();
+
+        int64s total_columns = 0;
+        FOR_ALL( parallel, n )
+            total_columns += columns[n];
+
+        DOUBLE col_rate = total_columns / wall;
+        DOUBLE frm_rate = (DOUBLE)frames * parallel / wall;
+        if( parallel == 1 )
+            single_rate = col_rate;
+        DOUBLE speedup  = single_rate > 0 ? col_rate / single_rate : 0;
+        int64s peak_rss = PeakRssKB();
+
+        csv << onus << "," << parallel << "," << frames << "," << wall << "," << col_rate << "," << frm_rate << ","
+            << col_rate / parallel << "," << speedup << "," << speedup / parallel << "," << peak_rss << endl;
+        cout << "Parallel simulations: " << parallel << ", " << col_rate << " columns/s, " << frm_rate << " frames/s, speedup "
+             << speedup << ", peak RSS " << peak_rss << " KB" << endl;
+
+        if( parallel >= max_parallel )
+            break;
+    }
+
+    csv.close();
+    return 0;
+}
+
+#endif // _SIM_BENCH_H_INCLUDED_
@@ -0,0 +1,395 @@
+/**********************************************************
+ * Filename:    sim_binary.h
+ *
+ * Description: Binary per-frame result records (RESULT #1).
+ *              Frames are buffered into large blocks and
+ *              stored column-wise (all frame sizes of a block,
+ *              then all delays of stage 0, stage 1, ...).
+ *              A block may optionally be compressed with
+ *              a delta/varint column codec. The reader and
+ *              the CSV converter turn a record file back into
+ *              the text format produced by MSG_OUT1.
+ *
+ *********************************************************/
+
+#ifndef _SIM_BINARY_H_INCLUDED_
+#define _SIM_BINARY_H_INCLUDED_
+
+#include <fstream>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "_types.h"
+#include "FSM_base.h"
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////
+// constants
+/////////////////////////////////////////////////////////////////////
+const CHAR   REC_FILE_MAGIC[8]     = { 'M', 'P', 'R', 'S', 'R', 'E', 'C', '2' };
+const int32s REC_BLOCK_FRAMES      = 65536;                 // frames per block
+const int32s REC_COLUMNS           = DELAY_ARRAY_SIZE + 1;  // frame size + delays
+const int32s REC_HEADER_CHARS      = 256;                   // space for column names
+const int32s REC_MAX_COLUMNS       = 64;                    // delay columns of a file
+static_assert( REC_COLUMNS - 1 <= REC_MAX_COLUMNS, "too many delay columns for a record file" );
+
+enum rec_codec_t
+{
+    REC_CODEC_RAW   = 0,    // fixed-width int16s columns
+    REC_CODEC_DVAR  = 1     // zigzag delta + LEB128 varint per column
+};
+
+/////////////////////////////////////////////////////////////////////
+// File header, written once at the beginning of the file
+/////////////////////////////////////////////////////////////////////
+struct rec_file_header_t
+{
+    CHAR    magic[8];
+    int32u  delay_columns;                  // delay columns of the writer
+    int8u   in_total[ REC_MAX_COLUMNS ];    // 1 if the column is included in TOTAL
+    CHAR    names[ REC_HEADER_CHARS ];      // CSV header (stage names)
+};
+
+/////////////////////////////////////////////////////////////////////
+// Block header, precedes each block of records
+/////////////////////////////////////////////////////////////////////
+struct rec_block_header_t
+{
+    int32u  frames;         // number of records in the block
+    int32u  stored_bytes;   // size of the payload that follows
+    int32u  codec;          // rec_codec_t
+};
+
+/////////////////////////////////////////////////////////////////////
+// Delta/varint column codec
+/////////////////////////////////////////////////////////////////////
+inline int32u RecEncodeColumn( const int16s* col, int32s cnt, BYTE* dst )
+{
+    BYTE*  out  = dst;
+    int32s prev = 0;
+
+    for( int32s i = 0; i < cnt; i++ )
+    {
+        int32s delta = (int32s)col[i] - prev;
+        int32u zz    = ((int32u)delta << 1) ^ (int32u)(delta >> 31);
+        prev = col[i];
+
+        while( zz >= 0x80 )
+        {
+            *out++ = (BYTE)( zz | 0x80 );
+            zz >>= 7;
+        }
+        *out++ = (BYTE)zz;
+    }
+    return (int32u)( out - dst );
+}
+
+inline const BYTE* RecDecodeColumn( const BYTE* src, const BYTE* end, int16s* col, int32s cnt )
+{
+    int32s prev = 0;
+
+    for( int32s i = 0; i < cnt; i++ )
+    {
+        int32u zz = 0;
+        int32s shift = 0;
+
+        do
+        {
+            if( src >= end )
+                return NULL;
+            zz |= (int32u)( *src & 0x7F ) << shift;
+            shift += 7;
+        }
+        while( *src++ & 0x80 );
+
+        prev  += (int32s)( zz >> 1 ) ^ -(int32s)( zz & 1 );
+        col[i] = (int16s)prev;
+    }
+    return src;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Writer of binary per-frame records
+/////////////////////////////////////////////////////////////////////
+class frame_record_writer_t
+{
+    private:
+        ofstream    file;
+        rec_codec_t codec;
+        int32s      frames;                                     // records in the current block
+        int16s*     columns;                                    // current block, column-wise
+        BYTE*       payload;                                    // encoding buffer
+        vector< int16s > delay_index;                           // delay array entry of every delay column
+
+        inline int16s* Column( int32s n )   { return this->columns + n * REC_BLOCK_FRAMES; }
+
+        /////////////////////////////////////////////////////////////
+        void WriteBlock( void )
+        {
+            rec_block_header_t hdr;
+            hdr.frames       = this->frames;
+            hdr.codec        = this->codec;
+            hdr.stored_bytes = 0;
+
+            int32s cols = (int32s)this->delay_index.size() + 1;
+            if( this->codec == REC_CODEC_DVAR )
+            {
+                FOR_ALL( cols, n )
+                    hdr.stored_bytes += RecEncodeColumn( Column( n ), this->frames, this->payload + hdr.stored_bytes );
+            }
+            else
+            {
+                FOR_ALL( cols, n )
+                {
+                    memcpy( this->payload + hdr.stored_bytes, Column( n ), this->frames * sizeof( int16s ));
+                    hdr.stored_bytes += this->frames * sizeof( int16s );
+                }
+            }
+
+            this->file.write( (const CHAR*)&hdr, sizeof( hdr ));
+            this->file.write( (const CHAR*)this->payload, hdr.stored_bytes );
+            this->frames = 0;
+        }
+
+    public:
+        frame_record_writer_t()
+        {
+            this->codec   = REC_CODEC_RAW;
+            this->frames  = 0;
+            this->columns = new int16s[ REC_COLUMNS * REC_BLOCK_FRAMES ];
+            // worst case of the varint codec is 3 bytes per value
+            this->payload = new BYTE[ REC_COLUMNS * REC_BLOCK_FRAMES * 3 ];
+        }
+
+        ~frame_record_writer_t()
+        {
+            Close();
+            delete [] this->columns;
+            delete [] this->payload;
+        }
+
+        /////////////////////////////////////////////////////////////
+        void Open( const CHAR* file_name, const result_columns_t& cols, rec_codec_t cdc )
+        {
+            rec_file_header_t hdr;
+
+            memset( &hdr, 0, sizeof( hdr ));
+            memcpy( hdr.magic, REC_FILE_MAGIC, sizeof( hdr.magic ));
+            hdr.delay_columns = (int32u)cols.delay.size();
+            FOR_ALL( (int32s)cols.delay.size(), n )
+                hdr.in_total[n] = cols.delay[n] >= cols.total_from;
+            strncpy( hdr.names, cols.header.c_str(), REC_HEADER_CHARS - 1 );
+
+            this->delay_index = cols.delay;
+
+            this->codec  = cdc;
+            this->frames = 0;
+            this->file.open( file_name, ios::out | ios::binary );
+            this->file.write( (const CHAR*)&hdr, sizeof( hdr ));
+        }
+
+        /////////////////////////////////////////////////////////////
+        void Close( void )
+        {
+            if( !this->file.is_open() )
+                return;
+            if( this->frames > 0 )
+                WriteBlock();
+            this->file.close();
+        }
+
+        /////////////////////////////////////////////////////////////
+        // Append one frame: size followed by the delays of the result
+        // columns; delay[] is the whole delay array
+        /////////////////////////////////////////////////////////////
+        inline void Write( int16s frame_size, const int16s* delay )
+        {
+            if( !this->file.is_open() )
+                return;
+
+            Column( 0 )[ this->frames ] = frame_size;
+            FOR_ALL( (int32s)this->delay_index.size(), n )
+                Column( n + 1 )[ this->frames ] = delay[ this->delay_index[n] ];
+
+            if( ++this->frames == REC_BLOCK_FRAMES )
+                WriteBlock();
+        }
+};
+
+/////////////////////////////////////////////////////////////////////
+// Reader of binary per-frame records
+/////////////////////////////////////////////////////////////////////
+class frame_record_reader_t
+{
+    private:
+        ifstream            file;
+        rec_file_header_t   header;
+        int32s              frames;         // records in the current block
+        int32s              next;           // next record to return
+        int16s*             columns;        // current block, column-wise
+        BYTE*               payload;
+
+        /////////////////////////////////////////////////////////////
+        bool ReadBlock( void )
+        {
+            rec_block_header_t hdr;
+            int32s cols = this->header.delay_columns + 1;
+
+            if( !this->file.read( (CHAR*)&hdr, sizeof( hdr )) || hdr.frames > REC_BLOCK_FRAMES ||
+                hdr.stored_bytes > (int32u)( cols * REC_BLOCK_FRAMES * 3 ))
+                return false;
+            if( !this->file.read( (CHAR*)this->payload, hdr.stored_bytes ))
+                return false;
+
+            const BYTE* src = this->payload;
+            const BYTE* end = this->payload + hdr.stored_bytes;
+
+            FOR_ALL( cols, n )
+            {
+                int16s* col = this->columns + n * REC_BLOCK_FRAMES;
+
+                if( hdr.codec == REC_CODEC_DVAR )
+                {
+                    if(( src = RecDecodeColumn( src, end, col, hdr.frames )) == NULL )
+                        return false;
+                }
+                else
+                {
+                    memcpy( col, src, hdr.frames * sizeof( int16s ));
+                    src += hdr.frames * sizeof( int16s );
+                }
+            }
+
+            this->frames = hdr.frames;
+            this->next   = 0;
+            return this->frames > 0;
+        }
+
+    public:
+        frame_record_reader_t()
+        {
+            this->frames  = 0;
+            this->next    = 0;
+            this->columns = NULL;
+            this->payload = NULL;
+        }
+
+        ~frame_record_reader_t()
+        {
+            delete [] this->columns;
+            delete [] this->payload;
+        }
+
+        /////////////////////////////////////////////////////////////
+        // Returns false if the file is missing or not a record file
+        /////////////////////////////////////////////////////////////
+        bool Open( const CHAR* file_name )
+        {
+            this->file.open( file_name, ios::in | ios::binary );
+            if( !this->file.read( (CHAR*)&this->header, sizeof( this->header )) ||
+                memcmp( this->header.magic, REC_FILE_MAGIC, sizeof( REC_FILE_MAGIC )) != 0 ||
+                this->header.delay_columns == 0 || this->header.delay_columns > REC_MAX_COLUMNS )
+                return false;
+
+            this->header.names[ REC_HEADER_CHARS - 1 ] = '\0';
+            int32s cols = this->header.delay_columns + 1;
+            this->columns = new int16s[ cols * REC_BLOCK_FRAMES ];
+            this->payload = new BYTE[ cols * REC_BLOCK_FRAMES * 3 ];
+            return true;
+        }
+
+        inline int32s      GetDelayColumns( void ) const { return this->header.delay_columns; }
+        inline bool        InTotal( int32s n )     const { return this->header.in_total[n] != 0; }
+        inline const CHAR* GetNames( void )        const { return this->header.names; }
+
+        /////////////////////////////////////////////////////////////
+        // Read next record; delay[] must hold GetDelayColumns() values
+        /////////////////////////////////////////////////////////////
+        bool Read( int16s& frame_size, int16s* delay )
+        {
+            if( this->next >= this->frames && !ReadBlock() )
+                return false;
+
+            frame_size = this->columns[ this->next ];
+            FOR_ALL( this->header.delay_columns, n )
+                delay[n] = this->columns[ ( n + 1 ) * REC_BLOCK_FRAMES + this->next ];
+            this->next++;
+            return true;
+        }
+};
+
+/////////////////////////////////////////////////////////////////////
+// Converts a record file into the CSV layout of the OUT1 stream.
+// Returns the number of converted frames, or -1 on error.
+/////////////////////////////////////////////////////////////////////
+int64s ConvertRecordsToCsv( const CHAR* bin_name, const CHAR* csv_name )
+{
+    frame_record_reader_t reader;
+    ofstream csv;
+
+    if( !reader.Open( bin_name ))
+        return -1;
+
+    csv.open( csv_name );
+    if( !csv.is_open() )
+        return -1;
+
+    int16s  frame_size;
+    int16s  delay[ REC_MAX_COLUMNS ];
+    int64s  count = 0;
+
+    csv << "Frame size,," << reader.GetNames() << "\n";
+    while( reader.Read( frame_size, delay ))
+    {
+        int32s total_delay = 0;
+
+        csv << frame_size << ",,";
+        FOR_ALL( reader.GetDelayColumns(), n )
+        {
+            csv << delay[n] << ",";
+            if( reader.InTotal( n ))
+                total_delay += delay[n];
+        }
+        csv << (int16s)total_delay << "\n";
+        count++;
+    }
+    return count;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Binary RESULT #1 output
+/////////////////////////////////////////////////////////////////////
+// The downstream direction writes into its own _OUT1_DS.bin file, 
+// selected per thread with USE_BIN1_DOWNSTREAM()
+/////////////////////////////////////////////////////////////////////
+#if defined ( RESULT_1_OUTPUT_BINARY )
+    frame_record_writer_t BIN_OUT1;
+    frame_record_writer_t BIN_OUT1_DS;
+    thread_local frame_record_writer_t* BIN_OUT1_THREAD = &BIN_OUT1;
+    #if defined ( RESULT_1_BINARY_COMPRESS )
+        const rec_codec_t BIN_OUT1_CODEC = REC_CODEC_DVAR;
+    #else
+        const rec_codec_t BIN_OUT1_CODEC = REC_CODEC_RAW;
+    #endif
+    inline void OPEN_BIN1_STREAM( CHAR* d, size_t sz, const result_columns_t& upstream, const result_columns_t& downstream )
+    { 
+        string base( d );
+        strcat_s( d, sz, "_OUT1.bin" );  BIN_OUT1.Open( d, upstream, BIN_OUT1_CODEC ); 
+    #if defined ( CHECK_DOWNSTREAM )
+        BIN_OUT1_DS.Open( ( base + "_OUT1_DS.bin" ).c_str(), downstream, BIN_OUT1_CODEC );
+    #else
+        (void)downstream;
+    #endif
+    }
+    inline void CLOSE_BIN1_STREAM( void )   { BIN_OUT1.Close(); BIN_OUT1_DS.Close(); }
+    inline void USE_BIN1_DOWNSTREAM( void ) { BIN_OUT1_THREAD = &BIN_OUT1_DS; }
+    #define RSLT1_BINARY_OUT( size, delay )     BIN_OUT1_THREAD->Write( size, delay )
+#else
+    inline void OPEN_BIN1_STREAM( CHAR*, size_t, const result_columns_t&, const result_columns_t& )  {}
+    inline void CLOSE_BIN1_STREAM( void )   {}
+    inline void USE_BIN1_DOWNSTREAM( void ) {}
+    #define RSLT1_BINARY_OUT( size, delay )
+#endif
+
+#endif // _SIM_BINARY_H_INCLUDED_
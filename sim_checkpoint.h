@@ -0,0 +1,192 @@
+/**********************************************************
+ * Filename:    sim_checkpoint.h
+ *
+ * Description: Binary snapshots of the simulation state.
+ *              Every stateful class provides a method
+ *                  template< class archive_t >
+ *                  void Serialize( archive_t& ar );
+ *              that passes its members to the archive. The
+ *              same method is used to save and to restore,
+ *              so both directions always stay in sync.
+ *
+ *********************************************************/
+
+#ifndef _SIM_CHECKPOINT_H_INCLUDED_
+#define _SIM_CHECKPOINT_H_INCLUDED_
+
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "_types.h"
+
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#endif
+
+using namespace std;
+
+const CHAR CKPT_FILE_MAGIC[8] = { 'M', 'P', 'R', 'S', 'C', 'K', 'P', '1' };
+
+/////////////////////////////////////////////////////////////////////
+// Renames a file over an existing one in a single step, so that the
+// target is always either the old or the new file. POSIX rename()
+// replaces the target; on Windows, rename() fails if the target
+// exists and MoveFileEx does the replacing.
+/////////////////////////////////////////////////////////////////////
+inline bool RenameOver( const CHAR* from, const CHAR* to )
+{
+#ifdef _WIN32
+    return MoveFileExA( from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) != 0;
+#else
+    return rename( from, to ) == 0;
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////
+// Snapshot archive: collects the state in memory when saving and
+// hands it back member by member when loading
+/////////////////////////////////////////////////////////////////////
+class snapshot_t
+{
+    private:
+        std::vector< BYTE > data;
+        size_t              pos;
+        bool                loading;
+        bool                failed;
+
+    public:
+        snapshot_t()
+        {
+            this->pos     = 0;
+            this->loading = false;
+            this->failed  = false;
+        }
+
+        inline bool IsLoading( void ) const    { return this->loading; }
+        inline bool Failed( void )    const    { return this->failed;  }
+
+        /////////////////////////////////////////////////////////////
+        // Copy raw bytes into (saving) or out of (loading) the archive
+        /////////////////////////////////////////////////////////////
+        void Bytes( void* ptr, size_t size )
+        {
+            if( !this->loading )
+            {
+                const BYTE* src = (const BYTE*)ptr;
+                this->data.insert( this->data.end(), src, src + size );
+                return;
+            }
+
+            if( this->failed || this->pos + size > this->data.size() )
+            {
+                this->failed = true;
+                return;
+            }
+            memcpy( ptr, &this->data[ this->pos ], size );
+            this->pos += size;
+        }
+
+        /////////////////////////////////////////////////////////////
+        // Plain (trivially copyable) values and arrays of them
+        /////////////////////////////////////////////////////////////
+        template< class T > inline void Raw( T& val )  { Bytes( &val, sizeof( T )); }
+
+        /////////////////////////////////////////////////////////////
+        // Vectors of plain values
+        /////////////////////////////////////////////////////////////
+        template< class T > void Vector( std::vector< T >& vec )
+        {
+            int64u size = vec.size();
+            Raw( size );
+            if( this->loading )
+            {
+                if( this->failed || size > this->data.size() )
+                {
+                    this->failed = true;
+                    return;
+                }
+                vec.resize( (size_t)size );
+            }
+            if( size > 0 )
+                Bytes( &vec[0], (size_t)size * sizeof( T ));
+        }
+
+        /////////////////////////////////////////////////////////////
+        // Write the archive atomically: into a temporary file that
+        // replaces the target only after it is complete
+        /////////////////////////////////////////////////////////////
+        bool Save( const CHAR* file_name, int32u layout )
+        {
+            string   tmp_name = string( file_name ) + ".tmp";
+            ofstream file( tmp_name.c_str(), ios::out | ios::binary | ios::trunc );
+            int64u   size = this->data.size();
+
+            file.write( CKPT_FILE_MAGIC, sizeof( CKPT_FILE_MAGIC ));
+            file.write( (const CHAR*)&layout, sizeof( layout ));
+            file.write( (const CHAR*)&size, sizeof( size ));
+            if( size > 0 )
+                file.write( (const CHAR*)&this->data[0], (streamsize)size );
+            file.close();
+
+            if( file.fail() )
+                return false;
+            return RenameOver( tmp_name.c_str(), file_name );
+        }
+
+        /////////////////////////////////////////////////////////////
+        // Read an archive for loading; the layout signature must
+        // match the one of the running executable
+        /////////////////////////////////////////////////////////////
+        bool Load( const CHAR* file_name, int32u layout )
+        {
+            ifstream file( file_name, ios::in | ios::binary );
+            CHAR     magic[ sizeof( CKPT_FILE_MAGIC ) ];
+            int32u   file_layout = 0;
+            int64u   size = 0;
+
+            bool ok = file.read( magic, sizeof( magic )) &&
+                      memcmp( magic, CKPT_FILE_MAGIC, sizeof( magic )) == 0 &&
+                      file.read( (CHAR*)&file_layout, sizeof( file_layout )) &&
+                      file_layout == layout &&
+                      file.read( (CHAR*)&size, sizeof( size ));
+
+            if( ok )
+            {
+                this->data.resize( (size_t)size );
+                ok = size == 0 || file.read( (CHAR*)&this->data[0], (streamsize)size );
+            }
+
+            this->loading = true;
+            this->pos     = 0;
+            this->failed  = !ok;
+            return ok;
+        }
+};
+
+/////////////////////////////////////////////////////////////////////
+// SIGINT/SIGTERM only raise a flag; the simulation loop writes a
+// checkpoint at the next frame boundary and terminates
+/////////////////////////////////////////////////////////////////////
+volatile sig_atomic_t checkpoint_signal = 0;
+
+extern "C" void CheckpointSignalHandler( int sig )
+{
+    checkpoint_signal = sig;
+}
+
+inline void InstallCheckpointHandlers( void )
+{
+    signal( SIGINT,  CheckpointSignalHandler );
+    signal( SIGTERM, CheckpointSignalHandler );
+}
+
+#endif // _SIM_CHECKPOINT_H_INCLUDED_
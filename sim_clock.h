@@ -0,0 +1,228 @@
+/**********************************************************
+ * Filename:    sim_clock.h
+ *
+ * Description: Clock domains and the tick schedule. Every
+ *              stage transfers data on the clock of its domain;
+ *              the period of a domain is a rational number of
+ *              byte clocks, e.g. 4/1 for 36-bit columns at 25G
+ *              or 1/2 for a MAC running twice as fast as the
+ *              byte clock. The order in which the domains tick
+ *              is computed once for a hyperperiod (the shortest
+ *              time after which all domains are in phase again)
+ *              and then replayed, so the simulation loop needs
+ *              no divisions. pipeline_t computes the pattern at
+ *              compile time, the stage graph at start-up.
+ *
+ *********************************************************/
+
+#ifndef _SIM_CLOCK_H_INCLUDED_
+#define _SIM_CLOCK_H_INCLUDED_
+
+#include <vector>
+#include <iostream>
+#include "_types.h"
+#include "FSM_base.h"
+
+/////////////////////////////////////////////////////////////////////
+// Period of a clock domain in byte clocks: num / den
+/////////////////////////////////////////////////////////////////////
+struct clock_period_t
+{
+    int32s  num;
+    int32s  den;
+};
+
+constexpr clock_period_t BYTE_CLOCK   = { 1, 1 };
+constexpr clock_period_t COLUMN_CLOCK = { COLUMN_BYTES, 1 };    // 36-bit columns
+constexpr clock_period_t VECTOR_CLOCK = { VECTOR_BYTES, 1 };    // 72-bit vectors, 66-bit blocks
+
+/////////////////////////////////////////////////////////////////////
+// Default domain of a stage, by the unit it delivers
+/////////////////////////////////////////////////////////////////////
+template< class unit_t > struct clock_of             { static constexpr clock_period_t period = BYTE_CLOCK; };
+template<> struct clock_of< _36b_t >                 { static constexpr clock_period_t period = COLUMN_CLOCK; };
+template<> struct clock_of< _72b_t >                 { static constexpr clock_period_t period = VECTOR_CLOCK; };
+template<> struct clock_of< _66b_t >                 { static constexpr clock_period_t period = VECTOR_CLOCK; };
+template< int16s N > struct clock_of< _columns_t< N > > { static constexpr clock_period_t period = { COLUMN_BYTES * N, 1 }; };
+
+constexpr int64s ClockGcd( int64s a, int64s b )
+{
+    while( b != 0 )
+    {
+        int64s t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+constexpr int64s ClockLcm( int64s a, int64s b )
+{
+    return a / ClockGcd( a, b ) * b;
+}
+
+const int32s TICK_MAX_STAGES  = 30;
+const int32u TICK_TIMESTAMP   = 1u << 30;     // byte clock of the timestamps
+const int32u TICK_END_OF_STEP = 1u << 31;
+
+enum tick_error_t
+{
+    TICK_OK,
+    TICK_BAD_STAGES,
+    TICK_BAD_PERIOD,
+    TICK_TOO_LONG
+};
+
+/////////////////////////////////////////////////////////////////////
+// Tick pattern for one hyperperiod. A slot is an instant at which
+// one or more domains tick; its mask has a bit for every stage that
+// ticks, TICK_TIMESTAMP if the byte clock ticks, and TICK_END_OF_STEP
+// on the last slot of a step. A step ends with every tick of the
+// last stage, so a frame leaving the pipeline is always the last
+// thing that happens in a step.
+/////////////////////////////////////////////////////////////////////
+template< int32s MAX_SLOTS > struct tick_pattern_t
+{
+    int32u          slot[ MAX_SLOTS ];
+    int32s          step_start[ MAX_SLOTS + 1 ];    // first slot of every step, then slots
+    int32s          slots;
+    int32s          steps;
+    int64s          hyper_num;                  // hyperperiod in byte clocks: num / den
+    int64s          hyper_den;
+    tick_error_t    error;
+};
+
+/////////////////////////////////////////////////////////////////////
+// Ticks happen at the end of each period; all domains start in
+// phase. At the same instant, the byte clock ticks first.
+/////////////////////////////////////////////////////////////////////
+template< int32s MAX_SLOTS > constexpr tick_pattern_t< MAX_SLOTS > BuildTickPattern( const clock_period_t* periods, int32s stages )
+{
+    tick_pattern_t< MAX_SLOTS > pattern {};
+    int64s num[ TICK_MAX_STAGES + 1 ] {}, den[ TICK_MAX_STAGES + 1 ] {}, next[ TICK_MAX_STAGES + 1 ] {};
+    int64s lcm_num = 1, gcd_den = 0, lcm_den = 1;
+
+    if( stages < 1 || stages > TICK_MAX_STAGES )
+    {
+        pattern.error = TICK_BAD_STAGES;
+        return pattern;
+    }
+
+    /////////////////////////////////////////////////////////////////
+    // the last domain is the byte clock of the timestamps
+    /////////////////////////////////////////////////////////////////
+    for( int32s n = 0; n <= stages; n++ )
+    {
+        clock_period_t period = n < stages ? periods[n] : BYTE_CLOCK;
+        if( period.num <= 0 || period.den <= 0 )
+        {
+            pattern.error = TICK_BAD_PERIOD;
+            return pattern;
+        }
+        int64s g = ClockGcd( period.num, period.den );
+        num[n]  = period.num / g;
+        den[n]  = period.den / g;
+        lcm_num = ClockLcm( lcm_num, num[n] );
+        gcd_den = ClockGcd( gcd_den, den[n] );
+        lcm_den = ClockLcm( lcm_den, den[n] );
+    }
+
+    /////////////////////////////////////////////////////////////////
+    // times in 1 / lcm_den byte clocks
+    /////////////////////////////////////////////////////////////////
+    int64s end = lcm_num * ( lcm_den / gcd_den );
+    for( int32s n = 0; n <= stages; n++ )
+    {
+        num[n] *= lcm_den / den[n];
+        next[n] = num[n];
+    }
+
+    pattern.hyper_num = lcm_num;
+    pattern.hyper_den = gcd_den;
+    for( int64s time = 0; time < end; )
+    {
+        time = end;
+        for( int32s n = 0; n <= stages; n++ )
+            time = next[n] < time ? next[n] : time;
+
+        if( pattern.slots == MAX_SLOTS )
+        {
+            pattern.error = TICK_TOO_LONG;
+            return pattern;
+        }
+
+        int32u slot = 0;
+        for( int32s n = 0; n <= stages; n++ )
+        {
+            if( next[n] != time )
+                continue;
+            slot    |= n < stages ? 1u << n : TICK_TIMESTAMP;
+            next[n] += num[n];
+        }
+        if( slot & ( 1u << ( stages - 1 )))
+        {
+            slot |= TICK_END_OF_STEP;
+            pattern.step_start[ ++pattern.steps ] = pattern.slots + 1;
+        }
+        pattern.slot[ pattern.slots++ ] = slot;
+    }
+    pattern.error = TICK_OK;
+    return pattern;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Pattern built at run time and replayed slot by slot
+/////////////////////////////////////////////////////////////////////
+class tick_schedule_t
+{
+    public:
+        static const int32s MAX_SLOTS = 4096;
+
+    private:
+        typedef tick_pattern_t< MAX_SLOTS > pattern_t;
+
+        pattern_t*  pattern;
+        int32s      cursor;
+
+    public:
+        tick_schedule_t()   { this->pattern = NULL; this->cursor = 0; }
+        ~tick_schedule_t()  { delete this->pattern; }
+
+        /////////////////////////////////////////////////////////////
+        // false if the pattern cannot be built
+        /////////////////////////////////////////////////////////////
+        bool Build( const std::vector< clock_period_t >& periods )
+        {
+            delete this->pattern;
+            this->pattern = new pattern_t( BuildTickPattern< MAX_SLOTS >( periods.data(), (int32s)periods.size() ));
+            this->cursor  = 0;
+
+            switch( this->pattern->error )
+            {
+                case TICK_OK:           return true;
+                case TICK_BAD_STAGES:   std::cerr << "Tick schedule: 1 to " << TICK_MAX_STAGES << " stages are supported" << std::endl; break;
+                case TICK_BAD_PERIOD:   std::cerr << "Tick schedule: invalid clock period" << std::endl; break;
+                case TICK_TOO_LONG:     std::cerr << "Tick schedule: more than " << MAX_SLOTS << " ticks per hyperperiod" << std::endl; break;
+            }
+            return false;
+        }
+
+        /////////////////////////////////////////////////////////////
+        // Continue at the given step, e.g. after resuming from a
+        // checkpoint
+        /////////////////////////////////////////////////////////////
+        void Seek( int64u step )
+        {
+            this->cursor = this->pattern->step_start[ step % this->pattern->steps ];
+        }
+
+        inline int32u Next( void )
+        {
+            int32u slot = this->pattern->slot[ this->cursor ];
+            if( ++this->cursor == this->pattern->slots )
+                this->cursor = 0;
+            return slot;
+        }
+};
+
+#endif // _SIM_CLOCK_H_INCLUDED_
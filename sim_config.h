@@ -12,12 +12,15 @@
 #define _SIMULATION_H_INCLUDED_ 
 
 #include <time.h>
+#include <thread>
 
 ///////////////////////////////////////////////////////////
 //  Output options
 ///////////////////////////////////////////////////////////
 //#define STOP_ON_WARNING
 
+#define ASYNC_OUTPUT                // write all streams from a background thread (see sim_async.h)
+
 //#define WARNING_OUTPUT_FILE 
 #define WARNING_OUTPUT_SCREEN
 
@@ -27,21 +30,37 @@
 #define INFORMATION_OUTPUT_FILE 
 #define INFORMATION_OUTPUT_SCREEN
 
-#define RESULT_1_OUTPUT_FILE 
+//#define RESULT_1_OUTPUT_FILE 
 //#define RESULT_1_OUTPUT_SCREEN
+#define RESULT_1_OUTPUT_BINARY      // per-frame records in binary blocks (see sim_binary.h)
+#define RESULT_1_BINARY_COMPRESS    // compress binary blocks with delta/varint codec
 
 #define RESULT_2_OUTPUT_FILE 
 //#define RESULT_2_OUTPUT_SCREEN
 
 #define SHOW_64B_PACKETS_ONLY
 
+#define PROBE_INTERVAL 1            // record delays of every nth frame only, of the shown size (see FSM_base.h)
+
 #define SHOW_HISTOGRAM
 
+//#define DELAY_QUANTILE_SKETCH     // constant-memory KLL sketch instead of per-stage histograms
+
 //#define CHECK_DOWNSTREAM
 #define CHECK_UPSTREAM
+//#define STAGE_GRAPH               // build the data path from the -graph stage list (see sim_graph.h)
+
+#define MII_WIDTH 1                 // upstream columns per MII transfer: 1 = 25GMII, 2 = 50GMII, 4 = 100GMII
+//#define BIT_ERROR_INJECTION       // -ber: errors between 25GMII TX and RX (see FSM_BER.h)
 
 //#define SPARSE_TRAFFIC
 
+#define CONVERGENCE_STOP            // stop when delay statistics converge (see data_path.h)
+#define WARMUP_DETECTION            // exclude warm-up transient from statistics (MSER-5)
+
+//#define PROFILE_STAGES            // sampled run time per FSM stage in INFO output (see sim_profile.h)
+#define METRICS_EXPORT              // JSON and Prometheus metrics files, periodically and at the end (see sim_metrics.h)
+
 //#define DEBUG_ENABLE_RS_TX_RX
 //#define DEBUG_ENABLE_RS_TX_TX
 //#define DEBUG_ENABLE_DATA_PATH_1
@@ -52,7 +71,12 @@
 
 
 #include "sim_output.h"
+#include "sim_options.h"
+#include "sim_binary.h"
 #include "data_path.h"
+#include "sim_bench.h"
+#include "sim_analytic.h"
+#include "sim_hybrid.h"
 
 
 
@@ -66,22 +90,49 @@ int Simulation( int, char* [] )
 {
 	//////////////////////////////////////////////////////////////////
     // Seed the random-number generator with the current time so that
-    // the numbers will be different every time we run.
+    // the numbers will be different every time we run, unless a
+    // seed was given on the command line.
 	//////////////////////////////////////////////////////////////////
-    srand( (unsigned)time( NULL ) );
+    SimSrand( SimOptions.seed_given ? SimOptions.seed : (unsigned)time( NULL ) );
 
     ////////////////////////////////////////////////////////////
     // Run simulation
     ////////////////////////////////////////////////////////////
-#ifdef CHECK_DOWNSTREAM
+#if defined( STAGE_GRAPH )
     ClearStats();
-    DownstreamTiming();
-#endif
+    if( !GraphTiming() )
+        return 1;
 
+#elif defined( CHECK_DOWNSTREAM ) && defined( CHECK_UPSTREAM )
+    ////////////////////////////////////////////////////////////
+    // both directions: downstream runs in a thread of its own,
+    // with its own clock, statistics and random sequence
+    ////////////////////////////////////////////////////////////
+    int32u downstream_seed = SimRandState() + 1;
+    std::thread downstream( [downstream_seed]()
+    {
+        SimSrand( downstream_seed );
+        ClearStats();
+        DownstreamTiming();
+    });
+
+    ClearStats();
+    if( SimOptions.hybrid_interval > 0 )
+        HybridTiming();
+    else
+        UpstreamTiming();
+    downstream.join();
+
+#elif defined( CHECK_DOWNSTREAM )
+    ClearStats();
+    DownstreamTiming();
 
-#ifdef CHECK_UPSTREAM
+#elif defined( CHECK_UPSTREAM )
     ClearStats();
-    UpstreamTiming();
+    if( SimOptions.hybrid_interval > 0 )
+        HybridTiming();
+    else
+        UpstreamTiming();
 #endif
 
     return 0;
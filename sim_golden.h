@@ -0,0 +1,254 @@
+/**********************************************************
+ * Filename:    sim_golden.h
+ *
+ * Description: Golden-result digests for checking that a
+ *              change to the simulator leaves the results
+ *              bit-exact.
+ *
+ *   MPRS_upstream -golden <digest> [<frames>]
+ *              runs the upstream path with a fixed seed and
+ *              writes the delays of every frame and all
+ *              per-stage histograms into a text digest.
+ *
+ *   MPRS_upstream -golden-diff <digest A> <digest B>
+ *              compares two digests and reports the first
+ *              diverging frame and stage, and every stage
+ *              whose histogram differs.
+ *
+ *********************************************************/
+
+#ifndef _SIM_GOLDEN_H_INCLUDED_
+#define _SIM_GOLDEN_H_INCLUDED_
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include "_types.h"
+
+using namespace std;
+
+const CHAR   GOLDEN_MAGIC[] = "MPRS golden digest v1";
+const int32u GOLDEN_SEED    = 1;
+
+/////////////////////////////////////////////////////////////////////
+// Digest writer. Frames are written as they leave the simulated
+// path; a hash over all frame lines is appended at the end, so two
+// identical runs are recognized without comparing line by line.
+/////////////////////////////////////////////////////////////////////
+class golden_digest_t
+{
+    private:
+        ofstream    file;
+        int64s      frames;
+        int64u      hash;
+
+        /////////////////////////////////////////////////////////////
+        // FNV-1a over the text of the frame lines
+        /////////////////////////////////////////////////////////////
+        inline void Hash( const string& text )
+        {
+            FOR_ALL( (int32s)text.size(), n )
+            {
+                this->hash ^= (BYTE)text[n];
+                this->hash *= 0x100000001B3ULL;
+            }
+        }
+
+    public:
+        golden_digest_t()
+        {
+            this->frames = 0;
+            this->hash   = 0xCBF29CE484222325ULL;
+        }
+
+        bool Open( const CHAR* file_name, int32u seed, int32s frame_limit, const CHAR* stage_names )
+        {
+            this->file.open( file_name, ios::out | ios::trunc );
+            if( !this->file.is_open() )
+                return false;
+
+            this->file << GOLDEN_MAGIC << endl;
+            this->file << "seed," << seed << endl;
+            this->file << "frames," << frame_limit << endl;
+            this->file << "stages," << stage_names << endl;
+            return true;
+        }
+
+        /////////////////////////////////////////////////////////////
+        // F,<frame>,<delivery clock>,<size>,<stage delays...>
+        // The timestamp of a frame is rewritten by every stage, so
+        // it holds the clock on which the last stage delivered it
+        /////////////////////////////////////////////////////////////
+        void AddFrame( const _frm_t& frame )
+        {
+            ostringstream line;
+            line << "F," << this->frames++ << "," << frame.GetTimestamp() << "," << frame.GetFrameSize();
+            FOR_ALL( DELAY_ARRAY_SIZE, n )
+                line << "," << frame.GetDelay( n );
+
+            Hash( line.str() );
+            this->file << line.str() << '\n';
+        }
+
+        /////////////////////////////////////////////////////////////
+        // H,<stage>,count,<n>,min,<min>,max,<max> followed by rows
+        // B,<stage>,<lowest value in bin or percentile>,<count or value>
+        /////////////////////////////////////////////////////////////
+        void AddHistogramHeader( const string& stage, stat_t count, stat_t min_val, stat_t max_val )
+        {
+            this->file << "H," << stage << ",count," << count << ",min," << min_val << ",max," << max_val << '\n';
+        }
+
+        void AddHistogramRow( const string& stage, stat_t key, stat_t value )
+        {
+            this->file << "B," << stage << "," << key << "," << value << '\n';
+        }
+
+        void Close( void )
+        {
+            this->file << "hash," << hex << this->hash << dec << endl;
+            this->file.close();
+        }
+};
+
+thread_local golden_digest_t* GoldenDigest = NULL;
+
+/////////////////////////////////////////////////////////////////////
+// Split a CSV line
+/////////////////////////////////////////////////////////////////////
+inline vector< string > GoldenFields( const string& line )
+{
+    vector< string > fields;
+    istringstream    in( line );
+    string           field;
+
+    while( getline( in, field, ',' ))
+        fields.push_back( field );
+    return fields;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Parsed digest: header lines, frame lines, histogram lines by stage
+/////////////////////////////////////////////////////////////////////
+struct golden_file_t
+{
+    vector< string >                    header;
+    vector< string >                    stages;
+    vector< string >                    frames;
+    map< string, vector< string > >     histograms;
+    string                              hash;
+
+    bool Load( const CHAR* file_name )
+    {
+        ifstream file( file_name );
+        string   line;
+
+        if( !getline( file, line ) || line != GOLDEN_MAGIC )
+            return false;
+
+        while( getline( file, line ))
+        {
+            if( line.compare( 0, 2, "F," ) == 0 )
+                this->frames.push_back( line );
+            else if( line.compare( 0, 2, "H," ) == 0 || line.compare( 0, 2, "B," ) == 0 )
+                this->histograms[ GoldenFields( line )[1] ].push_back( line );
+            else if( line.compare( 0, 5, "hash," ) == 0 )
+                this->hash = line.substr( 5 );
+            else
+            {
+                this->header.push_back( line );
+                if( line.compare( 0, 7, "stages," ) == 0 )
+                    this->stages = GoldenFields( line.substr( 7 ));
+            }
+        }
+        return true;
+    }
+};
+
+/////////////////////////////////////////////////////////////////////
+// Compare two digests; returns 0 if identical, 3 if they differ
+/////////////////////////////////////////////////////////////////////
+int CompareGoldenDigests( const CHAR* file_a, const CHAR* file_b )
+{
+    golden_file_t a, b;
+
+    if( !a.Load( file_a ) || !b.Load( file_b ))
+    {
+        cerr << "Cannot read digests " << file_a << " and " << file_b << endl;
+        return 1;
+    }
+
+    if( a.header != b.header )
+        cout << "Run parameters differ (seed, frames or stages)" << endl;
+
+    if( a.header == b.header && a.hash == b.hash && a.histograms == b.histograms )
+    {
+        cout << "Digests are identical: " << a.frames.size() << " frames, hash " << a.hash << endl;
+        return 0;
+    }
+
+    /////////////////////////////////////////////////////////////////
+    // per-frame delays: first diverging frame and stage
+    /////////////////////////////////////////////////////////////////
+    size_t common = MIN( a.frames.size(), b.frames.size() );
+    size_t diverging = 0;
+
+    for( size_t n = 0; n < common; n++ )
+    {
+        if( a.frames[n] == b.frames[n] )
+            continue;
+
+        if( diverging++ > 0 )
+            continue;
+
+        vector< string > fa = GoldenFields( a.frames[n] );
+        vector< string > fb = GoldenFields( b.frames[n] );
+        for( size_t f = 2; f < fa.size() && f < fb.size(); f++ )
+        {
+            if( fa[f] == fb[f] )
+                continue;
+
+            string what = f == 2 ? "delivery clock" : f == 3 ? "frame size" :
+                          f - 4 < a.stages.size() ? a.stages[ f - 4 ] + " delay" : "delay " + to_string( f - 4 );
+            cout << "First diverging frame: " << n << ", " << what << ": " << fa[f] << " vs. " << fb[f] << endl;
+            break;
+        }
+    }
+
+    if( diverging > 0 )
+        cout << "Diverging frames: " << diverging << " of " << common << endl;
+    if( a.frames.size() != b.frames.size() )
+        cout << "Frame count differs: " << a.frames.size() << " vs. " << b.frames.size() << endl;
+
+    /////////////////////////////////////////////////////////////////
+    // histograms: every differing stage and its first differing row
+    /////////////////////////////////////////////////////////////////
+    for( map< string, vector< string > >::const_iterator it = a.histograms.begin(); it != a.histograms.end(); ++it )
+    {
+        map< string, vector< string > >::const_iterator other = b.histograms.find( it->first );
+        if( other == b.histograms.end() )
+        {
+            cout << "Histogram " << it->first << " missing in " << file_b << endl;
+            continue;
+        }
+        if( other->second == it->second )
+            continue;
+
+        size_t rows = MIN( it->second.size(), other->second.size() ), r = 0;
+        while( r < rows && it->second[r] == other->second[r] )
+            r++;
+        cout << "Histogram " << it->first << " differs: "
+             << ( r < it->second.size() ? it->second[r] : "(end)" ) << " vs. "
+             << ( r < other->second.size() ? other->second[r] : "(end)" ) << endl;
+    }
+    for( map< string, vector< string > >::const_iterator it = b.histograms.begin(); it != b.histograms.end(); ++it )
+        if( a.histograms.find( it->first ) == a.histograms.end() )
+            cout << "Histogram " << it->first << " missing in " << file_a << endl;
+
+    return 3;
+}
+
+#endif // _SIM_GOLDEN_H_INCLUDED_
@@ -0,0 +1,553 @@
+/**********************************************************
+ * Filename:    sim_graph.h
+ *
+ * Description: Stage registry and pipeline builder. With
+ *              STAGE_GRAPH, the data path is built at run time
+ *              from a list of stage names, e.g.
+ *
+ *   MPRS_upstream -graph macc,mpcp_tx,mac_tx,rs_tx,25gmii_tx,25gmii_rx,mac_rx,mpcp_rx
+ *
+ *              Adapters between 36-bit columns, 72-bit vectors
+ *              and 66-bit blocks are inserted where needed. The
+ *              delay index of every stage is its position in
+ *              the list; the result columns follow the list.
+ *
+ *********************************************************/
+
+#ifndef _SIM_GRAPH_H_INCLUDED_
+#define _SIM_GRAPH_H_INCLUDED_
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <string.h>
+#include "_types.h"
+#include "sim_pipeline.h"
+
+using namespace std;
+
+int16s PacketSize(void);        // defined in data_path.h
+
+const CHAR STAGE_GRAPH_UPSTREAM[]   = "macc,mpcp_tx,mac_tx,rs_tx,25gmii_tx,25gmii_rx,mac_rx,mpcp_rx";
+const CHAR STAGE_GRAPH_DOWNSTREAM[] = "macc_olt,mpcp_tx_olt,mac_tx,idle_del,66b_encoder,scrambler,data_det,"
+                                      "fec_decoder,descrambler,66b_decoder,idle_ins,mac_rx,mpcp_rx";
+
+/////////////////////////////////////////////////////////////////////
+// Data units passed between stages
+/////////////////////////////////////////////////////////////////////
+enum graph_domain_t
+{
+    DOM_NONE,           // input of a traffic source
+    DOM_FRAME,
+    DOM_36B,
+    DOM_72B,
+    DOM_66B
+};
+
+const CHAR* const GRAPH_DOMAIN_NAME[] = { "none", "frames", "36-bit columns", "72-bit vectors", "66-bit blocks" };
+
+struct graph_unit_t
+{
+    _frm_t  frame;
+    _36b_t  column;
+    _72b_t  vector;
+    _66b_t  block;
+};
+
+template< class T > struct graph_domain_of;
+
+template<> struct graph_domain_of< _frm_t >
+{
+    static const graph_domain_t value = DOM_FRAME;
+    static inline _frm_t& Field( graph_unit_t& unit )   { return unit.frame; }
+};
+
+template<> struct graph_domain_of< _36b_t >
+{
+    static const graph_domain_t value = DOM_36B;
+    static inline _36b_t& Field( graph_unit_t& unit )   { return unit.column; }
+};
+
+template<> struct graph_domain_of< _72b_t >
+{
+    static const graph_domain_t value = DOM_72B;
+    static inline _72b_t& Field( graph_unit_t& unit )   { return unit.vector; }
+};
+
+template<> struct graph_domain_of< _66b_t >
+{
+    static const graph_domain_t value = DOM_66B;
+    static inline _66b_t& Field( graph_unit_t& unit )   { return unit.block; }
+};
+
+/////////////////////////////////////////////////////////////////////
+// A stage of the pipeline. A unit moves from a stage to the next one
+// when the next one Accepts() it and the stage is Ready(), on the
+// clock of the stage (sim_clock.h).
+/////////////////////////////////////////////////////////////////////
+class graph_stage_t
+{
+    public:
+        graph_domain_t  in_domain;
+        graph_domain_t  out_domain;
+        clock_period_t  clock;
+        int32s          delay_ndx;      // -1 for adapters
+
+        graph_stage_t()             { this->delay_ndx = -1; this->clock = BYTE_CLOCK; }
+        virtual ~graph_stage_t()    {}
+
+        virtual void Tick( void )                       {}      // byte clock
+        virtual bool Accepts( void )                    { return true; }
+        virtual bool Ready( void )                      = 0;
+        virtual void Put( graph_unit_t& unit )          = 0;
+        virtual void Get( graph_unit_t& unit )          = 0;
+
+        /////////////////////////////////////////////////////////////
+        // A new frame left the traffic source
+        /////////////////////////////////////////////////////////////
+        virtual void FrameAdmitted( graph_stage_t& )    {}
+        virtual bool GrantStart( void )                 { return false; }
+};
+
+/////////////////////////////////////////////////////////////////////
+// Any FSM derived from fsm_base_t; the rules of the stage come from
+// stage_traits_t (sim_pipeline.h)
+/////////////////////////////////////////////////////////////////////
+template< class fsm_t > class graph_fsm_stage_t: public graph_stage_t
+{
+    public:
+        typedef typename fsm_t::input_t     in_t;
+        typedef typename fsm_t::output_t    out_t;
+        typedef stage_traits_t< fsm_t >     traits_t;
+        typedef stage_dispatch_t< fsm_t >   dispatch_t;
+
+        static const graph_domain_t IN  = traits_t::source ? DOM_NONE : graph_domain_of< in_t >::value;
+        static const graph_domain_t OUT = graph_domain_of< out_t >::value;
+
+    protected:
+        fsm_t   fsm;
+
+    public:
+        graph_fsm_stage_t()
+        {
+            this->in_domain  = IN;
+            this->out_domain = OUT;
+            this->clock      = traits_t::clock;
+        }
+
+        template< class arg_t > explicit graph_fsm_stage_t( arg_t arg ): fsm( arg )
+        {
+            this->in_domain  = IN;
+            this->out_domain = OUT;
+            this->clock      = traits_t::clock;
+        }
+
+        virtual void Tick( void )                   { traits_t::Tick( this->fsm ); }
+        virtual bool Accepts( void )                { return traits_t::Accepts( this->fsm ); }
+        virtual bool Ready( void )                  { return traits_t::Ready( this->fsm ); }
+        virtual void Put( graph_unit_t& unit )      { dispatch_t::Put( this->fsm, graph_domain_of< in_t >::Field( unit )); }
+        virtual void Get( graph_unit_t& unit )
+        {
+            out_t& out = graph_domain_of< out_t >::Field( unit );
+            out = dispatch_t::Get( this->fsm, this->delay_ndx );
+            traits_t::Transmitted( this->fsm, out );
+        }
+
+        virtual void FrameAdmitted( graph_stage_t& source )     { traits_t::FrameAdmitted( this->fsm, source.GrantStart() ); }
+        virtual bool GrantStart( void )                         { return traits_t::GrantStart( this->fsm ); }
+};
+
+/////////////////////////////////////////////////////////////////////
+// Adapters between the column, vector and block domains. Adapters
+// do not measure delay.
+/////////////////////////////////////////////////////////////////////
+class graph_pack_36b_t: public graph_stage_t      // 2 columns -> vector
+{
+    private:
+        _72b_t  vector;
+        int32s  columns;
+
+    public:
+        graph_pack_36b_t()                      { this->in_domain = DOM_36B; this->out_domain = DOM_72B; this->clock = VECTOR_CLOCK; this->columns = 0; }
+
+        virtual bool Accepts( void )            { return this->columns < 2; }
+        virtual bool Ready( void )              { return this->columns == 2; }
+        virtual void Put( graph_unit_t& unit )  { this->vector[ this->columns++ ] = unit.column; }
+        virtual void Get( graph_unit_t& unit )  { unit.vector = this->vector; this->columns = 0; }
+};
+
+class graph_unpack_72b_t: public graph_stage_t    // vector -> 2 columns
+{
+    private:
+        _72b_t  vector;
+        int32s  next;
+
+    public:
+        graph_unpack_72b_t()                    { this->in_domain = DOM_72B; this->out_domain = DOM_36B; this->clock = COLUMN_CLOCK; this->next = 2; }
+
+        virtual bool Accepts( void )            { return this->next == 2; }
+        virtual bool Ready( void )              { return this->next < 2; }
+        virtual void Put( graph_unit_t& unit )  { this->vector = unit.vector; this->next = 0; }
+        virtual void Get( graph_unit_t& unit )  { unit.column = this->vector[ this->next++ ]; }
+};
+
+class graph_72b_to_66b_t: public graph_stage_t
+{
+    private:
+        _66b_t  block;
+        bool    ready;
+
+    public:
+        graph_72b_to_66b_t()                    { this->in_domain = DOM_72B; this->out_domain = DOM_66B; this->clock = VECTOR_CLOCK; this->ready = false; }
+
+        virtual bool Accepts( void )            { return !this->ready; }
+        virtual bool Ready( void )              { return this->ready; }
+        virtual void Put( graph_unit_t& unit )  { this->block = _66b_t( unit.vector ); this->ready = true; }
+        virtual void Get( graph_unit_t& unit )  { unit.block = this->block; this->ready = false; }
+};
+
+class graph_66b_to_72b_t: public graph_stage_t
+{
+    private:
+        _72b_t  vector;
+        bool    ready;
+
+    public:
+        graph_66b_to_72b_t()                    { this->in_domain = DOM_66B; this->out_domain = DOM_72B; this->clock = VECTOR_CLOCK; this->ready = false; }
+
+        virtual bool Accepts( void )            { return !this->ready; }
+        virtual bool Ready( void )              { return this->ready; }
+        virtual void Put( graph_unit_t& unit )  { this->vector = static_cast< _72b_t >( unit.block ); this->ready = true; }
+        virtual void Get( graph_unit_t& unit )  { unit.vector = this->vector; this->ready = false; }
+};
+
+typedef graph_fsm_stage_t< fsm_ngepon_macc_t< PacketSize > > graph_macc_stage_t;
+typedef graph_fsm_stage_t< fsm_ngepon_mpcp_tx_t >             graph_mpcp_tx_stage_t;
+typedef graph_fsm_stage_t< fsm_ngepon_mac_tx_t< > >           graph_mac_tx_stage_t;
+typedef graph_fsm_stage_t< fsm_ngepon_rs_tx_t< > >            graph_rs_tx_stage_t;
+typedef graph_fsm_stage_t< fsm_ngepon_25gmii_tx_t< > >        graph_25gmii_tx_stage_t;
+typedef graph_fsm_stage_t< fsm_bit_error_t< > >               graph_bit_error_stage_t;
+typedef graph_fsm_stage_t< fsm_ngepon_25gmii_rx_t< > >        graph_25gmii_rx_stage_t;
+typedef graph_fsm_stage_t< fsm_ngepon_mac_rx_t< > >           graph_mac_rx_stage_t;
+typedef graph_fsm_stage_t< fsm_ngepon_mpcp_rx_t >             graph_mpcp_rx_stage_t;
+typedef graph_fsm_stage_t< fsm_olt_idle_deletion_t >          graph_olt_idle_del_stage_t;
+typedef graph_fsm_stage_t< fsm_onu_idle_deletion_t >          graph_onu_idle_del_stage_t;
+typedef graph_fsm_stage_t< fsm_64b66b_encoder_t >             graph_encoder_stage_t;
+typedef graph_fsm_stage_t< fsm_scrambler_t >                  graph_scrambler_stage_t;
+typedef graph_fsm_stage_t< fsm_olt_data_detector_t >          graph_olt_data_det_stage_t;
+typedef graph_fsm_stage_t< fsm_onu_data_detector_t >          graph_onu_data_det_stage_t;
+typedef graph_fsm_stage_t< fsm_fec_decoder_t >                graph_fec_decoder_stage_t;
+typedef graph_fsm_stage_t< fsm_descrambler_t >                graph_descrambler_stage_t;
+typedef graph_fsm_stage_t< fsm_66b64b_decoder_t >             graph_decoder_stage_t;
+typedef graph_fsm_stage_t< fsm_idle_insertion_t >             graph_idle_ins_stage_t;
+
+/////////////////////////////////////////////////////////////////////
+// Stage registry
+/////////////////////////////////////////////////////////////////////
+struct graph_stage_info_t
+{
+    const CHAR*     name;           // name in the -graph list
+    const CHAR*     column;         // column name in the delay tables
+    graph_domain_t  in_domain;
+    graph_domain_t  out_domain;
+    graph_stage_t*  (*create)( void );
+};
+
+template< class stage_t > graph_stage_t* CreateStage( void )        { return new stage_t; }
+inline graph_stage_t* CreateMaccOnu( void )                         { return new graph_macc_stage_t( true ); }
+inline graph_stage_t* CreateMaccOlt( void )                         { return new graph_macc_stage_t( false ); }
+inline graph_stage_t* CreateMpcpTx( void )                          { return new graph_mpcp_tx_stage_t( false ); }
+inline graph_stage_t* CreateMpcpTxOlt( void )                       { return new graph_mpcp_tx_stage_t( true ); }
+
+#define GRAPH_STAGE( name, column, stage_t, create )    { name, column, stage_t::IN, stage_t::OUT, create }
+#define GRAPH_FSM( name, column, stage_t )              GRAPH_STAGE( name, column, stage_t, &CreateStage< stage_t > )
+
+//////////////////////////////////////////////////////////////////////
+// RS RX is a stub that drops all data and is therefore not registered
+//////////////////////////////////////////////////////////////////////
+const graph_stage_info_t GRAPH_STAGES[] =
+{
+    GRAPH_STAGE( "macc",        "CLIENT",       graph_macc_stage_t,     &CreateMaccOnu ),   // burst mode (ONU)
+    GRAPH_STAGE( "macc_olt",    "CLIENT",       graph_macc_stage_t,     &CreateMaccOlt ),   // continuous (OLT)
+    GRAPH_STAGE( "mpcp_tx",     "MPCP_TX",      graph_mpcp_tx_stage_t,  &CreateMpcpTx ),
+    GRAPH_STAGE( "mpcp_tx_olt", "MPCP_TX",      graph_mpcp_tx_stage_t,  &CreateMpcpTxOlt ), // leaves room for FEC parity
+    GRAPH_FSM  ( "mac_tx",      "MAC_TX",       graph_mac_tx_stage_t ),
+    GRAPH_FSM  ( "rs_tx",       "RS_TX",        graph_rs_tx_stage_t ),
+    GRAPH_FSM  ( "25gmii_tx",   "25GMII_TX",    graph_25gmii_tx_stage_t ),
+    GRAPH_FSM  ( "bit_errors",  "BIT_ERRORS",   graph_bit_error_stage_t ),     // see FSM_BER.h
+    GRAPH_FSM  ( "25gmii_rx",   "25GMII_RX",    graph_25gmii_rx_stage_t ),
+    GRAPH_FSM  ( "mac_rx",      "MAC_RX",       graph_mac_rx_stage_t ),
+    GRAPH_FSM  ( "mpcp_rx",     "MPCP_RX",      graph_mpcp_rx_stage_t ),
+    GRAPH_FSM  ( "idle_del",    "IDLE_DEL",     graph_olt_idle_del_stage_t ),
+    GRAPH_FSM  ( "onu_idle_del","IDLE_DEL",     graph_onu_idle_del_stage_t ),
+    GRAPH_FSM  ( "66b_encoder", "66B_ENCODER",  graph_encoder_stage_t ),
+    GRAPH_FSM  ( "scrambler",   "SCRAMBLER",    graph_scrambler_stage_t ),
+    GRAPH_FSM  ( "data_det",    "DATA_DET",     graph_olt_data_det_stage_t ),
+    GRAPH_FSM  ( "onu_data_det","DATA_DET",     graph_onu_data_det_stage_t ),
+    GRAPH_FSM  ( "fec_decoder", "FEC_DECODER",  graph_fec_decoder_stage_t ),
+    GRAPH_FSM  ( "descrambler", "DESCRAMBLER",  graph_descrambler_stage_t ),
+    GRAPH_FSM  ( "66b_decoder", "66B_DECODER",  graph_decoder_stage_t ),
+    GRAPH_FSM  ( "idle_ins",    "IDLE_INS",     graph_idle_ins_stage_t ),
+};
+
+const int32s GRAPH_STAGE_COUNT = sizeof( GRAPH_STAGES ) / sizeof( GRAPH_STAGES[0] );
+
+/////////////////////////////////////////////////////////////////////
+// Stage list, checked against the registry. The delay table columns
+// and the first stage counted in TOTAL are derived from it.
+/////////////////////////////////////////////////////////////////////
+class stage_graph_spec_t
+{
+    private:
+        vector< int32s >    stages;         // indices into GRAPH_STAGES
+        string              list;           // the stage list, shorthands expanded
+        string              header;
+        int32s              total_from;
+
+        /////////////////////////////////////////////////////////////
+        // Adapters needed between two domains; false if none exist
+        /////////////////////////////////////////////////////////////
+        static bool Adapters( graph_domain_t from, graph_domain_t to, vector< graph_stage_t* >* chain )
+        {
+            if( from == to )
+                return true;
+            if( from == DOM_FRAME || to == DOM_FRAME || from == DOM_NONE || to == DOM_NONE )
+                return false;
+            if( chain == NULL )
+                return true;
+
+            if( from == DOM_36B )   chain->push_back( new graph_pack_36b_t );
+            if( from == DOM_66B )   chain->push_back( new graph_66b_to_72b_t );
+            if( to   == DOM_66B )   chain->push_back( new graph_72b_to_66b_t );
+            if( to   == DOM_36B )   chain->push_back( new graph_unpack_72b_t );
+            return true;
+        }
+
+    public:
+        stage_graph_spec_t()    { Parse( STAGE_GRAPH_UPSTREAM ); }
+
+        /////////////////////////////////////////////////////////////
+        // Parse a comma-separated list of stage names, or one of
+        // the shorthands "upstream" and "downstream"; on error,
+        // the previous list is kept
+        /////////////////////////////////////////////////////////////
+        bool Parse( const CHAR* list )
+        {
+            if( strcmp( list, "upstream" ) == 0 )
+                list = STAGE_GRAPH_UPSTREAM;
+            else if( strcmp( list, "downstream" ) == 0 )
+                list = STAGE_GRAPH_DOWNSTREAM;
+
+            vector< int32s > parsed;
+            string           text( list ), name;
+            size_t           start = 0;
+
+            while( start <= text.size() )
+            {
+                size_t end = text.find( ',', start );
+                if( end == string::npos )
+                    end = text.size();
+                name  = text.substr( start, end - start );
+                start = end + 1;
+
+                int32s ndx = 0;
+                while( ndx < GRAPH_STAGE_COUNT && name != GRAPH_STAGES[ ndx ].name )
+                    ndx++;
+                if( ndx == GRAPH_STAGE_COUNT )
+                {
+                    cerr << "Unknown stage '" << name << "'. Stages:";
+                    FOR_ALL( GRAPH_STAGE_COUNT, n )
+                        cerr << " " << GRAPH_STAGES[n].name;
+                    cerr << endl;
+                    return false;
+                }
+                parsed.push_back( ndx );
+            }
+
+            if( (int32s)parsed.size() > DELAY_ARRAY_SIZE )
+            {
+                cerr << "Too many stages: " << parsed.size() << " (at most " << DELAY_ARRAY_SIZE << ")" << endl;
+                return false;
+            }
+
+            for( size_t n = 0; n < parsed.size(); n++ )
+            {
+                const graph_stage_info_t& stage = GRAPH_STAGES[ parsed[n] ];
+                if(( n == 0 ) != ( stage.in_domain == DOM_NONE ))
+                {
+                    cerr << "Stage '" << stage.name << "': " << ( n == 0 ? "the first stage must be a traffic source" : "a traffic source must come first" ) << endl;
+                    return false;
+                }
+                if( n > 0 && !Adapters( GRAPH_STAGES[ parsed[ n - 1 ]].out_domain, stage.in_domain, NULL ))
+                {
+                    cerr << "Cannot connect '" << GRAPH_STAGES[ parsed[ n - 1 ]].name << "' (" << GRAPH_DOMAIN_NAME[ GRAPH_STAGES[ parsed[ n - 1 ]].out_domain ]
+                         << ") to '" << stage.name << "' (" << GRAPH_DOMAIN_NAME[ stage.in_domain ] << ")" << endl;
+                    return false;
+                }
+            }
+            if( GRAPH_STAGES[ parsed.back() ].out_domain != DOM_FRAME )
+            {
+                cerr << "The last stage must deliver frames" << endl;
+                return false;
+            }
+
+            /////////////////////////////////////////////////////////
+            // delay columns; TOTAL starts at the first stage that
+            // does not deliver frames (the MAC)
+            /////////////////////////////////////////////////////////
+            this->stages     = parsed;
+            this->list       = text;
+            this->header     = "";
+            this->total_from = 0;
+            FOR_ALL( DELAY_ARRAY_SIZE, n )
+            {
+                this->header += n < (int32s)parsed.size() ? GRAPH_STAGES[ parsed[n] ].column : "UNUSED";
+                this->header += ",";
+            }
+            this->header += "TOTAL";
+
+            while( this->total_from < (int32s)parsed.size() - 1 && GRAPH_STAGES[ parsed[ this->total_from ]].out_domain == DOM_FRAME )
+                this->total_from++;
+            return true;
+        }
+
+        inline const CHAR*  List( void )        const { return this->list.c_str(); }
+        inline const CHAR*  Header( void )      const { return this->header.c_str(); }
+        inline int32s       TotalFrom( void )   const { return this->total_from; }
+
+        /////////////////////////////////////////////////////////////
+        // Result columns: the listed stages only
+        /////////////////////////////////////////////////////////////
+        result_columns_t Columns( void ) const
+        {
+            result_columns_t columns;
+            FOR_ALL( (int32s)this->stages.size(), n )
+            {
+                columns.header += GRAPH_STAGES[ this->stages[n] ].column;
+                columns.header += ",";
+                columns.delay.push_back( (int16s)n );
+            }
+            columns.header    += "TOTAL";
+            columns.total_from = this->total_from;
+            return columns;
+        }
+
+        /////////////////////////////////////////////////////////////
+        // Instantiate the stages and the adapters between them
+        /////////////////////////////////////////////////////////////
+        void Build( vector< graph_stage_t* >& chain ) const
+        {
+            for( size_t n = 0; n < this->stages.size(); n++ )
+            {
+                const graph_stage_info_t& info = GRAPH_STAGES[ this->stages[n] ];
+                if( n > 0 )
+                    Adapters( chain.back()->out_domain, info.in_domain, &chain );
+
+                chain.push_back( info.create() );
+                chain.back()->delay_ndx = (int32s)n;
+            }
+        }
+};
+
+stage_graph_spec_t StageGraph;
+
+/////////////////////////////////////////////////////////////////////
+// The pipeline. Step() replays the tick schedule up to the next tick
+// of the last stage, like pipeline_t (sim_pipeline.h). Stages in 
+// front of the MAC move frames; a frame leaves the source only if 
+// all of them can take it. At the same instant, stages move units 
+// in order, so a unit may pass several stages in one step.
+/////////////////////////////////////////////////////////////////////
+class stage_graph_t
+{
+    private:
+        vector< graph_stage_t* >    chain;
+        int32s                      byte_stages;    // leading stages moving frames
+        tick_schedule_t             schedule;
+        bool                        scheduled;
+        graph_unit_t                unit;
+
+        /////////////////////////////////////////////////////////////
+        // move a unit from stage ndx into the next one, or into the
+        // sink after the last stage; true if a frame was delivered
+        /////////////////////////////////////////////////////////////
+        inline bool Transfer( int32s ndx )
+        {
+            graph_stage_t* stage = this->chain[ ndx ];
+            graph_stage_t* next  = ndx + 1 < (int32s)this->chain.size() ? this->chain[ ndx + 1 ] : NULL;
+
+            if( next != NULL && !next->Accepts() )
+                return false;
+            if( !stage->Ready() )
+                return false;
+            /////////////////////////////////////////////////////////
+            // in front of the MAC, a frame moves only if all stages 
+            // up to and including the MAC can take it
+            /////////////////////////////////////////////////////////
+            for( int32s n = ndx + 2; ndx < this->byte_stages && n <= this->byte_stages && n < (int32s)this->chain.size(); n++ )
+                if( !this->chain[n]->Accepts() )
+                    return false;
+
+            stage->Get( this->unit );
+            if( next == NULL )
+                return true;
+
+            next->Put( this->unit );
+            if( ndx == 0 )
+                FOR_ALL( (int32s)this->chain.size(), n )
+                    this->chain[n]->FrameAdmitted( *stage );
+            return false;
+        }
+
+    public:
+        stage_graph_t( const stage_graph_spec_t& spec )
+        {
+            vector< clock_period_t > periods;
+
+            spec.Build( this->chain );
+            this->byte_stages  = 0;
+            while( this->byte_stages < (int32s)this->chain.size() && this->chain[ this->byte_stages ]->out_domain == DOM_FRAME )
+                this->byte_stages++;
+
+            FOR_ALL( (int32s)this->chain.size(), n )
+                periods.push_back( this->chain[n]->clock );
+            this->scheduled = this->schedule.Build( periods );
+        }
+
+        ~stage_graph_t()
+        {
+            FOR_ALL( (int32s)this->chain.size(), n )
+                delete this->chain[n];
+        }
+
+        /////////////////////////////////////////////////////////////
+        // false if the stage clocks cannot be scheduled; the graph
+        // must not be stepped then
+        /////////////////////////////////////////////////////////////
+        inline bool Scheduled( void ) const { return this->scheduled; }
+
+        /////////////////////////////////////////////////////////////
+        // One step; frames leaving the last stage go to sink()
+        /////////////////////////////////////////////////////////////
+        template< class sink_t > void Step( sink_t& sink )
+        {
+            int32s stages = (int32s)this->chain.size();
+            int32u slot;
+
+            do
+            {
+                slot = this->schedule.Next();
+                if( slot & TICK_TIMESTAMP )
+                    timestamp_t::IncrementClock();
+                FOR_ALL( stages, n )
+                    if( slot & ( 1u << n ))
+                        this->chain[n]->Tick();
+                FOR_ALL( stages, n )
+                    if(( slot & ( 1u << n )) && Transfer( n ))
+                        sink( this->unit.frame );
+            }
+            while(( slot & TICK_END_OF_STEP ) == 0 );
+        }
+};
+
+#endif // _SIM_GRAPH_H_INCLUDED_
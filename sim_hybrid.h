@@ -0,0 +1,197 @@
+/**********************************************************
+ * Filename:    sim_hybrid.h
+ *
+ * Description: Hybrid simulation of the upstream path for
+ *              long runs, started with
+ *
+ *   MPRS_upstream [prefix] -hybrid <frames> [-seed <n>]
+ *
+ *              Probe frames are selected at random, on average
+ *              one in <frames>. Between them, the traffic is
+ *              advanced by a frame-level model (the admission
+ *              timing of sim_analytic.h): packet sizes are drawn
+ *              as in the MAC Client and the clock moves by the
+ *              time the frame takes to get through MPCP and
+ *              MAC TX. Around every probe frame, all state
+ *              machines are simulated column by column from an
+ *              empty upstream path: the frames of a short warm-up
+ *              are counted for the throughput only and the first
+ *              frame after it that goes into the statistics is
+ *              the probe. The delay statistics thus describe a
+ *              run of <frames> times as many frames as there are
+ *              probes, at the cost of about HYBRID_WARMUP_FRAMES
+ *              simulated frames per probe. Throughput is that of
+ *              the frame-level model for most of the run.
+ *
+ *********************************************************/
+
+#ifndef _SIM_HYBRID_H_INCLUDED_
+#define _SIM_HYBRID_H_INCLUDED_
+
+#include <math.h>
+#include "_types.h"
+
+/////////////////////////////////////////////////////////////////////
+// Frames simulated before the probe frame of a window: a fixed part,
+// long enough for the RS TX codeword buffer to lose the phase it
+// starts with, plus up to BURST_FRAMES - 1 more so that probe frames
+// fall on every position of a burst
+/////////////////////////////////////////////////////////////////////
+const int32s HYBRID_WARMUP_FRAMES = 2 * BURST_FRAMES;
+
+/////////////////////////////////////////////////////////////////////
+// Frame-level model of the MAC Client, MPCP TX and MAC TX: frames of
+// a burst leave as fast as MAC TX gets their columns and IPG through
+// RS TX, or as MPCP lets them (frame + tail guard); the last frame
+// of a burst is followed by the burst gap
+/////////////////////////////////////////////////////////////////////
+class hybrid_frame_model_t
+{
+    private:
+
+        DOUBLE  column_time;        // byte times per MAC TX column
+        DOUBLE  ipg_columns;        // mean IPG columns after a frame
+        DOUBLE  residue;            // fraction of a byte time not yet added to the clock
+        int32s  burst_frame;        // frames of the current burst so far
+
+    public:
+
+        hybrid_frame_model_t()
+        {
+            this->column_time = COLUMN_BYTES;
+            this->ipg_columns = MIN_IPG_BYTES / COLUMN_BYTES;
+            this->residue     = 0;
+            this->burst_frame = 0;
+        }
+
+        bool Init( void )
+        {
+            analytic_model_t model;
+            return model.FrameTiming( analytic_params_t(), this->column_time, this->ipg_columns );
+        }
+
+        /////////////////////////////////////////////////////////////
+        // one frame; returns its size including preamble
+        /////////////////////////////////////////////////////////////
+        inline int16s Advance( void )
+        {
+            int16s size = PacketSize();
+            DOUBLE time = size - E_HEADER_BYTES - CHECKSUM_BYTES + TAIL_GUARD;
+
+#ifdef SPARSE_TRAFFIC
+            time += (int16s)(( SimRand() * FEC_CODEWORD_BYTES ) / SIM_RAND_MAX );
+#endif
+            if( ++this->burst_frame < BURST_FRAMES )
+                time = MAX( time, this->column_time * ( BLK_ROUNDUP( size + PREAMBLE_BYTES, COLUMN_BYTES ) + this->ipg_columns ));
+            else
+            {
+                time += BURST_GAP_BYTES;
+                this->burst_frame = 0;
+            }
+
+            this->residue += time;
+            clk_t whole = (clk_t)this->residue;
+            this->residue -= whole;
+            timestamp_t::ResetClock( timestamp_t::GetClock() + whole );
+            return size + PREAMBLE_BYTES;
+        }
+};
+
+/////////////////////////////////////////////////////////////////////
+// Frames between two probe frames: geometric with the given mean
+/////////////////////////////////////////////////////////////////////
+inline int64s HybridProbeGap( int32s mean )
+{
+    if( mean <= 1 )
+        return 0;
+
+    DOUBLE u = ( SimRand() + 0.5 ) / ( SIM_RAND_MAX + 1.0 );
+    return (int64s)( log( u ) / log( 1.0 - 1.0 / mean ));
+}
+
+/////////////////////////////////////////////////////////////////////
+// Cycle-accurate window: all state machines from an empty upstream
+// path until the probe frame leaves MPCP RX. Frames still on their
+// way are dropped with the window. Returns the simulated frames.
+/////////////////////////////////////////////////////////////////////
+int32s RunProbeWindow( upstream_context_t& ctx, int32s warmup_frames )
+{
+    upstream_pipeline_t pipeline = UpstreamPipeline(ctx);
+
+    bool done = false;
+    auto sink = [&](const _frm_t& frame)
+    {
+        if (done)
+            return;
+
+        /////////////////////////////////////////////////////////////
+        // the probe is the first frame after the warm-up that goes
+        // into the statistics (e.g. with SHOW_64B_PACKETS_ONLY)
+        /////////////////////////////////////////////////////////////
+        if (ctx.frame_count++ < warmup_frames)
+            frame_bytes += frame.GetFrameSize();
+        else
+        {
+            PROFILE_SCOPE(PRF_STATS);
+            done = CollectStats(frame);
+        }
+    };
+
+    while (!done)
+    {
+        PROFILE_COLUMN();
+        ctx.VectorCount36b++;
+        pipeline.Step(sink);
+    }
+    return ctx.frame_count;
+}
+
+/////////////////////////////////////////////////////////////////////
+// void HybridTiming(void)
+// Counterpart of UpstreamTiming() for -hybrid
+/////////////////////////////////////////////////////////////////////
+void HybridTiming(void)
+{
+    hybrid_frame_model_t model;
+    if (MII_WIDTH != 1 || !model.Init())
+    {
+        MSG_WARN("Hybrid simulation needs MII_WIDTH 1 and parameters within the analytic model; running the full simulation");
+        UpstreamTiming();
+        return;
+    }
+    if (SimOptions.resume_file != NULL || SimOptions.checkpoint_interval > 0)
+        MSG_WARN("Checkpoints are not supported in hybrid simulation");
+
+#ifdef CHECK_DOWNSTREAM
+    StatsDirection = "Upstream";
+#endif
+    ResultColumns = DirectionColumns(false);
+    MSG_OUT1("Frame size,," << ResultColumns.header << endl);
+
+    int32s  probes = 0;
+    int64s  model_frames = 0, simulated_frames = 0;
+
+    PROFILE_START();
+    while (!SimulationDone(probes))
+    {
+        int64s gap = HybridProbeGap(SimOptions.hybrid_interval);
+        for (int64s n = 0; n < gap; n++)
+            frame_bytes += model.Advance();
+        model_frames += gap;
+
+        upstream_context_t* ctx = new upstream_context_t;
+        simulated_frames += RunProbeWindow(*ctx, HYBRID_WARMUP_FRAMES + SimRand() % BURST_FRAMES);
+        delete ctx;
+
+        if (++probes % 1000 == 0)
+            std::cout << "Probe counter: " << probes << std::endl;
+        METRICS_POLL();
+    }
+    PROFILE_REPORT();
+
+    MSG_INFO("Hybrid simulation: " << probes << " probe frames, " << simulated_frames << " frames in cycle-accurate windows, "
+             << model_frames << " frames at frame level");
+    OutputStats();
+}
+
+#endif // _SIM_HYBRID_H_INCLUDED_
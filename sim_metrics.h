@@ -0,0 +1,358 @@
+/**********************************************************
+ * Filename:    sim_metrics.h
+ *
+ * Description: Machine-readable metrics. With METRICS_EXPORT,
+ *              a run writes
+ *
+ *   <file>_METRICS.json   - all metrics as JSON
+ *   <file>_METRICS.prom   - Prometheus text exposition format
+ *
+ *              every -metrics <seconds> of wall-clock time and at
+ *              the end of the run (the downstream direction into
+ *              _METRICS_DS files). The metrics are the units moved,
+ *              the stalls and the buffer occupancy of every stage
+ *              of the upstream and downstream paths, the frame,
+ *              byte and clock counters, the per-stage delay
+ *              histograms and the warning counts of every call
+ *              site. A file is written under a temporary name and
+ *              renamed, so a scraper never reads a partial file.
+ *
+ *********************************************************/
+
+#ifndef _SIM_METRICS_H_INCLUDED_
+#define _SIM_METRICS_H_INCLUDED_
+
+#include <math.h>
+#include <stdio.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <utility>
+#include <sstream>
+#include <fstream>
+#include "_types.h"
+#include "sim_checkpoint.h"
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////
+// Counters of one pipeline stage
+/////////////////////////////////////////////////////////////////////
+struct stage_metrics_t
+{
+    const CHAR* name;
+    int64u      units_in;
+    int64u      units_out;
+    int64u      stalls;         // clocks with a unit ready that the next stage did not take
+    int32s      occupancy;      // units buffered, -1 if the stage has no buffer
+};
+
+typedef vector< pair< string, string > > metric_labels_t;
+
+/////////////////////////////////////////////////////////////////////
+// Snapshot of all metrics, in the data model of Prometheus: families
+// of samples that differ by their labels. Histogram samples hold the
+// cumulative count up to each bound, summary samples the value at
+// each quantile.
+/////////////////////////////////////////////////////////////////////
+class metrics_snapshot_t
+{
+    private:
+        struct sample_t
+        {
+            metric_labels_t                     labels;
+            DOUBLE                              value;      // sum of a histogram or summary
+            int64u                              count;
+            vector< pair< DOUBLE, DOUBLE > >    points;     // (bound, cumulative count) or (quantile, value)
+        };
+
+        struct family_t
+        {
+            string              name;
+            string              help;
+            string              type;       // counter, gauge, histogram or summary
+            vector< sample_t >  samples;
+        };
+
+        vector< family_t >  families;
+        metric_labels_t     common;         // labels of every sample
+
+        /////////////////////////////////////////////////////////////
+        sample_t& Add( const CHAR* name, const CHAR* help, const CHAR* type, const metric_labels_t& labels )
+        {
+            size_t n = 0;
+            while( n < this->families.size() && this->families[n].name != name )
+                n++;
+            if( n == this->families.size() )
+            {
+                family_t family;
+                family.name = name;
+                family.help = help;
+                family.type = type;
+                this->families.push_back( family );
+            }
+
+            sample_t sample;
+            sample.labels = this->common;
+            sample.labels.insert( sample.labels.end(), labels.begin(), labels.end() );
+            sample.value  = 0;
+            sample.count  = 0;
+            this->families[n].samples.push_back( sample );
+            return this->families[n].samples.back();
+        }
+
+        /////////////////////////////////////////////////////////////
+        // Prometheus label values and JSON strings escape the same
+        // characters
+        /////////////////////////////////////////////////////////////
+        static string Escape( const string& text )
+        {
+            string out;
+            for( size_t n = 0; n < text.size(); n++ )
+            {
+                if( text[n] == '\\' || text[n] == '"' )
+                    out += '\\';
+                if( text[n] == '\n' )
+                    out += "\\n";
+                else
+                    out += text[n];
+            }
+            return out;
+        }
+
+        static string Number( DOUBLE value, bool json )
+        {
+            if( isnan( value ))
+                return json ? "null" : "NaN";
+            if( isinf( value ))
+                return json ? "null" : ( value > 0 ? "+Inf" : "-Inf" );
+
+            ostringstream out;
+            out.precision( 15 );
+            out << value;
+            return out.str();
+        }
+
+        static string PromLabels( const metric_labels_t& labels, const CHAR* extra_name = NULL, const string& extra_value = "" )
+        {
+            string out;
+            for( size_t n = 0; n < labels.size(); n++ )
+                out += ( out.empty() ? "" : "," ) + labels[n].first + "=\"" + Escape( labels[n].second ) + "\"";
+            if( extra_name != NULL )
+                out += ( out.empty() ? "" : "," ) + string( extra_name ) + "=\"" + extra_value + "\"";
+            return out.empty() ? out : "{" + out + "}";
+        }
+
+    public:
+        void SetLabel( const CHAR* name, const string& value )      { this->common.push_back( make_pair( string( name ), value )); }
+
+        void Counter( const CHAR* name, const CHAR* help, DOUBLE value, const metric_labels_t& labels = metric_labels_t() )
+        {
+            Add( name, help, "counter", labels ).value = value;
+        }
+
+        void Gauge( const CHAR* name, const CHAR* help, DOUBLE value, const metric_labels_t& labels = metric_labels_t() )
+        {
+            Add( name, help, "gauge", labels ).value = value;
+        }
+
+        void Histogram( const CHAR* name, const CHAR* help, const vector< pair< DOUBLE, DOUBLE > >& buckets,
+                        DOUBLE sum, int64u count, const metric_labels_t& labels = metric_labels_t() )
+        {
+            sample_t& sample = Add( name, help, "histogram", labels );
+            sample.points = buckets;
+            sample.value  = sum;
+            sample.count  = count;
+        }
+
+        void Summary( const CHAR* name, const CHAR* help, const vector< pair< DOUBLE, DOUBLE > >& quantiles,
+                      DOUBLE sum, int64u count, const metric_labels_t& labels = metric_labels_t() )
+        {
+            sample_t& sample = Add( name, help, "summary", labels );
+            sample.points = quantiles;
+            sample.value  = sum;
+            sample.count  = count;
+        }
+
+        /////////////////////////////////////////////////////////////
+        // Prometheus text exposition format
+        /////////////////////////////////////////////////////////////
+        string Prometheus( void ) const
+        {
+            ostringstream out;
+            for( size_t f = 0; f < this->families.size(); f++ )
+            {
+                const family_t& family = this->families[f];
+                out << "# HELP " << family.name << " " << family.help << "\n";
+                out << "# TYPE " << family.name << " " << family.type << "\n";
+
+                for( size_t s = 0; s < family.samples.size(); s++ )
+                {
+                    const sample_t& sample = family.samples[s];
+                    if( family.type == "histogram" || family.type == "summary" )
+                    {
+                        bool histogram = family.type == "histogram";
+                        for( size_t p = 0; p < sample.points.size(); p++ )
+                            out << family.name << ( histogram ? "_bucket" : "" )
+                                << PromLabels( sample.labels, histogram ? "le" : "quantile", Number( sample.points[p].first, false ))
+                                << " " << Number( sample.points[p].second, false ) << "\n";
+                        if( histogram )
+                            out << family.name << "_bucket" << PromLabels( sample.labels, "le", "+Inf" ) << " " << sample.count << "\n";
+                        out << family.name << "_sum" << PromLabels( sample.labels ) << " " << Number( sample.value, false ) << "\n";
+                        out << family.name << "_count" << PromLabels( sample.labels ) << " " << sample.count << "\n";
+                    }
+                    else
+                        out << family.name << PromLabels( sample.labels ) << " " << Number( sample.value, false ) << "\n";
+                }
+            }
+            return out.str();
+        }
+
+        /////////////////////////////////////////////////////////////
+        // The same families and samples as JSON
+        /////////////////////////////////////////////////////////////
+        string Json( void ) const
+        {
+            ostringstream out;
+            out << "{\n  \"metrics\": [";
+            for( size_t f = 0; f < this->families.size(); f++ )
+            {
+                const family_t& family = this->families[f];
+                out << ( f ? "," : "" ) << "\n    { \"name\": \"" << family.name << "\", \"type\": \"" << family.type
+                    << "\", \"help\": \"" << Escape( family.help ) << "\", \"samples\": [";
+
+                for( size_t s = 0; s < family.samples.size(); s++ )
+                {
+                    const sample_t& sample = family.samples[s];
+                    out << ( s ? "," : "" ) << "\n        { \"labels\": {";
+                    for( size_t l = 0; l < sample.labels.size(); l++ )
+                        out << ( l ? ", " : " " ) << "\"" << sample.labels[l].first << "\": \"" << Escape( sample.labels[l].second ) << "\"";
+                    out << ( sample.labels.empty() ? "}" : " }" );
+
+                    if( family.type == "histogram" || family.type == "summary" )
+                    {
+                        out << ", \"" << ( family.type == "histogram" ? "buckets" : "quantiles" ) << "\": [";
+                        for( size_t p = 0; p < sample.points.size(); p++ )
+                            out << ( p ? ", " : "" ) << "[" << Number( sample.points[p].first, true ) << ", " << Number( sample.points[p].second, true ) << "]";
+                        out << "], \"sum\": " << Number( sample.value, true ) << ", \"count\": " << sample.count << " }";
+                    }
+                    else
+                        out << ", \"value\": " << Number( sample.value, true ) << " }";
+                }
+                out << ( family.samples.empty() ? "] }" : "\n      ] }" );
+            }
+            out << "\n  ]\n}\n";
+            return out.str();
+        }
+};
+
+/////////////////////////////////////////////////////////////////////
+// Replaces a file by writing a temporary one and renaming it over
+// the old one (RenameOver in sim_checkpoint.h)
+/////////////////////////////////////////////////////////////////////
+inline bool WriteFileAtomic( const string& file_name, const string& text )
+{
+    string temp_name = file_name + ".tmp";
+    {
+        ofstream file( temp_name.c_str(), ios::out | ios::binary | ios::trunc );
+        if( !file.is_open() )
+            return false;
+        file.write( text.data(), (streamsize)text.size() );
+        file.close();
+        if( file.fail() )
+        {
+            remove( temp_name.c_str() );
+            return false;
+        }
+    }
+
+    if( RenameOver( temp_name.c_str(), file_name.c_str() ))
+        return true;
+
+    remove( temp_name.c_str() );
+    return false;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Output file names; nothing is exported until Open() is called
+// (benchmarks and golden-result runs do not export)
+/////////////////////////////////////////////////////////////////////
+class metrics_exporter_t
+{
+    private:
+        string  base;
+
+    public:
+        void Open( const CHAR* base_name )      { this->base = base_name; }
+        bool IsOpen( void ) const               { return !this->base.empty(); }
+
+        bool Write( const metrics_snapshot_t& snapshot, const CHAR* suffix )
+        {
+            if( !IsOpen() )
+                return false;
+
+            bool ok = WriteFileAtomic( this->base + "_METRICS" + suffix + ".json", snapshot.Json() );
+            return WriteFileAtomic( this->base + "_METRICS" + suffix + ".prom", snapshot.Prometheus() ) && ok;
+        }
+};
+
+metrics_exporter_t MetricsExporter;
+
+/////////////////////////////////////////////////////////////////////
+// Wall-clock timer of the periodic export; the clock is read once in
+// METRICS_POLL_FRAMES polls
+/////////////////////////////////////////////////////////////////////
+const int32u METRICS_POLL_FRAMES = 64;
+
+class metrics_timer_t
+{
+    private:
+        typedef std::chrono::steady_clock   wall_clock_t;
+
+        wall_clock_t::time_point    last;
+        int32u                      polls;
+
+    public:
+        metrics_timer_t()           { Reset(); }
+
+        void Reset( void )
+        {
+            this->last  = wall_clock_t::now();
+            this->polls = 0;
+        }
+
+        inline bool Due( int32s interval_sec )
+        {
+            if( interval_sec <= 0 || ++this->polls % METRICS_POLL_FRAMES != 0 )
+                return false;
+
+            wall_clock_t::time_point now = wall_clock_t::now();
+            if( now - this->last < std::chrono::seconds( interval_sec ))
+                return false;
+
+            this->last = now;
+            return true;
+        }
+};
+
+/////////////////////////////////////////////////////////////////////
+// State of the exporting thread: the direction it simulates and the
+// stage counters last taken from its pipeline
+/////////////////////////////////////////////////////////////////////
+thread_local metrics_timer_t            MetricsTimer;
+thread_local const CHAR*                MetricsDirection = "upstream";
+thread_local vector< stage_metrics_t >  MetricsStages;
+
+#ifdef METRICS_EXPORT
+    #define OPEN_METRICS( base )                MetricsExporter.Open( base )
+    #define USE_METRICS_DOWNSTREAM()            { MetricsDirection = "downstream"; WarnDirection = 1; }
+    #define METRICS_CAPTURE( capture )          { capture; }
+    #define METRICS_POLL( capture )             { if( MetricsTimer.Due( SimOptions.metrics_interval )) { capture; ExportMetrics(); } }
+#else
+    #define OPEN_METRICS( base )
+    #define USE_METRICS_DOWNSTREAM()
+    #define METRICS_CAPTURE( capture )
+    #define METRICS_POLL( capture )
+#endif
+
+#endif // _SIM_METRICS_H_INCLUDED_
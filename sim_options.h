@@ -0,0 +1,126 @@
+/**********************************************************
+ * Filename:    sim_options.h
+ *
+ * Description: Command-line options
+ *
+ *   MPRS_upstream [prefix] [-resume <file>] [-seed <n>]
+ *                 [-checkpoint <frames>] [-graph <stages>]
+ *                 [-hybrid <frames>] [-ber <rate>] [-ber-columns]
+ *                 [-ber-burst <rate> <good> <bad>] [-metrics <seconds>]
+ *
+ *   prefix       - prefix of all output file names
+ *   -resume      - continue from a checkpoint file
+ *   -seed        - seed the random-number generator (after
+ *                  -resume: fork a variant of the saved run)
+ *   -checkpoint  - write a checkpoint every <frames> frames
+ *   -graph       - comma-separated stage list (STAGE_GRAPH only)
+ *   -hybrid      - cycle-accurate only around probe frames, one
+ *                  in <frames> on average (see sim_hybrid.h)
+ *   -ber         - bit errors between 25GMII TX and RX at <rate>
+ *                  (in the good state with -ber-burst; see FSM_BER.h)
+ *   -ber-columns - error rates are per 36-bit column, not per bit
+ *   -ber-burst   - Gilbert-Elliott channel: errors at <rate> in the
+ *                  bad state, mean sojourns of <good> and <bad> bits
+ *                  (columns) in the good and the bad state
+ *   -metrics     - seconds between metrics files, 0 = at the end
+ *                  only (METRICS_EXPORT only; see sim_metrics.h)
+ *
+ *********************************************************/
+
+#ifndef _SIM_OPTIONS_H_INCLUDED_
+#define _SIM_OPTIONS_H_INCLUDED_
+
+#include <stdlib.h>
+#include <string.h>
+#include "_types.h"
+
+/////////////////////////////////////////////////////////////////////
+// Bit-error channel between 25GMII TX and RX (see FSM_BER.h); all
+// zero for an error-free link
+/////////////////////////////////////////////////////////////////////
+struct bit_error_params_t
+{
+    DOUBLE      rate;                   // error rate, in the good state of a bursty channel
+    DOUBLE      burst_rate;             // error rate in the bad state
+    DOUBLE      good_length;            // mean units in the good state, 0 = independent errors
+    DOUBLE      bad_length;             // mean units in the bad state
+    bool        per_column;             // units are 36-bit columns instead of bits
+};
+
+struct sim_options_t
+{
+    const CHAR* prefix;                 // output file name prefix
+    const CHAR* resume_file;            // checkpoint to resume from, or NULL
+    bool        seed_given;
+    int32u      seed;
+    int32s      checkpoint_interval;    // frames between checkpoints, 0 = off
+    CHAR        checkpoint_file[ 256 ];
+    const CHAR* stage_graph;            // -graph stage list, or NULL
+    int32s      hybrid_interval;        // mean frames per probe frame, 0 = off
+    bit_error_params_t bit_errors;
+    int32s      metrics_interval;       // seconds between metrics exports, 0 = at the end only
+};
+
+sim_options_t SimOptions;
+
+////////////////////////////////////////////////////////////////
+// FUNCTION:     void ParseOptions( int argc, char* argv[] )
+// PURPOSE:      Fill SimOptions from the command line
+////////////////////////////////////////////////////////////////
+void ParseOptions( int argc, char* argv[] )
+{
+    SimOptions.prefix              = "";
+    SimOptions.resume_file         = NULL;
+    SimOptions.seed_given          = false;
+    SimOptions.seed                = 0;
+    SimOptions.checkpoint_interval = 0;
+    SimOptions.stage_graph         = NULL;
+    SimOptions.hybrid_interval     = 0;
+    memset( &SimOptions.bit_errors, 0, sizeof( SimOptions.bit_errors ));
+    SimOptions.metrics_interval    = 10;
+
+    int32s arg = 1;
+    if( argc > 1 && argv[1][0] != '-' )
+        SimOptions.prefix = argv[ arg++ ];
+
+    for( ; arg < argc; arg++ )
+    {
+        bool has_value = arg + 1 < argc;
+
+        if( strcmp( argv[ arg ], "-resume" ) == 0 && has_value )
+            SimOptions.resume_file = argv[ ++arg ];
+        else if( strcmp( argv[ arg ], "-seed" ) == 0 && has_value )
+        {
+            SimOptions.seed_given = true;
+            SimOptions.seed       = (int32u)strtoul( argv[ ++arg ], NULL, 10 );
+        }
+        else if( strcmp( argv[ arg ], "-checkpoint" ) == 0 && has_value )
+            SimOptions.checkpoint_interval = atoi( argv[ ++arg ] );
+        else if( strcmp( argv[ arg ], "-graph" ) == 0 && has_value )
+            SimOptions.stage_graph = argv[ ++arg ];
+        else if( strcmp( argv[ arg ], "-hybrid" ) == 0 && has_value )
+            SimOptions.hybrid_interval = atoi( argv[ ++arg ] );
+        else if( strcmp( argv[ arg ], "-ber" ) == 0 && has_value )
+            SimOptions.bit_errors.rate = atof( argv[ ++arg ] );
+        else if( strcmp( argv[ arg ], "-metrics" ) == 0 && has_value )
+            SimOptions.metrics_interval = atoi( argv[ ++arg ] );
+        else if( strcmp( argv[ arg ], "-ber-columns" ) == 0 )
+            SimOptions.bit_errors.per_column = true;
+        else if( strcmp( argv[ arg ], "-ber-burst" ) == 0 && arg + 3 < argc )
+        {
+            SimOptions.bit_errors.burst_rate  = atof( argv[ ++arg ] );
+            SimOptions.bit_errors.good_length = atof( argv[ ++arg ] );
+            SimOptions.bit_errors.bad_length  = atof( argv[ ++arg ] );
+        }
+    }
+
+    ////////////////////////////////////////////////////////////
+    // the checkpoint name has no timestamp, so a resumed run
+    // keeps updating the same file
+    ////////////////////////////////////////////////////////////
+    strncpy( SimOptions.checkpoint_file, SimOptions.prefix[0] ? SimOptions.prefix : "MPRS", sizeof( SimOptions.checkpoint_file ) - 16 );
+    SimOptions.checkpoint_file[ sizeof( SimOptions.checkpoint_file ) - 16 ] = '\0';
+    strcat( SimOptions.checkpoint_file, "_CKPT.bin" );
+}
+
+#endif // _SIM_OPTIONS_H_INCLUDED_
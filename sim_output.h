@@ -16,9 +16,23 @@
 //#include <fstream.h>  // old style for VC++ 6.0
 #include <fstream>      // new style for VC++.NET
 #include <conio.h>
+#include "sim_warn.h"
 
 using namespace std;
 
+#if defined ( ASYNC_OUTPUT )
+    #include "sim_async.h"
+    #define STREAM_OUT_LN( stream, msg )    ASYNC_OUT( stream, msg )
+    #define STREAM_OUT( stream, msg )       ASYNC_OUT_NOLN( stream, msg )
+    #define STREAM_DRAIN()                  ASYNC_DRAIN()
+    #define STREAM_START()                  AsyncLog.Start()
+#else
+    #define STREAM_OUT_LN( stream, msg )    stream << msg << endl
+    #define STREAM_OUT( stream, msg )       stream << msg
+    #define STREAM_DRAIN()
+    #define STREAM_START()
+#endif
+
 ///////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////
 //
@@ -30,10 +44,11 @@ using namespace std;
 ofstream LOG_##n ;                                              \
 inline void OPEN_##n##_STREAM( char* d, size_t sz )             \
 { strcat_s( d, sz, "_" #n ".csv" );                             \
+  STREAM_START();                                               \
   LOG_##n.open( d );                                            \
   LOG_##n.precision( 12 );                                      \
   LOG_##n << d << endl; }                                       \
-inline void CLOSE_##n##_STREAM( void )   { LOG_##n.close(); } 
+inline void CLOSE_##n##_STREAM( void )   { STREAM_DRAIN(); LOG_##n.close(); } 
 
 #define DUMMY_STREAM( n )                                       \
 inline void OPEN_##n##_STREAM( char*, size_t )   {}             \
@@ -45,26 +60,58 @@ inline void CLOSE_##n##_STREAM( void )   {}
 ////////////////////////////////////////////////////////////////////////
 #if defined ( WARNING_OUTPUT_FILE )
     REAL_STREAM( WARN );
-    #define WARN_FILE_OUT( msg )    LOG_WARN << "WARNING: " << msg << endl
+    #define WARN_FILE_OUT( msg )    STREAM_OUT_LN( LOG_WARN, "WARNING: " << msg )
 #else
     DUMMY_STREAM( WARN );
     #define WARN_FILE_OUT( msg )           
 #endif
     
 #if defined ( WARNING_OUTPUT_SCREEN )
-    #define WARN_SCREEN_OUT( msg )  cerr << "WARNING: " << msg << endl 
+    #define WARN_SCREEN_OUT( msg )  STREAM_OUT_LN( cerr, "WARNING: " << msg )
 #else
     #define WARN_SCREEN_OUT( msg )           
 #endif
 
 #if defined ( STOP_ON_WARNING )
     #include <signal.h>
-    #define STOP_WARN          { clog << "Press any key to continue ..." << endl; if( _getch() == 0x03 ) raise(SIGINT); } 
+    #define STOP_WARN          { STREAM_DRAIN(); clog << "Press any key to continue ..." << endl; if( _getch() == 0x03 ) raise(SIGINT); } 
 #else
     #define STOP_WARN           
 #endif
 
-#define MSG_WARN( msg )  { WARN_SCREEN_OUT( msg ); WARN_FILE_OUT( msg ); STOP_WARN; }  
+////////////////////////////////////////////////////////////////////////
+// Every call site is a warning ID in WarnRegistry (see sim_warn.h), 
+// which rate-limits the output; STOP_WARN at the first of every ID
+////////////////////////////////////////////////////////////////////////
+#define MSG_WARN( msg )                                                             \
+{                                                                                   \
+    static const int32s warn_id = WarnRegistry.Intern( __FILE__, __LINE__ );       \
+    warn_action_t warn_action = WarnRegistry.Raise( warn_id, timestamp_t::GetClock() ); \
+    if( warn_action != WARN_SUPPRESS )                                              \
+    {                                                                               \
+        WARN_SCREEN_OUT( msg ); WARN_FILE_OUT( msg );                               \
+    }                                                                               \
+    if( warn_action == WARN_FIRST )                                                 \
+    {                                                                               \
+        ostringstream warn_text;                                                    \
+        warn_text << msg;                                                           \
+        WarnRegistry.SetText( warn_id, warn_text.str() );                           \
+        STOP_WARN;                                                                  \
+    }                                                                               \
+}
+
+////////////////////////////////////////////////////////////////////////
+// Count and time span of every warning ID, at the end of a run
+////////////////////////////////////////////////////////////////////////
+inline void OutputWarningSummary( void )
+{
+    vector< string > lines = WarnRegistry.Summary();
+    for( size_t n = 0; n < lines.size(); n++ )
+    {
+        WARN_SCREEN_OUT( lines[n] );
+        WARN_FILE_OUT( lines[n] );
+    }
+}
 
 
 ////////////////////////////////////////////////////////////////////////
@@ -72,14 +119,14 @@ inline void CLOSE_##n##_STREAM( void )   {}
 ////////////////////////////////////////////////////////////////////////
 #if defined ( CONFIGURATION_OUTPUT_FILE )
     REAL_STREAM( CONF );
-    #define CONF_FILE_OUT( msg )    LOG_CONF << msg << endl
+    #define CONF_FILE_OUT( msg )    STREAM_OUT_LN( LOG_CONF, msg )
 #else
     DUMMY_STREAM( CONF );
     #define CONF_FILE_OUT( msg )           
 #endif
     
 #if defined ( CONFIGURATION_OUTPUT_SCREEN )
-    #define CONF_SCREEN_OUT( msg )  clog << msg << endl 
+    #define CONF_SCREEN_OUT( msg )  STREAM_OUT_LN( clog, msg )
 #else
     #define CONF_SCREEN_OUT( msg )           
 #endif
@@ -91,14 +138,14 @@ inline void CLOSE_##n##_STREAM( void )   {}
 ////////////////////////////////////////////////////////////////////////
 #if defined ( INFORMATION_OUTPUT_FILE )
     REAL_STREAM( INFO );
-    #define INFO_FILE_OUT( msg )    LOG_INFO << "INFO: " << msg << endl
+    #define INFO_FILE_OUT( msg )    STREAM_OUT_LN( LOG_INFO, "INFO: " << msg )
 #else
     DUMMY_STREAM( INFO );
     #define INFO_FILE_OUT( msg )           
 #endif
     
 #if defined ( INFORMATION_OUTPUT_SCREEN )
-    #define INFO_SCREEN_OUT( msg )  clog << "INFO: " << msg << endl 
+    #define INFO_SCREEN_OUT( msg )  STREAM_OUT_LN( clog, "INFO: " << msg )
 #else
     #define INFO_SCREEN_OUT( msg )           
 #endif
@@ -107,18 +154,29 @@ inline void CLOSE_##n##_STREAM( void )   {}
 
 
 ////////////////////////////////////////////////////////////////////////
-// Result #1 output
+// Result #1 output; the downstream direction writes into its own 
+// _OUT1_DS.csv file, selected per thread with USE_OUT1_DOWNSTREAM()
 ////////////////////////////////////////////////////////////////////////
-#if defined ( RESULT_1_OUTPUT_FILE )
+#if defined ( RESULT_1_OUTPUT_FILE ) && defined ( CHECK_DOWNSTREAM )
+    REAL_STREAM( OUT1 );
+    REAL_STREAM( OUT1_DS );
+    thread_local ofstream* LOG_OUT1_THREAD = &LOG_OUT1;
+    inline void USE_OUT1_DOWNSTREAM( void )     { LOG_OUT1_THREAD = &LOG_OUT1_DS; }
+    #define RSLT1_FILE_OUT( msg )        STREAM_OUT( *LOG_OUT1_THREAD, msg )
+#elif defined ( RESULT_1_OUTPUT_FILE )
     REAL_STREAM( OUT1 );
-    #define RSLT1_FILE_OUT( msg )        LOG_OUT1 << msg
+    DUMMY_STREAM( OUT1_DS );
+    inline void USE_OUT1_DOWNSTREAM( void )     {}
+    #define RSLT1_FILE_OUT( msg )        STREAM_OUT( LOG_OUT1, msg )
 #else
     DUMMY_STREAM( OUT1 );
+    DUMMY_STREAM( OUT1_DS );
+    inline void USE_OUT1_DOWNSTREAM( void )     {}
     #define RSLT1_FILE_OUT( msg )           
 #endif
     
 #if defined ( RESULT_1_OUTPUT_SCREEN )
-    #define RSLT1_SCREEN_OUT( msg )      cout << msg 
+    #define RSLT1_SCREEN_OUT( msg )      STREAM_OUT( cout, msg )
 #else
     #define RSLT1_SCREEN_OUT( msg )           
 #endif
@@ -130,14 +188,14 @@ inline void CLOSE_##n##_STREAM( void )   {}
 ////////////////////////////////////////////////////////////////////////
 #if defined ( RESULT_2_OUTPUT_FILE )
     REAL_STREAM( OUT2 );
-    #define RSLT2_FILE_OUT( msg )        LOG_OUT2 << msg
+    #define RSLT2_FILE_OUT( msg )        STREAM_OUT( LOG_OUT2, msg )
 #else
     DUMMY_STREAM( OUT2 );
     #define RSLT1_FILE_OUT( msg )           
 #endif
     
 #if defined ( RESULT_2_OUTPUT_SCREEN )
-    #define RSLT2_SCREEN_OUT( msg )      cout << msg 
+    #define RSLT2_SCREEN_OUT( msg )      STREAM_OUT( cout, msg )
 #else
     #define RSLT2_SCREEN_OUT( msg )           
 #endif
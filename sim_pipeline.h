@@ -0,0 +1,458 @@
+/**********************************************************
+ * Filename:    sim_pipeline.h
+ *
+ * Description: Compile-time pipeline. The stages of a data
+ *              path are given as a list of FSM types, e.g.
+ *
+ *   pipeline_t< fsm_ngepon_macc_t< PacketSize >, fsm_ngepon_mpcp_tx_t, ... >
+ *
+ *              and the simulation loop is generated from it: the
+ *              stages tick on their clock domains (sim_clock.h)
+ *              and the FSMs are called without virtual dispatch.
+ *              The per-stage rules live in stage_traits_t and are
+ *              shared with the run-time stage graph (sim_graph.h).
+ *
+ *********************************************************/
+
+#ifndef _SIM_PIPELINE_H_INCLUDED_
+#define _SIM_PIPELINE_H_INCLUDED_
+
+#include <tuple>
+#include <utility>
+#include <type_traits>
+#include <iostream>
+#include "_types.h"
+#include "sim_profile.h"
+#include "sim_clock.h"
+#include "sim_metrics.h"
+
+#include "FSM_misc.h"
+#include "FSM_ID.h"
+#include "FSM_DD.h"
+#include "FSM_FEC.h"
+#include "FSM_II.h"
+
+#include "FSM_NGEPON_MACC.h"
+#include "FSM_NGEPON_MPCP.h"
+#include "FSM_NGEPON_MAC.h"
+#include "FSM_NGEPON_RS.h"
+#include "FSM_NGEPON_25GMII.h"
+#include "FSM_BER.h"
+
+/////////////////////////////////////////////////////////////////////
+// Rules of a stage. A unit moves from a stage to the next one when
+// the next one Accepts() it and the stage is Ready(). Specializations
+// override only what differs from these defaults.
+/////////////////////////////////////////////////////////////////////
+template< class fsm_t > struct stage_defaults_t
+{
+    static const bool               source  = false;    // traffic source, takes no input
+    static const profile_stage_t    profile = PRF_PCS;
+    static constexpr clock_period_t clock   = clock_of< typename fsm_t::output_t >::period;
+
+    static inline void Tick( fsm_t& )                       {}      // byte clock
+    static inline bool Accepts( fsm_t& )                    { return true; }
+    static inline bool Ready( fsm_t& fsm )                  { return fsm.OutputReady(); }
+    static inline bool GrantStart( fsm_t& )                 { return false; }
+    static inline int32s Occupancy( fsm_t& )                { return -1; }      // units buffered, -1: no buffer
+
+    /////////////////////////////////////////////////////////////////
+    // A new frame left the traffic source
+    /////////////////////////////////////////////////////////////////
+    static inline void FrameAdmitted( fsm_t&, bool )        {}
+    static inline void Transmitted( fsm_t&, const typename fsm_t::output_t& ) {}
+};
+
+/////////////////////////////////////////////////////////////////////
+// Free-running stages transmit on every clock of their output domain
+/////////////////////////////////////////////////////////////////////
+template< class fsm_t > struct stage_free_running_t: public stage_defaults_t< fsm_t >
+{
+    static inline bool Ready( fsm_t& )                      { return true; }
+};
+
+template< class fsm_t > struct stage_traits_t: public stage_defaults_t< fsm_t > {};
+
+template< int16s (*pf)(void) > struct stage_traits_t< fsm_ngepon_macc_t< pf > >: public stage_defaults_t< fsm_ngepon_macc_t< pf > >
+{
+    typedef fsm_ngepon_macc_t< pf > fsm_t;
+
+    static const bool               source  = true;
+    static const profile_stage_t    profile = PRF_MACC;
+
+    static inline void Tick( fsm_t& fsm )                   { fsm.IncrementMACClientClock(); }
+    static inline bool Ready( fsm_t& fsm )                  { return fsm.FrameAvailable(); }
+    static inline bool GrantStart( fsm_t& fsm )             { return fsm.GrantStart(); }
+};
+
+template<> struct stage_traits_t< fsm_ngepon_mpcp_tx_t >: public stage_defaults_t< fsm_ngepon_mpcp_tx_t >
+{
+    typedef fsm_ngepon_mpcp_tx_t fsm_t;
+
+    static const profile_stage_t    profile = PRF_MPCP_TX;
+
+    static inline void Tick( fsm_t& fsm )                   { fsm.IncrementByteClock(); }
+    static inline bool Accepts( fsm_t& fsm )                { return fsm.ChannelReady(); }
+    static inline void FrameAdmitted( fsm_t& fsm, bool grant_start )    { fsm.grantStart = grant_start; }
+};
+
+template< int16s W > struct stage_traits_t< fsm_ngepon_mac_tx_t< W > >: public stage_free_running_t< fsm_ngepon_mac_tx_t< W > >
+{
+    typedef fsm_ngepon_mac_tx_t< W > fsm_t;
+
+    static const profile_stage_t    profile = PRF_MAC_TX;
+
+    static inline bool Accepts( fsm_t& fsm )                { return fsm.MacReady(); }
+};
+
+template< int16s W > struct stage_traits_t< fsm_ngepon_rs_tx_t< W > >: public stage_free_running_t< fsm_ngepon_rs_tx_t< W > >
+{
+    typedef fsm_ngepon_rs_tx_t< W > fsm_t;
+
+    static const profile_stage_t    profile = PRF_RS_TX;
+
+    static inline bool Accepts( fsm_t& fsm )                { return fsm.IsReadyForMoreData( 0 ); }
+    static inline int32s Occupancy( fsm_t& fsm )            { return fsm.BufferedCodewords( 0 ); }
+    static inline void FrameAdmitted( fsm_t& fsm, bool )
+    {
+        PROFILE_SCOPE( PRF_RS_TX );
+        fsm.CbCtrlRequest( 0, 300 );
+    }
+
+#ifdef DEBUG_ENABLE_DATA_PATH_1
+    static inline void Transmitted( fsm_t&, typename fsm_t::column_t columns )
+    {
+        for( int16s n = 0; n < W; n++ )
+        {
+            _36b_t& column = ColumnOf( columns, n );
+            std::cout << "Data path 1 column type: " << BlockName( column.C_TYPE() ) << ", sequence " << column.GetSeqNumber() << std::endl;
+        }
+    }
+#endif // DEBUG_ENABLE_DATA_PATH_1
+};
+
+template< int16s W > struct stage_traits_t< fsm_ngepon_25gmii_tx_t< W > >: public stage_defaults_t< fsm_ngepon_25gmii_tx_t< W > >
+{
+    static const profile_stage_t    profile = PRF_25GMII_TX;
+};
+
+template< int16s W > struct stage_traits_t< fsm_bit_error_t< W > >: public stage_defaults_t< fsm_bit_error_t< W > >
+{
+    static const profile_stage_t    profile = PRF_BIT_ERRORS;
+};
+
+template< int16s W > struct stage_traits_t< fsm_ngepon_25gmii_rx_t< W > >: public stage_free_running_t< fsm_ngepon_25gmii_rx_t< W > >
+{
+    static const profile_stage_t    profile = PRF_25GMII_RX;
+};
+
+/////////////////////////////////////////////////////////////////////
+// Behind the MAC, frames are delivered on the clock of an MII 
+// transfer, so a step moves MII_WIDTH columns
+/////////////////////////////////////////////////////////////////////
+template< int16s W > struct stage_traits_t< fsm_ngepon_mac_rx_t< W > >: public stage_defaults_t< fsm_ngepon_mac_rx_t< W > >
+{
+    static const profile_stage_t    profile = PRF_MAC_RX;
+    static constexpr clock_period_t clock   = clock_of< typename fsm_ngepon_mac_rx_t< W >::column_t >::period;
+};
+
+template<> struct stage_traits_t< fsm_ngepon_mpcp_rx_t >: public stage_defaults_t< fsm_ngepon_mpcp_rx_t >
+{
+    static const profile_stage_t    profile = PRF_MPCP_RX;
+    static constexpr clock_period_t clock   = { COLUMN_BYTES * MII_WIDTH, 1 };
+};
+
+template<> struct stage_traits_t< fsm_olt_data_detector_t >: public stage_free_running_t< fsm_olt_data_detector_t > {};
+template<> struct stage_traits_t< fsm_onu_data_detector_t >: public stage_free_running_t< fsm_onu_data_detector_t > {};
+template<> struct stage_traits_t< fsm_idle_insertion_t >:    public stage_free_running_t< fsm_idle_insertion_t > {};
+
+/////////////////////////////////////////////////////////////////////
+// Moving units in and out of an FSM. If its ReceiveUnit() and
+// TransmitUnit() are public, they are called directly on the exact
+// type (no virtual dispatch); otherwise the fsm_base_t operators
+// are used.
+/////////////////////////////////////////////////////////////////////
+template< class fsm_t, class = void > struct stage_dispatch_t
+{
+    typedef typename fsm_t::input_t     in_t;
+    typedef typename fsm_t::output_t    out_t;
+
+    static inline void  Put( fsm_t& fsm, const in_t& unit )     { fsm << unit; }
+    static inline out_t Get( fsm_t& fsm, int32s delay_ndx )     { return fsm.Transmit( delay_ndx ); }
+};
+
+template< class fsm_t > struct stage_dispatch_t< fsm_t, std::void_t<
+    decltype( std::declval< fsm_t& >().fsm_t::ReceiveUnit( std::declval< typename fsm_t::input_t >() )),
+    decltype( std::declval< fsm_t& >().fsm_t::TransmitUnit() ) > >
+{
+    typedef typename fsm_t::input_t     in_t;
+    typedef typename fsm_t::output_t    out_t;
+
+    static inline void  Put( fsm_t& fsm, const in_t& unit )     { fsm.fsm_t::ReceiveUnit( unit ); }
+    static inline out_t Get( fsm_t& fsm, int32s delay_ndx )
+    {
+        out_t unit = fsm.fsm_t::TransmitUnit();
+        if( delay_ndx != DLY_NONE )
+            unit.MeasureDelay( delay_ndx );
+        return unit;
+    }
+};
+
+/////////////////////////////////////////////////////////////////////
+// The pipeline. The FSMs are owned by the caller (e.g. the context
+// that is saved in checkpoints). Every stage moves its output on the
+// clock of its domain (stage_traits_t::clock); the tick pattern is
+// computed at compile time (sim_clock.h). Step() replays it up to
+// the next tick of the last stage, one 36-bit column for the NG-EPON
+// paths. Stages in front of the MAC move frames and a frame leaves
+// the source only if all of them can take it; at the same instant,
+// stages move units in order, so a unit may pass several stages.
+/////////////////////////////////////////////////////////////////////
+template< class... fsm_ts > class pipeline_t
+{
+    private:
+        template< size_t I > using fsm_at = typename std::tuple_element< I, std::tuple< fsm_ts... > >::type;
+        template< size_t I > using out_at = typename fsm_at< I >::output_t;
+
+        static const size_t STAGES = sizeof...( fsm_ts );
+
+        /////////////////////////////////////////////////////////////
+        // number of leading stages that deliver frames
+        /////////////////////////////////////////////////////////////
+        template< size_t I > static constexpr size_t LeadingFrameStages( void )
+        {
+            if constexpr( I < STAGES && std::is_same< out_at< I >, _frm_t >::value )
+                return LeadingFrameStages< I + 1 >();
+            else
+                return I;
+        }
+
+        static const size_t FRAME_STAGES = LeadingFrameStages< 0 >();
+
+        template< size_t I > static constexpr bool Connected( void )
+        {
+            if constexpr( I + 1 < STAGES )
+                return std::is_same< out_at< I >, typename fsm_at< I + 1 >::input_t >::value && Connected< I + 1 >();
+            else
+                return true;
+        }
+
+        static_assert( STAGES > 1, "a pipeline needs a source and at least one more stage" );
+        static_assert( stage_traits_t< fsm_at< 0 > >::source, "the first stage must be a traffic source" );
+        static_assert( std::is_same< out_at< STAGES - 1 >, _frm_t >::value, "the last stage must deliver frames" );
+        static_assert( Connected< 0 >(), "the output of every stage must be the input of the next one" );
+
+        /////////////////////////////////////////////////////////////
+        // Tick pattern, computed at compile time. Every slot is 
+        // unrolled, so the pattern is kept short.
+        /////////////////////////////////////////////////////////////
+        static const int32s MAX_SLOTS = 64;
+
+        static constexpr clock_period_t                 PERIODS[ STAGES ] = { stage_traits_t< fsm_ts >::clock... };
+        static constexpr tick_pattern_t< MAX_SLOTS >    PATTERN = BuildTickPattern< MAX_SLOTS >( PERIODS, (int32s)STAGES );
+
+        static_assert( PATTERN.error != TICK_BAD_STAGES, "too many stages for the tick schedule" );
+        static_assert( PATTERN.error != TICK_BAD_PERIOD, "invalid clock period" );
+        static_assert( PATTERN.error != TICK_TOO_LONG, "the hyperperiod of the clock domains is too long" );
+
+        std::tuple< fsm_ts&... >    fsm;
+        int32s                      phase;      // current step within the hyperperiod
+
+#ifdef METRICS_EXPORT
+        int64u                      units_out[ STAGES ];
+        int64u                      stalls[ STAGES ];
+#endif
+
+        /////////////////////////////////////////////////////////////
+        // stage I had a unit the next stage did not take. Ready() of 
+        // the traffic source draws its next frame, so the source is
+        // not asked and its stalls are not counted.
+        /////////////////////////////////////////////////////////////
+        template< size_t I > inline void CountStall( void )
+        {
+#ifdef METRICS_EXPORT
+            if constexpr( I > 0 )
+                if( stage_traits_t< fsm_at< I > >::Ready( std::get< I >( this->fsm )))
+                    this->stalls[ I ]++;
+#endif
+        }
+
+        template< size_t I > inline void CollectStageMetrics( vector< stage_metrics_t >& stages )
+        {
+#ifdef METRICS_EXPORT
+            typedef stage_traits_t< fsm_at< I > > traits_t;
+
+            stage_metrics_t stage;
+            stage.name      = PROFILE_STAGE_NAME[ traits_t::profile ];
+            stage.units_in  = this->units_out[ I > 0 ? I - 1 : I ];     // the source counts its frames once
+            stage.units_out = this->units_out[ I ];
+            stage.stalls    = this->stalls[ I ];
+            stage.occupancy = traits_t::Occupancy( std::get< I >( this->fsm ));
+            stages.push_back( stage );
+#endif
+            if constexpr( I + 1 < STAGES )
+                CollectStageMetrics< I + 1 >( stages );
+        }
+
+        /////////////////////////////////////////////////////////////
+        template< size_t I, int32u SLOT > inline void Tick( void )
+        {
+            if constexpr(( SLOT & ( 1u << I )) != 0 )
+            {
+                PROFILE_SCOPE( stage_traits_t< fsm_at< I > >::profile );
+                stage_traits_t< fsm_at< I > >::Tick( std::get< I >( this->fsm ));
+            }
+            if constexpr( I + 1 < STAGES )
+                Tick< I + 1, SLOT >();
+        }
+
+        /////////////////////////////////////////////////////////////
+        // stages I..FRAME_STAGES can take a new frame
+        /////////////////////////////////////////////////////////////
+        template< size_t I > inline bool AcceptFrame( void )
+        {
+            if constexpr( I <= FRAME_STAGES && I < STAGES )
+                return stage_traits_t< fsm_at< I > >::Accepts( std::get< I >( this->fsm )) && AcceptFrame< I + 1 >();
+            else
+                return true;
+        }
+
+        template< size_t I > inline void FrameAdmitted( bool grant_start )
+        {
+            stage_traits_t< fsm_at< I > >::FrameAdmitted( std::get< I >( this->fsm ), grant_start );
+            if constexpr( I + 1 < STAGES )
+                FrameAdmitted< I + 1 >( grant_start );
+        }
+
+        /////////////////////////////////////////////////////////////
+        // units are constructed in place, never default-constructed 
+        // and assigned
+        /////////////////////////////////////////////////////////////
+        template< size_t I > inline out_at< I > Get( void )
+        {
+            typedef fsm_at< I > fsm_t;
+
+            PROFILE_SCOPE( stage_traits_t< fsm_t >::profile );
+            out_at< I > unit = stage_dispatch_t< fsm_t >::Get( std::get< I >( this->fsm ), fsm_t::location );
+            stage_traits_t< fsm_t >::Transmitted( std::get< I >( this->fsm ), unit );
+            return unit;
+        }
+
+        /////////////////////////////////////////////////////////////
+        // move a unit from stage I into the next one, or into the
+        // sink after the last stage
+        /////////////////////////////////////////////////////////////
+        template< size_t I, class sink_t > inline void Transfer( sink_t& sink )
+        {
+            typedef fsm_at< I >                 fsm_t;
+            typedef stage_traits_t< fsm_t >     traits_t;
+
+            fsm_t& stage = std::get< I >( this->fsm );
+
+            if constexpr( I + 1 < STAGES )
+                if( !stage_traits_t< fsm_at< I + 1 > >::Accepts( std::get< I + 1 >( this->fsm )))
+                {
+                    CountStall< I >();
+                    return;
+                }
+            if( !traits_t::Ready( stage ))
+                return;
+            if constexpr( I < FRAME_STAGES )
+                if( !AcceptFrame< I + 2 >() )
+                {
+                    CountStall< I >();
+                    return;
+                }
+
+            const out_at< I > unit = Get< I >();
+#ifdef METRICS_EXPORT
+            this->units_out[ I ]++;
+#endif
+            if constexpr( I + 1 == STAGES )
+                sink( unit );
+            else
+            {
+                {
+                    PROFILE_SCOPE( stage_traits_t< fsm_at< I + 1 > >::profile );
+                    stage_dispatch_t< fsm_at< I + 1 > >::Put( std::get< I + 1 >( this->fsm ), unit );
+                }
+                // outside the scope above: every stage profiles its own share
+                if constexpr( I == 0 )
+                    FrameAdmitted< 0 >( traits_t::GrantStart( stage ));
+            }
+        }
+
+        template< size_t I, int32u SLOT, class sink_t > inline void TransferAll( sink_t& sink )
+        {
+            if constexpr(( SLOT & ( 1u << I )) != 0 )
+                Transfer< I >( sink );
+            if constexpr( I + 1 < STAGES )
+                TransferAll< I + 1, SLOT >( sink );
+        }
+
+        /////////////////////////////////////////////////////////////
+        // slots K..END-1 of the pattern
+        /////////////////////////////////////////////////////////////
+        template< int32s K, int32s END, class sink_t > inline void Replay( sink_t& sink )
+        {
+            if constexpr( K < END )
+            {
+                constexpr int32u SLOT = PATTERN.slot[ K ];
+
+                if constexpr(( SLOT & TICK_TIMESTAMP ) != 0 )
+                    timestamp_t::IncrementClock();
+                Tick< 0, SLOT >();
+                TransferAll< 0, SLOT >( sink );
+                Replay< K + 1, END >( sink );
+            }
+        }
+
+        template< int32s S, class sink_t > inline void ReplayStep( sink_t& sink )
+        {
+            if constexpr( S < PATTERN.steps )
+            {
+                if( this->phase == S )
+                    Replay< PATTERN.step_start[ S ], PATTERN.step_start[ S + 1 ] >( sink );
+                else
+                    ReplayStep< S + 1 >( sink );
+            }
+        }
+
+    public:
+        /////////////////////////////////////////////////////////////
+        // step: number of steps already simulated with these FSMs
+        // (e.g. restored from a checkpoint), for the phase of the 
+        // clock domains
+        /////////////////////////////////////////////////////////////
+        pipeline_t( int64u step, fsm_ts&... stages ): fsm( stages... )
+        {
+            this->phase = (int32s)( step % PATTERN.steps );
+#ifdef METRICS_EXPORT
+            FOR_ALL( (int32s)STAGES, n )
+                this->units_out[n] = this->stalls[n] = 0;
+#endif
+        }
+
+        /////////////////////////////////////////////////////////////
+        // Counters of all stages since the pipeline was built (see 
+        // sim_metrics.h); empty without METRICS_EXPORT
+        /////////////////////////////////////////////////////////////
+        void StageMetrics( vector< stage_metrics_t >& stages )
+        {
+            stages.clear();
+            CollectStageMetrics< 0 >( stages );
+        }
+
+        /////////////////////////////////////////////////////////////
+        // Up to and including the next tick of the last stage; 
+        // frames leaving the last stage go to sink()
+        /////////////////////////////////////////////////////////////
+        template< class sink_t > inline void Step( sink_t& sink )
+        {
+            ReplayStep< 0 >( sink );
+            if( ++this->phase == PATTERN.steps )
+                this->phase = 0;
+        }
+};
+
+#endif // _SIM_PIPELINE_H_INCLUDED_
@@ -0,0 +1,176 @@
+/**********************************************************
+ * Filename:    sim_profile.h
+ *
+ * Description: Sampling profiler for the stages of the
+ *              simulation loop. Every PROFILE_SAMPLE_PERIOD-th
+ *              column is timed stage by stage; all other
+ *              columns only test a flag. Without PROFILE_STAGES
+ *              the macros expand to nothing.
+ *
+ *********************************************************/
+
+#ifndef _SIM_PROFILE_H_INCLUDED_
+#define _SIM_PROFILE_H_INCLUDED_
+
+#include <chrono>
+#include "_types.h"
+
+enum profile_stage_t
+{
+    PRF_MACC,
+    PRF_MPCP_TX,
+    PRF_MAC_TX,
+    PRF_RS_TX,
+    PRF_25GMII_TX,
+    PRF_BIT_ERRORS,
+    PRF_25GMII_RX,
+    PRF_MAC_RX,
+    PRF_MPCP_RX,
+    PRF_PCS,            // legacy PCS stages (see sim_pipeline.h)
+    PRF_STATS,
+    PRF_STAGES
+};
+
+const CHAR* const PROFILE_STAGE_NAME[ PRF_STAGES ] =
+{
+    "MACC", "MPCP_TX", "MAC_TX", "RS_TX", "25GMII_TX", "BIT_ERRORS", "25GMII_RX", "MAC_RX", "MPCP_RX", "PCS", "Stats"
+};
+
+const int32u PROFILE_SAMPLE_PERIOD = 512;    // columns; must be a power of 2
+
+class stage_profiler_t
+{
+    public:
+        typedef std::chrono::steady_clock   prf_clock_t;
+
+    private:
+        int64s          stage_ns[ PRF_STAGES ];
+        int64s          stage_calls[ PRF_STAGES ];
+        int64s          columns;            // all columns
+        int64s          sampled;            // timed columns
+        DOUBLE          timer_ns;           // cost of one timed scope, subtracted from results
+        prf_clock_t::time_point run_start;
+        int64s          run_ns;
+
+    public:
+        bool            sampling;           // current column is timed
+
+        stage_profiler_t()      { Clear(); }
+
+        void Clear( void )
+        {
+            FOR_ALL( PRF_STAGES, n )
+            {
+                this->stage_ns[n]    = 0;
+                this->stage_calls[n] = 0;
+            }
+            this->columns  = 0;
+            this->sampled  = 0;
+            this->run_ns   = 0;
+            this->timer_ns = 0;
+            this->sampling = false;
+        }
+
+        /////////////////////////////////////////////////////////////
+        // Start of the run: estimate the cost of reading the clock
+        /////////////////////////////////////////////////////////////
+        void Start( void )
+        {
+            const int32s CALIBRATION_LOOPS = 10000;
+
+            Clear();
+            prf_clock_t::time_point t0 = prf_clock_t::now();
+            FOR_ALL( CALIBRATION_LOOPS, n )
+                prf_clock_t::now();
+            this->timer_ns = (DOUBLE)std::chrono::duration_cast< std::chrono::nanoseconds >( prf_clock_t::now() - t0 ).count() / CALIBRATION_LOOPS;
+            this->run_start = prf_clock_t::now();
+        }
+
+        void Stop( void )
+        {
+            this->run_ns = std::chrono::duration_cast< std::chrono::nanoseconds >( prf_clock_t::now() - this->run_start ).count();
+        }
+
+        /////////////////////////////////////////////////////////////
+        // Called once per 36-bit column
+        /////////////////////////////////////////////////////////////
+        inline void NextColumn( void )
+        {
+            this->sampling = ( this->columns++ & ( PROFILE_SAMPLE_PERIOD - 1 )) == 0;
+            this->sampled += this->sampling;
+        }
+
+        inline void Add( profile_stage_t stage, int64s ns )
+        {
+            this->stage_ns[ stage ] += ns;
+            this->stage_calls[ stage ]++;
+        }
+
+        /////////////////////////////////////////////////////////////
+        // ns/column and share of each stage, extrapolated from the
+        // sampled columns
+        /////////////////////////////////////////////////////////////
+        void Report( void )
+        {
+            if( this->sampled == 0 )
+                return;
+
+            DOUBLE stage_col[ PRF_STAGES ];
+            DOUBLE total_col = 0;
+
+            FOR_ALL( PRF_STAGES, n )
+            {
+                DOUBLE ns = this->stage_ns[n] - this->stage_calls[n] * this->timer_ns;
+                stage_col[n] = ( ns > 0 ? ns : 0 ) / this->sampled;
+                total_col   += stage_col[n];
+            }
+
+            MSG_INFO( "Profile: " << this->columns << " columns, " << this->sampled << " sampled, "
+                      << (DOUBLE)this->run_ns / this->columns << " ns/column in total (incl. loop overhead)" );
+            MSG_INFO( "Profile: stage, ns/column, % of stage time" );
+            FOR_ALL( PRF_STAGES, n )
+                MSG_INFO( "Profile: " << PROFILE_STAGE_NAME[n] << ", " << stage_col[n] << ", "
+                          << ( total_col > 0 ? 100.0 * stage_col[n] / total_col : 0.0 ));
+        }
+};
+
+/////////////////////////////////////////////////////////////////////
+// Times the enclosing block if the current column is sampled
+/////////////////////////////////////////////////////////////////////
+class profile_scope_t
+{
+    private:
+        stage_profiler_t&                       profiler;
+        profile_stage_t                         stage;
+        stage_profiler_t::prf_clock_t::time_point start;
+
+    public:
+        inline profile_scope_t( stage_profiler_t& prf, profile_stage_t stg ): profiler( prf ), stage( stg )
+        {
+            if( this->profiler.sampling )
+                this->start = stage_profiler_t::prf_clock_t::now();
+        }
+
+        inline ~profile_scope_t()
+        {
+            if( this->profiler.sampling )
+                this->profiler.Add( this->stage, std::chrono::duration_cast< std::chrono::nanoseconds >(
+                                    stage_profiler_t::prf_clock_t::now() - this->start ).count() );
+        }
+};
+
+#ifdef PROFILE_STAGES
+    thread_local stage_profiler_t StageProfiler;
+
+    #define PROFILE_START()         StageProfiler.Start()
+    #define PROFILE_COLUMN()        StageProfiler.NextColumn()
+    #define PROFILE_SCOPE( stage )  profile_scope_t _profile_scope( StageProfiler, stage )
+    #define PROFILE_REPORT()        { StageProfiler.Stop(); StageProfiler.Report(); }
+#else
+    #define PROFILE_START()
+    #define PROFILE_COLUMN()
+    #define PROFILE_SCOPE( stage )
+    #define PROFILE_REPORT()
+#endif
+
+#endif // _SIM_PROFILE_H_INCLUDED_
@@ -0,0 +1,186 @@
+/**********************************************************
+ * Filename:    sim_warn.h
+ *
+ * Description: Registry of protocol warnings. Every MSG_WARN
+ *              call site is interned once as a warning ID; each
+ *              ID counts its occurrences, in total and per
+ *              direction of the raising thread, and keeps the
+ *              simulated time of the first and the last one. Only
+ *              the first WARN_RATE_LIMIT occurrences of an ID within
+ *              WARN_RATE_WINDOW byte clocks are printed, so a
+ *              misconfigured state machine warning on every column
+ *              no longer floods the output; the end of the run
+ *              prints a summary of all IDs. With STOP_ON_WARNING,
+ *              the simulation halts at the first occurrence of
+ *              every ID.
+ *
+ *********************************************************/
+
+#ifndef _SIM_WARN_H_INCLUDED_
+#define _SIM_WARN_H_INCLUDED_
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <string.h>
+#include "_types.h"
+
+using namespace std;
+
+const int32s WARN_RATE_LIMIT    = 10;           // warnings printed per ID and window
+const int64s WARN_RATE_WINDOW   = 1000000;      // byte clocks
+const int32s WARN_DIRECTIONS    = 2;            // upstream and downstream
+
+thread_local int32s WarnDirection = 0;          // direction simulated by the calling thread
+
+enum warn_action_t
+{
+    WARN_SUPPRESS,                  // counted only
+    WARN_SHOW,                      // printed
+    WARN_FIRST                      // first of its ID: printed and its text kept for the summary
+};
+
+class warn_registry_t
+{
+    private:
+        struct warn_entry_t
+        {
+            const CHAR* file;
+            int32s      line;
+            string      text;       // first message
+            int64s      count;
+            int64s      direction_count[ WARN_DIRECTIONS ];
+            int64s      shown;
+            int64s      first_clock;
+            int64s      last_clock;
+            int64s      window_start;
+            int32s      window_shown;
+        };
+
+        mutex                   lock;       // upstream and downstream threads share the registry
+        vector< warn_entry_t >  entries;
+
+        /////////////////////////////////////////////////////////////
+        // file:line of a call site, without the directory
+        /////////////////////////////////////////////////////////////
+        static string Source( const warn_entry_t& entry )
+        {
+            const CHAR* name = strrchr( entry.file, '\\' ) ? strrchr( entry.file, '\\' ) + 1 : entry.file;
+            name = strrchr( name, '/' ) ? strrchr( name, '/' ) + 1 : name;
+
+            ostringstream source;
+            source << name << ":" << entry.line;
+            return source.str();
+        }
+
+    public:
+        /////////////////////////////////////////////////////////////
+        // ID of a call site; called once per site and template
+        // instance (static local), which share the ID
+        /////////////////////////////////////////////////////////////
+        int32s Intern( const CHAR* file, int32s line )
+        {
+            lock_guard< mutex > guard( this->lock );
+
+            for( size_t n = 0; n < this->entries.size(); n++ )
+                if( this->entries[n].line == line && strcmp( this->entries[n].file, file ) == 0 )
+                    return (int32s)n;
+
+            warn_entry_t entry;
+            entry.file         = file;
+            entry.line         = line;
+            entry.count        = 0;
+            entry.shown        = 0;
+            for( int32s dir = 0; dir < WARN_DIRECTIONS; dir++ )
+                entry.direction_count[ dir ] = 0;
+            entry.first_clock  = 0;
+            entry.last_clock   = 0;
+            entry.window_start = 0;
+            entry.window_shown = 0;
+            this->entries.push_back( entry );
+            return (int32s)this->entries.size() - 1;
+        }
+
+        /////////////////////////////////////////////////////////////
+        // Count an occurrence at the given simulated time
+        /////////////////////////////////////////////////////////////
+        warn_action_t Raise( int32s id, int64s clock )
+        {
+            lock_guard< mutex > guard( this->lock );
+            warn_entry_t& entry = this->entries[ id ];
+
+            entry.direction_count[ WarnDirection ]++;
+            if( entry.count++ == 0 )
+            {
+                entry.first_clock  = clock;
+                entry.last_clock   = clock;
+                entry.window_start = clock;
+                entry.window_shown = 1;
+                entry.shown        = 1;
+                return WARN_FIRST;
+            }
+
+            entry.last_clock = clock;
+            if( clock - entry.window_start >= WARN_RATE_WINDOW || clock < entry.window_start )
+            {
+                entry.window_start = clock;
+                entry.window_shown = 0;
+            }
+            if( entry.window_shown >= WARN_RATE_LIMIT )
+                return WARN_SUPPRESS;
+
+            entry.window_shown++;
+            entry.shown++;
+            return WARN_SHOW;
+        }
+
+        void SetText( int32s id, const string& text )
+        {
+            lock_guard< mutex > guard( this->lock );
+            this->entries[ id ].text = text;
+        }
+
+        /////////////////////////////////////////////////////////////
+        // Summary lines, one per ID that occurred; empty if none did
+        /////////////////////////////////////////////////////////////
+        vector< string > Summary( void )
+        {
+            lock_guard< mutex > guard( this->lock );
+            vector< string > lines;
+
+            for( size_t n = 0; n < this->entries.size(); n++ )
+            {
+                const warn_entry_t& entry = this->entries[n];
+                if( entry.count == 0 )
+                    continue;
+
+                if( lines.empty() )
+                    lines.push_back( "Summary,Count,Shown,First clock,Last clock,Source,Message" );
+
+                ostringstream line;
+                line << "Summary," << entry.count << "," << entry.shown << "," << entry.first_clock << "," << entry.last_clock
+                     << "," << Source( entry ) << ",\"" << entry.text << "\"";
+                lines.push_back( line.str() );
+            }
+            return lines;
+        }
+
+        /////////////////////////////////////////////////////////////
+        // Occurrences by call site (file:line) in one direction, for
+        // the metrics export; IDs that never occurred are included
+        /////////////////////////////////////////////////////////////
+        vector< pair< string, int64s > > Counts( int32s direction )
+        {
+            lock_guard< mutex > guard( this->lock );
+            vector< pair< string, int64s > > counts;
+
+            for( size_t n = 0; n < this->entries.size(); n++ )
+                counts.push_back( make_pair( Source( this->entries[n] ), this->entries[n].direction_count[ direction ] ));
+            return counts;
+        }
+};
+
+warn_registry_t WarnRegistry;
+
+#endif // _SIM_WARN_H_INCLUDED_
@@ -5,6 +5,10 @@
 //              statistical variables
 //                 class Stats, 
 //                 class Distrib
+//                 class LogHistogram
+//                 class QuantileSketch
+//                 class BatchMeansCI
+//                 function MserTruncation
 //                 class AutoCorr
 //
 // Author:      Glen Kramer (kramer@cs.ucdavis.edu)
@@ -18,8 +22,15 @@
 #define _STATS_H_INCLUDED_
 
 #include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
 #include "_types.h"
 
+#if defined ( _MSC_VER )
+    #include <intrin.h>
+#endif
+
 #define INVALID_VAL     0		// value returned when asking for AVG or VAR of an empty set 
 typedef DOUBLE stat_t;
 
@@ -27,14 +38,18 @@ typedef DOUBLE stat_t;
 //////////////////////////////////////////////////////////////////////
 // class Stats 
 // Calculates average value, maximum value, and variance of a series.
+// Mean and variance are updated incrementally (Welford), which stays 
+// accurate for very long series of large values. Two instances 
+// collected independently (e.g., in separate threads) can be merged 
+// exactly with operator+= (Chan et al.).
 //////////////////////////////////////////////////////////////////////
 class Stats  
 {
 private:
 	stat_t _Min;    // smallest element in the set
     stat_t _Max;    // largest element in the set
-    stat_t _Sqr;    // weighted square of all elements collected
-    stat_t _Tot;    // weighted sum of all elements collected
+    stat_t _Mean;   // weighted mean of all elements collected
+    stat_t _M2;     // weighted sum of squared deviations from the mean
     stat_t _Cnt;    // number of elements collected (sum of weights)
 
 public:
@@ -45,33 +60,51 @@ public:
     {
 		if( _Max < sample || _Cnt == 0 ) _Max = sample;
 		if( _Min > sample || _Cnt == 0 ) _Min = sample;
-        _Tot += sample * weight;
-        _Sqr += sample * sample * weight;
         _Cnt += weight;
+        stat_t delta = sample - _Mean;
+        _Mean += delta * weight / _Cnt;
+        _M2   += delta * ( sample - _Mean ) * weight;
     }
     //////////////////////////////////////////////////////////////////
-	inline void Clear( void )			{ _Min = _Max = _Sqr = _Tot = _Cnt = 0.0; }
+	inline void Clear( void )			{ _Min = _Max = _Mean = _M2 = _Cnt = 0.0; }
 
-    inline stat_t GetTotal(void) const  { return _Tot; }
+    inline stat_t GetTotal(void) const  { return _Mean * _Cnt; }
     inline stat_t GetCount(void) const  { return _Cnt; }
     inline stat_t GetMin(void)   const  { return _Min; }
 	inline stat_t GetMax(void)   const  { return _Max; }
     inline stat_t GetRange(void) const  { return _Max - _Min; }
-    inline stat_t GetAvg(void)   const  { return _Cnt? _Tot / _Cnt : INVALID_VAL; }
-    inline stat_t GetVar(void)   const  { return _Cnt? (_Sqr - _Tot*_Tot/_Cnt)/_Cnt: INVALID_VAL; }
+    inline stat_t GetAvg(void)   const  { return _Cnt? _Mean : INVALID_VAL; }
+    inline stat_t GetVar(void)   const  { return _Cnt? _M2 / _Cnt : INVALID_VAL; }
     //////////////////////////////////////////////////////////////////
     inline Stats operator+ ( Stats st ) { return st += *this; }
     //////////////////////////////////////////////////////////////////
     inline Stats& operator+= ( const Stats& st )
     {
-       if( _Max < st._Max )
-           _Max = st._Max;
+        if( st._Cnt == 0 )
+            return *this;
+
+        if( _Cnt == 0 )
+            return *this = st;
 
-        _Tot += st._Tot;
-        _Sqr += st._Sqr;
-        _Cnt += st._Cnt;
+        if( _Max < st._Max ) _Max = st._Max;
+        if( _Min > st._Min ) _Min = st._Min;
+
+        stat_t count = _Cnt + st._Cnt;
+        stat_t delta = st._Mean - _Mean;
+        _Mean += delta * st._Cnt / count;
+        _M2   += st._M2 + delta * delta * _Cnt * st._Cnt / count;
+        _Cnt   = count;
         return *this;
     }
+    //////////////////////////////////////////////////////////////////
+    template< class archive_t > void Serialize( archive_t& ar )
+    {
+        ar.Raw( _Min );
+        ar.Raw( _Max );
+        ar.Raw( _Mean );
+        ar.Raw( _M2 );
+        ar.Raw( _Cnt );
+    }
 };
 
 
@@ -139,9 +172,9 @@ public:
         return d += *this;
     }
     //////////////////////////////////////////////////////////////////
-    inline Distrib< BINS > operator+= (const Distrib< BINS >& d )
+    inline Distrib< BINS >& operator+= (const Distrib< BINS >& d )
     {
-        Stats::operator += ( static_cast<Stats>( d ));
+        Stats::operator += ( d );
         for( int16s i = 0; i < BINS; i++ )
             _Dstrb[i] += d._Dstrb[i];
         return *this;
@@ -185,13 +218,507 @@ public:
         DOUBLE rank = 0;
 
         for( int32s bin  = _VerifyBin( _CalcBin( val )); bin >= 0; bin-- )
-            rank += _Dstrb[ b ];
+            rank += _Dstrb[ bin ];
 
         return rank / GetCount();
+    }
+    //////////////////////////////////////////////////////////////////
+    template< class archive_t > void Serialize( archive_t& ar )
+    {
+        Stats::Serialize( ar );
+        ar.Raw( _MinVal );
+        ar.Raw( _BinSize );
+        ar.Raw( _Dstrb );
     }
 	//////////////////////////////////////////////////////////////////
 };
 
+//////////////////////////////////////////////////////////////////////
+// Returns index of the most significant set bit (val must be > 0)
+//////////////////////////////////////////////////////////////////////
+inline int32s MsbIndex( int64u val )
+{
+#if defined ( _MSC_VER ) && defined ( _M_X64 )
+    unsigned long ndx;
+    _BitScanReverse64( &ndx, val );
+    return (int32s)ndx;
+#elif defined ( __GNUC__ )
+    return 63 - __builtin_clzll( val );
+#else
+    int32s ndx = 0;
+    while( val >>= 1 )
+        ndx++;
+    return ndx;
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////
+// class LogHistogram 
+// Log-linear (HDR-style) histogram of non-negative integer samples. 
+// Values below 2^SUB_BITS are counted exactly; above that, each 
+// power-of-two range is split into 2^SUB_BITS equal buckets, so the 
+// relative error of any reported value is at most 2^-SUB_BITS. 
+// Buckets are allocated up to the largest value seen, and values up 
+// to 2^MAX_BITS are accepted (larger ones go to the last bucket).
+//////////////////////////////////////////////////////////////////////
+template < int32s SUB_BITS = 7, int32s MAX_BITS = 40 > class LogHistogram : public Stats
+{
+private:
+    std::vector< int64u > _Count;   // bucket counts, grown on demand
+    int64u                _Total;   // sum of all bucket counts
+
+    static const int64s SUB_COUNT   = (int64s)1 << SUB_BITS;
+    static const int32s MAX_BUCKETS = ( MAX_BITS - SUB_BITS + 1 ) * (int32s)SUB_COUNT;
+
+    //////////////////////////////////////////////////////////////////
+    // Maps a value to its bucket in constant time
+    //////////////////////////////////////////////////////////////////
+    static inline int32s _CalcBucket( stat_t sample )
+    {
+        if( sample < SUB_COUNT )
+            return sample <= 0 ? 0 : (int32s)sample;
+
+        int64u val   = sample >= (stat_t)((int64u)1 << MAX_BITS) ? ((int64u)1 << MAX_BITS) - 1 : (int64u)sample;
+        int32s shift = MsbIndex( val ) - SUB_BITS;
+        return (int32s)(( shift + 1 ) * SUB_COUNT + (int64s)( val >> shift ) - SUB_COUNT );
+    }
+
+public:
+    LogHistogram() : Stats()            { Clear(); }
+    virtual ~LogHistogram()             {}
+
+    //////////////////////////////////////////////////////////////////
+    inline void Clear( void )
+    {
+        Stats::Clear();
+        _Count.assign( _Count.size(), 0 );
+        _Total = 0;
+    }
+    //////////////////////////////////////////////////////////////////
+    inline void Sample( stat_t sample )
+    {
+        int32s bucket = _CalcBucket( sample );
+
+        Stats::Sample( sample );
+        if( bucket >= (int32s)_Count.size() )
+            _Count.resize( bucket + 1, 0 );
+        _Count[ bucket ]++;
+        _Total++;
+    }
+    //////////////////////////////////////////////////////////////////
+    // Merging is exact: bucket boundaries are identical in all 
+    // instances with the same SUB_BITS
+    //////////////////////////////////////////////////////////////////
+    inline LogHistogram& operator+= ( const LogHistogram& h )
+    {
+        Stats::operator += ( h );
+        if( h._Count.size() > _Count.size() )
+            _Count.resize( h._Count.size(), 0 );
+        for( size_t i = 0; i < h._Count.size(); i++ )
+            _Count[i] += h._Count[i];
+        _Total += h._Total;
+        return *this;
+    }
+
+    //////////////////////////////////////////////////////////////////
+    inline int32s GetBins( void )            const { return (int32s)_Count.size(); }
+    inline int64u GetBin( int32s bin )       const { return bin >= 0 && bin < GetBins()? _Count[ bin ] : 0; }
+    inline stat_t GetBinNorm( int32s bin )   const { return _Total? (stat_t)GetBin( bin ) / _Total : INVALID_VAL; }
+
+    //////////////////////////////////////////////////////////////////
+    // Bucket of a value, allocated or not
+    //////////////////////////////////////////////////////////////////
+    static inline int32s GetBinOf( stat_t sample )  { return _CalcBucket( sample ); }
+
+    //////////////////////////////////////////////////////////////////
+    // Lowest and highest value that map into the bucket
+    //////////////////////////////////////////////////////////////////
+    static inline stat_t GetBinFloor( int32s bin )
+    {
+        if( bin < SUB_COUNT )
+            return bin;
+        int32s shift = (int32s)( bin / SUB_COUNT ) - 1;
+        return (stat_t)((int64u)( bin % SUB_COUNT + SUB_COUNT ) << shift );
+    }
+    static inline stat_t GetBinCeil( int32s bin )
+    {
+        return bin + 1 >= MAX_BUCKETS ? (stat_t)((int64u)1 << MAX_BITS) : GetBinFloor( bin + 1 ) - 1;
+    }
+
+    //////////////////////////////////////////////////////////////////
+    // Returns a value such that the fraction pcnt (e.g. 0.99) of all 
+    // samples are at or below this value. The value is the upper bound
+    // of the bucket, limited to the largest sample seen.
+    //////////////////////////////////////////////////////////////////
+    stat_t GetPercentileValue( DOUBLE pcnt ) const
+    {
+        stat_t value;
+        GetPercentileValues( &pcnt, &value, 1 );
+        return value;
+    }
+
+    //////////////////////////////////////////////////////////////////
+    // Multiple percentiles in a single pass over the buckets; 
+    // pcnt[] must be sorted in ascending order
+    //////////////////////////////////////////////////////////////////
+    void GetPercentileValues( const DOUBLE* pcnt, stat_t* value, int32s cnt ) const
+    {
+        int32s n = 0;
+        int64u sum = 0;
+
+        for( int32s bin = 0; bin < GetBins() && n < cnt; bin++ )
+        {
+            sum += _Count[ bin ];
+            while( n < cnt && sum > 0 && sum >= pcnt[n] * _Total )
+                value[ n++ ] = MIN( GetBinCeil( bin ), GetMax() );
+        }
+        while( n < cnt )
+            value[ n++ ] = _Total? GetMax() : INVALID_VAL;
+    }
+
+    //////////////////////////////////////////////////////////////////
+    template< class archive_t > void Serialize( archive_t& ar )
+    {
+        Stats::Serialize( ar );
+        ar.Vector( _Count );
+        ar.Raw( _Total );
+    }
+};
+
+//////////////////////////////////////////////////////////////////////
+// class QuantileSketch 
+// Constant-memory streaming quantile estimator (KLL sketch). Samples 
+// are kept in a stack of compactors; when a level overflows, it is 
+// sorted and every other sample (random offset) is promoted to the 
+// next level with twice the weight. The rank error is about 1.7/K, 
+// independent of the number and range of samples. Two sketches can 
+// be merged, e.g. after collecting in separate threads.
+//////////////////////////////////////////////////////////////////////
+template < int32s K = 200 > class QuantileSketch : public Stats
+{
+private:
+    std::vector< std::vector< stat_t > > _Level;   // compactors; level h has weight 2^h
+    int32s  _Size;                                  // samples retained in all levels
+    int32u  _Rand;                                  // xorshift state for compaction offsets
+
+    //////////////////////////////////////////////////////////////////
+    // Capacity of a level shrinks geometrically (by 2/3) below the top
+    //////////////////////////////////////////////////////////////////
+    inline int32s _Capacity( int32s level ) const
+    {
+        int32s depth = (int32s)_Level.size() - 1 - level;
+        DOUBLE cap   = K;
+
+        while( depth-- > 0 && cap > 2 )
+            cap *= 2.0 / 3.0;
+        return MAX< int32s >( (int32s)( cap + 0.5 ), 2 );
+    }
+
+    //////////////////////////////////////////////////////////////////
+    inline bool _Coin( void )
+    {
+        _Rand ^= _Rand << 13;
+        _Rand ^= _Rand >> 17;
+        _Rand ^= _Rand << 5;
+        return ( _Rand & 1 ) != 0;
+    }
+
+    //////////////////////////////////////////////////////////////////
+    inline int32s _TotalCapacity( void ) const
+    {
+        int32s cap = 0;
+        for( int32s h = 0; h < (int32s)_Level.size(); h++ )
+            cap += _Capacity( h );
+        return cap;
+    }
+
+    //////////////////////////////////////////////////////////////////
+    // Compact the lowest overflowing level until the sketch fits
+    //////////////////////////////////////////////////////////////////
+    void _Compress( void )
+    {
+        while( _Size >= _TotalCapacity() )
+        {
+            for( int32s h = 0; h < (int32s)_Level.size(); h++ )
+            {
+                if( (int32s)_Level[h].size() < _Capacity( h ))
+                    continue;
+
+                if( h + 1 >= (int32s)_Level.size() )
+                    _Level.push_back( std::vector< stat_t >() );
+
+                std::vector< stat_t >& lvl = _Level[h];
+                std::sort( lvl.begin(), lvl.end() );
+
+                // an odd item stays at this level
+                size_t keep = lvl.size() & 1;
+                for( size_t i = keep + ( _Coin()? 1 : 0 ); i < lvl.size(); i += 2 )
+                    _Level[ h + 1 ].push_back( lvl[i] );
+
+                _Size -= (int32s)( lvl.size() - keep ) / 2;
+                lvl.erase( lvl.begin() + keep, lvl.end() );
+                break;
+            }
+        }
+    }
+
+public:
+    QuantileSketch() : Stats()          { _Rand = 0x2545F491; Clear(); }
+    virtual ~QuantileSketch()           {}
+
+    //////////////////////////////////////////////////////////////////
+    inline void Clear( void )
+    {
+        Stats::Clear();
+        _Level.assign( 1, std::vector< stat_t >() );
+        _Level[0].reserve( K );
+        _Size = 0;
+    }
+    //////////////////////////////////////////////////////////////////
+    inline void Sample( stat_t sample )
+    {
+        Stats::Sample( sample );
+        _Level[0].push_back( sample );
+        if( ++_Size >= _TotalCapacity() )
+            _Compress();
+    }
+    //////////////////////////////////////////////////////////////////
+    inline QuantileSketch& operator+= ( const QuantileSketch& q )
+    {
+        Stats::operator += ( q );
+        while( _Level.size() < q._Level.size() )
+            _Level.push_back( std::vector< stat_t >() );
+        for( size_t h = 0; h < q._Level.size(); h++ )
+            _Level[h].insert( _Level[h].end(), q._Level[h].begin(), q._Level[h].end() );
+        _Size += q._Size;
+        _Compress();
+        return *this;
+    }
+
+    //////////////////////////////////////////////////////////////////
+    // Multiple percentiles in one pass; pcnt[] must be ascending 
+    //////////////////////////////////////////////////////////////////
+    void GetPercentileValues( const DOUBLE* pcnt, stat_t* value, int32s cnt ) const
+    {
+        std::vector< std::pair< stat_t, int64u > > items;
+        int64u total = 0;
+
+        items.reserve( _Size );
+        for( size_t h = 0; h < _Level.size(); h++ )
+            for( size_t i = 0; i < _Level[h].size(); i++ )
+            {
+                items.push_back( std::make_pair( _Level[h][i], (int64u)1 << h ));
+                total += (int64u)1 << h;
+            }
+        std::sort( items.begin(), items.end() );
+
+        int32s n = 0;
+        int64u sum = 0;
+        for( size_t i = 0; i < items.size() && n < cnt; i++ )
+        {
+            sum += items[i].second;
+            while( n < cnt && sum >= pcnt[n] * total && pcnt[n] < 1.0 )
+                value[ n++ ] = items[i].first;
+        }
+        while( n < cnt )
+            value[ n++ ] = total? GetMax() : INVALID_VAL;
+    }
+
+    //////////////////////////////////////////////////////////////////
+    stat_t GetPercentileValue( DOUBLE pcnt ) const
+    {
+        stat_t value;
+        GetPercentileValues( &pcnt, &value, 1 );
+        return value;
+    }
+
+    //////////////////////////////////////////////////////////////////
+    template< class archive_t > void Serialize( archive_t& ar )
+    {
+        int32s levels = (int32s)_Level.size();
+
+        Stats::Serialize( ar );
+        ar.Raw( levels );
+        _Level.resize( levels );
+        for( int32s h = 0; h < levels; h++ )
+            ar.Vector( _Level[h] );
+        ar.Raw( _Size );
+        ar.Raw( _Rand );
+    }
+};
+
+//////////////////////////////////////////////////////////////////////
+// class BatchMeansCI 
+// Confidence intervals of the mean and of a percentile of a 
+// (correlated) series by the method of non-overlapping batch means. 
+// The series is cut into batches of BatchSize() samples; the batch 
+// means and batch percentiles are treated as independent samples, 
+// and a Student-t interval is built over them. For the interval of 
+// the percentile, a batch needs at least 10 / (1 - pcnt) samples; 
+// in smaller batches, the batch percentile is the batch maximum.
+//////////////////////////////////////////////////////////////////////
+class BatchMeansCI
+{
+private:
+    std::vector< stat_t > _Batch;       // samples of the current batch
+    int32s  _BatchSize;
+    DOUBLE  _Pcnt;                      // tracked percentile
+    DOUBLE  _Conf;                      // two-sided confidence level (0.90, 0.95, 0.99)
+    Stats   _Means;                     // statistics of batch means
+    Stats   _Pctls;                     // statistics of batch percentiles
+
+    //////////////////////////////////////////////////////////////////
+    // Student-t quantile for the confidence level (Cornish-Fisher 
+    // expansion around the normal quantile)
+    //////////////////////////////////////////////////////////////////
+    inline DOUBLE _TQuantile( DOUBLE df ) const
+    {
+        DOUBLE z = _Conf >= 0.99 ? 2.575829 : _Conf >= 0.95 ? 1.959964 : 1.644854;
+        DOUBLE z3 = z * z * z, z5 = z3 * z * z;
+        return z + ( z3 + z ) / ( 4 * df ) + ( 5 * z5 + 16 * z3 + 3 * z ) / ( 96 * df * df );
+    }
+
+    //////////////////////////////////////////////////////////////////
+    inline stat_t _HalfWidth( const Stats& st ) const
+    {
+        stat_t n = st.GetCount();
+        if( n < 2 )
+            return INVALID_VAL;
+        // unbiased variance of the batch values
+        stat_t var = st.GetVar() * n / ( n - 1 );
+        return _TQuantile( n - 1 ) * sqrt( var / n );
+    }
+
+public:
+    BatchMeansCI( int32s batch_size = 1000, DOUBLE pcnt = 0.99, DOUBLE conf = 0.95 )
+    {
+        _BatchSize = batch_size;
+        _Pcnt      = pcnt;
+        _Conf      = conf;
+        _Batch.reserve( batch_size );
+    }
+
+    //////////////////////////////////////////////////////////////////
+    inline void Clear( void )
+    {
+        _Batch.clear();
+        _Means.Clear();
+        _Pctls.Clear();
+    }
+    //////////////////////////////////////////////////////////////////
+    inline void Sample( stat_t sample )
+    {
+        _Batch.push_back( sample );
+        if( (int32s)_Batch.size() < _BatchSize )
+            return;
+
+        stat_t sum = 0;
+        for( size_t i = 0; i < _Batch.size(); i++ )
+            sum += _Batch[i];
+        _Means.Sample( sum / _Batch.size() );
+
+        size_t k = MIN< size_t >( (size_t)( _Pcnt * _Batch.size() ), _Batch.size() - 1 );
+        std::nth_element( _Batch.begin(), _Batch.begin() + k, _Batch.end() );
+        _Pctls.Sample( _Batch[k] );
+
+        _Batch.clear();
+    }
+
+    //////////////////////////////////////////////////////////////////
+    inline int32s GetBatches( void )        const { return (int32s)_Means.GetCount(); }
+    inline int32s GetBatchSize( void )      const { return _BatchSize; }
+    inline DOUBLE GetPercentile( void )     const { return _Pcnt; }
+    inline DOUBLE GetConfidence( void )     const { return _Conf; }
+    inline stat_t GetMean( void )           const { return _Means.GetAvg(); }
+    inline stat_t GetMeanHalfWidth( void )  const { return _HalfWidth( _Means ); }
+    inline stat_t GetPctl( void )           const { return _Pctls.GetAvg(); }
+    inline stat_t GetPctlHalfWidth( void )  const { return _HalfWidth( _Pctls ); }
+
+    //////////////////////////////////////////////////////////////////
+    // Relative precision (half-width / estimate); 1.0 if unknown
+    //////////////////////////////////////////////////////////////////
+    inline DOUBLE GetMeanPrecision( void ) const
+    {
+        return GetBatches() >= 2 && GetMean() != 0 ? GetMeanHalfWidth() / fabs( GetMean() ) : 1.0;
+    }
+    inline DOUBLE GetPctlPrecision( void ) const
+    {
+        return GetBatches() >= 2 && GetPctl() != 0 ? GetPctlHalfWidth() / fabs( GetPctl() ) : 1.0;
+    }
+
+    //////////////////////////////////////////////////////////////////
+    // True once both intervals are within the relative precision. An
+    // interval of zero width (all batch percentiles equal, as integer
+    // samples at a hard bound give) has no resolution rather than
+    // a perfect one; it is accepted only after min_flat_batches.
+    //////////////////////////////////////////////////////////////////
+    inline bool Converged( DOUBLE precision, int32s min_batches, int32s min_flat_batches ) const
+    {
+        return GetBatches() >= min_batches &&
+               GetMeanPrecision() <= precision &&
+               GetPctlPrecision() <= precision &&
+               ( GetPctlHalfWidth() > 0 || GetBatches() >= min_flat_batches );
+    }
+
+    //////////////////////////////////////////////////////////////////
+    template< class archive_t > void Serialize( archive_t& ar )
+    {
+        ar.Vector( _Batch );
+        ar.Raw( _BatchSize );
+        ar.Raw( _Pcnt );
+        ar.Raw( _Conf );
+        _Means.Serialize( ar );
+        _Pctls.Serialize( ar );
+    }
+};
+
+//////////////////////////////////////////////////////////////////////
+// MSER-m warm-up detection. The series is averaged in batches of m 
+// samples; the truncation point d (in batches) minimizes the 
+// marginal standard error of the remaining batches,
+//     MSER(d) = SUM_{i>=d} (Y_i - avg(Y_d..))^2 / (k - d)^2,
+// with d limited to the first half of the series. Returns the 
+// number of leading samples that should be discarded.
+//////////////////////////////////////////////////////////////////////
+inline int32s MserTruncation( const stat_t* series, int32s count, int32s m = 5 )
+{
+    int32s k = count / m;
+    if( k < 2 )
+        return 0;
+
+    std::vector< stat_t > batch( k );
+    for( int32s i = 0; i < k; i++ )
+    {
+        stat_t sum = 0;
+        for( int32s j = 0; j < m; j++ )
+            sum += series[ i * m + j ];
+        batch[i] = sum / m;
+    }
+
+    //////////////////////////////////////////////////////////////////
+    // scan from the end so each candidate d costs O(1)
+    //////////////////////////////////////////////////////////////////
+    Stats  tail;
+    int32s best_d   = 0;
+    stat_t best_val = -1;
+
+    for( int32s d = k - 1; d >= 0; d-- )
+    {
+        tail.Sample( batch[d] );
+        if( d > k / 2 )
+            continue;
+
+        stat_t n   = k - d;
+        stat_t val = tail.GetVar() * n / ( n * n );
+        if( best_val < 0 || val <= best_val )
+        {
+            best_val = val;
+            best_d   = d;
+        }
+    }
+    return best_d * m;
+}
+
 //////////////////////////////////////////////////////////////////////
 // class AutoCorr 
 // Calculates auto-correlation of a series 
@@ -241,6 +768,16 @@ public:
 
         return ( _Prod / GetCount() - avg * avg ) / GetVar();
     }
+
+    //////////////////////////////////////////////////////////////////
+    template< class archive_t > void Serialize( archive_t& ar )
+    {
+        Stats::Serialize( ar );
+        ar.Raw( _History );
+        ar.Raw( _Prod );
+        ar.Raw( _Fill );
+        ar.Raw( _Tail );
+    }
 };
 
 #endif // _STATS_H_INCLUDED_